@@ -1,20 +1,20 @@
 // directory.cc
 //	Routines to manage a directory of file names.
 //
-//	The directory is a table of fixed length entries; each
-//	entry represents a single file, and contains the file name,
-//	and the location of the file header on disk.  The fixed size
-//	of each directory entry means that we have the restriction
-//	of a fixed maximum size for file names.
+//	The directory is a table of entries; each entry represents a
+//	single file, and contains the file name, and the location of the
+//	file header on disk.  On disk, the entries have a variable length,
+//	so that long file names only cost space when they are used.
 //
 //	The constructor initializes an empty directory of a certain size;
-//	we use ReadFrom/WriteBack to fetch the contents of the directory
-//	from disk, and to write back any modifications back to disk.
+//	we use FetchFrom/WriteBack to fetch the contents of the directory
+//	from disk, and to write back any modifications back to disk.  Only
+//	the sectors holding records that changed are written back.
 //
-//	Also, this implementation has the restriction that the size
-//	of the directory cannot expand.  In other words, once all the
-//	entries in the directory are used, no more files can be created.
-//	Fixing this is one of the parts to the assignment.
+//	The in-memory table grows when it is full, and is indexed by a
+//	hash table on the file names, so that finding a name does not
+//	depend on the size of the directory.  The caller is responsible
+//	for extending the directory file when Size() exceeds its length.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation
@@ -23,8 +23,31 @@
 #include "directory.h"
 #include "copyright.h"
 #include "filehdr.h"
+#include "journal.h"
 #include "utility.h"
 
+// Number of bytes taken on disk by an entry whose name has "length" characters
+#define EntrySize(length) ((int)(4 * sizeof(int) + divRoundUp(length, sizeof(int)) * sizeof(int)))
+
+// Bytes of the header of a directory file: the format tag and the
+// number of bytes in use
+#define DirHeaderSize (2 * (int)sizeof(int))
+
+//----------------------------------------------------------------------
+// HashName
+// 	Hash function on the file names (djb2).
+//----------------------------------------------------------------------
+
+static unsigned int
+HashName(const char *name)
+{
+    unsigned int hash = 5381;
+
+    while(*name != '\0')
+        hash = hash * 33 + (unsigned char)*name++;
+    return hash;
+}
+
 //----------------------------------------------------------------------
 // Directory::Directory
 // 	Initialize a directory; initially, the directory is completely
@@ -32,15 +55,28 @@
 //	is all we need, but otherwise, we need to call FetchFrom in order
 //	to initialize it from disk.
 //
-//	"size" is the number of entries in the directory
+//	"size" is the number of entries the directory can hold before
+//	having to grow
 //----------------------------------------------------------------------
 
 Directory::Directory(int size)
 {
-    table = new DirectoryEntry[size];
-    tableSize = size;
+    tableSize = (size > 0) ? size : 1;
+    numEntries = 0;
+    table = new DirectoryEntry[tableSize];
+    buckets = new int[tableSize];
+    chain = new int[tableSize];
     for(int i = 0; i < tableSize; i++)
-        table[i].inUse = FALSE;
+        buckets[i] = -1;
+
+    imageSize = SectorSize;
+    image = new char[imageSize];
+    bzero(image, imageSize);
+    used = DirHeaderSize;
+    holes = NULL;
+    numHoles = holesSize = 0;
+    headerDirty = TRUE; // a new directory is written from scratch
+    dirtyFrom = dirtyTo = 0;
 }
 
 //----------------------------------------------------------------------
@@ -48,30 +84,134 @@ Directory::Directory(int size)
 // 	De-allocate directory data structure.
 //----------------------------------------------------------------------
 
-Directory::~Directory() { delete[] table; }
+Directory::~Directory()
+{
+    for(int i = 0; i < numEntries; i++)
+        delete[] table[i].name;
+    delete[] table;
+    delete[] buckets;
+    delete[] chain;
+    delete[] image;
+    delete[] holes;
+}
 
 //----------------------------------------------------------------------
 // Directory::FetchFrom
-// 	Read the contents of the directory from disk.
+// 	Read the contents of the directory from disk, and build the hash
+//	table on the names.
 //
 //	"file" -- file containing the directory contents
 //----------------------------------------------------------------------
 
 void Directory::FetchFrom(OpenFile *file)
 {
-    (void)file->ReadAt((char *)table, tableSize * sizeof(DirectoryEntry), 0);
+    int length = file->Length();
+    int i, magic, position, nameLength, sector, type, size;
+    char name[FileNameMaxLen + 1];
+
+    for(i = 0; i < numEntries; i++)
+        delete[] table[i].name;
+    numEntries = 0;
+    for(i = 0; i < tableSize; i++)
+        buckets[i] = -1;
+    numHoles = 0;
+    used = DirHeaderSize;
+    headerDirty = FALSE;
+    dirtyFrom = dirtyTo = 0;
+
+    if(length < DirHeaderSize)
+        return;
+
+    Reserve(length);
+    (void)file->ReadAt(image, length, 0);
+
+    // a directory written in an older format would be misread
+    bcopy(image, (char *)&magic, sizeof(int));
+    ASSERT(magic == DirectoryMagic);
+    bcopy(&image[sizeof(int)], (char *)&used, sizeof(int));
+    ASSERT(used >= DirHeaderSize && used <= length);
+
+    for(position = DirHeaderSize; position < used; position += EntrySize(nameLength))
+    {
+        ASSERT(position + EntrySize(0) <= used);
+        bcopy(&image[position], (char *)&sector, sizeof(int));
+        bcopy(&image[position + 3 * sizeof(int)], (char *)&nameLength, sizeof(int));
+        ASSERT(nameLength >= 0 && position + EntrySize(nameLength) <= used);
+        if(sector == -1)
+        {
+            AddHole(position);
+            continue;
+        }
+        ASSERT(nameLength <= FileNameMaxLen);
+        bcopy(&image[position + 4 * sizeof(int)], name, nameLength);
+        name[nameLength] = '\0';
+        bcopy(&image[position + sizeof(int)], (char *)&type, sizeof(int));
+        bcopy(&image[position + 2 * sizeof(int)], (char *)&size, sizeof(int));
+        Insert(name, sector, (fileType)type, size, position);
+    }
 }
 
 //----------------------------------------------------------------------
 // Directory::WriteBack
-// 	Write any modifications to the directory back to disk
+// 	Write the modifications to the directory back to disk: the header
+//	if the number of bytes in use changed, and the sectors holding the
+//	records changed since the directory was fetched or last written.
+//	The file must be at least Size() bytes long.
+//
+//	Every change is a few records, so the sectors written (all of them
+//	logged, as metadata) don't depend on the size of the directory.
 //
 //	"file" -- file to contain the new directory contents
 //----------------------------------------------------------------------
 
 void Directory::WriteBack(OpenFile *file)
 {
-    (void)file->WriteAt((char *)table, tableSize * sizeof(DirectoryEntry), 0);
+    int magic = DirectoryMagic;
+
+    ASSERT(file->Length() >= used);
+
+    bcopy((char *)&magic, image, sizeof(int));
+    bcopy((char *)&used, &image[sizeof(int)], sizeof(int));
+    if(headerDirty)
+    {
+        if(dirtyFrom < dirtyTo && dirtyFrom < SectorSize)
+            dirtyFrom = 0; // the header shares the first sector
+        else
+            WriteSectors(file, 0, DirHeaderSize);
+    }
+    if(dirtyFrom < dirtyTo)
+        WriteSectors(file, dirtyFrom, dirtyTo);
+    headerDirty = FALSE;
+    dirtyFrom = dirtyTo = 0;
+}
+
+//----------------------------------------------------------------------
+// Directory::WriteSectors
+// 	Write the sectors of the image holding bytes "from" to "to" to
+//	the directory file.  Whole sectors are written, so that none is
+//	read back to be filled.
+//----------------------------------------------------------------------
+
+void Directory::WriteSectors(OpenFile *file, int from, int to)
+{
+    from = divRoundDown(from, SectorSize) * SectorSize;
+    to = divRoundUp(to, SectorSize) * SectorSize;
+    if(to > file->Length())
+        to = file->Length();
+    // a few records at most: they must fit in the log with the rest of
+    // the operation
+    ASSERT((to - from) / SectorSize <= JournalOpBlocks);
+    (void)file->WriteAt(&image[from], to - from, from);
+}
+
+//----------------------------------------------------------------------
+// Directory::Size
+// 	Return the number of bytes the directory takes on disk.
+//----------------------------------------------------------------------
+
+int Directory::Size()
+{
+    return used;
 }
 
 //----------------------------------------------------------------------
@@ -84,8 +224,8 @@ void Directory::WriteBack(OpenFile *file)
 
 int Directory::FindIndex(const char *name)
 {
-    for(int i = 0; i < tableSize; i++)
-        if(table[i].inUse && !strncmp(table[i].name, name, FileNameMaxLen))
+    for(int i = buckets[HashName(name) % tableSize]; i != -1; i = chain[i])
+        if(!strcmp(table[i].name, name))
             return i;
     return -1; // name not in directory
 }
@@ -108,31 +248,197 @@ int Directory::Find(const char *name)
     return -1;
 }
 
+//----------------------------------------------------------------------
+// Directory::Insert
+// 	Append an entry to the table and to the hash table, growing them
+//	if they are full.  The name must not be in the directory yet; its
+//	record is at "offset" in the image.
+//----------------------------------------------------------------------
+
+void Directory::Insert(const char *name, int newSector, fileType type, int size, int offset)
+{
+    int bucket;
+
+    if(numEntries == tableSize)
+        Resize(2 * tableSize);
+
+    table[numEntries].sector = newSector;
+    table[numEntries].type = type;
+    table[numEntries].size = size;
+    table[numEntries].offset = offset;
+    table[numEntries].name = new char[strlen(name) + 1];
+    strcpy(table[numEntries].name, name);
+
+    bucket = HashName(name) % tableSize;
+    chain[numEntries] = buckets[bucket];
+    buckets[bucket] = numEntries;
+    numEntries++;
+}
+
+//----------------------------------------------------------------------
+// Directory::Resize
+// 	Grow the table to "newSize" entries, and rebuild the hash table
+//	with as many buckets.
+//----------------------------------------------------------------------
+
+void Directory::Resize(int newSize)
+{
+    DirectoryEntry *newTable = new DirectoryEntry[newSize];
+    int i, bucket;
+
+    for(i = 0; i < numEntries; i++)
+        newTable[i] = table[i];
+    delete[] table;
+    delete[] buckets;
+    delete[] chain;
+
+    table = newTable;
+    tableSize = newSize;
+    buckets = new int[tableSize];
+    chain = new int[tableSize];
+    for(i = 0; i < tableSize; i++)
+        buckets[i] = -1;
+    for(i = 0; i < numEntries; i++)
+    {
+        bucket = HashName(table[i].name) % tableSize;
+        chain[i] = buckets[bucket];
+        buckets[bucket] = i;
+    }
+}
+
 //----------------------------------------------------------------------
 // Directory::Add
 // 	Add a file into the directory.  Return TRUE if successful;
 //	return FALSE if the file name is already in the directory, or if
-//	the directory is completely full, and has no more space for
-//	additional file names.
+//	it is too long.
 //
 //	"name" -- the name of the file being added
 //	"newSector" -- the disk sector containing the added file's header
+//	"type" -- the type of the file
+//	"size" -- the size of the file, in bytes
 //----------------------------------------------------------------------
 
-bool Directory::Add(const char *name, int newSector)
+bool Directory::Add(const char *name, int newSector, fileType type, int size)
 {
-    if(FindIndex(name) != -1)
+    int nameLength = strlen(name);
+    int length = EntrySize(nameLength);
+    int offset;
+
+    if(nameLength > FileNameMaxLen || FindIndex(name) != -1)
         return FALSE;
 
-    for(int i = 0; i < tableSize; i++)
-        if(!table[i].inUse)
+    offset = Allocate(length);
+    bzero(&image[offset], length);
+    bcopy((char *)&newSector, &image[offset], sizeof(int));
+    bcopy((char *)&type, &image[offset + sizeof(int)], sizeof(int));
+    bcopy((char *)&size, &image[offset + 2 * sizeof(int)], sizeof(int));
+    bcopy((char *)&nameLength, &image[offset + 3 * sizeof(int)], sizeof(int));
+    bcopy(name, &image[offset + 4 * sizeof(int)], nameLength);
+    Touch(offset, offset + length);
+    Insert(name, newSector, type, size, offset);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Directory::Allocate
+// 	Return the offset of room for a record of "length" bytes: the
+//	first hole large enough, whose rest stays a hole, or the end of
+//	the records in use.
+//----------------------------------------------------------------------
+
+int Directory::Allocate(int length)
+{
+    int offset, holeLength, nameLength;
+
+    for(int h = 0; h < numHoles; h++)
+    {
+        offset = holes[h];
+        bcopy(&image[offset + 3 * sizeof(int)], (char *)&nameLength, sizeof(int));
+        holeLength = EntrySize(nameLength);
+        // the rest of a hole must hold at least a record header
+        if(holeLength != length && holeLength < length + EntrySize(0))
+            continue;
+        holes[h] = holes[--numHoles];
+        if(holeLength > length)
+            FreeRecord(offset + length, holeLength - length);
+        return offset;
+    }
+
+    offset = used;
+    Reserve(used + length);
+    used += length;
+    headerDirty = TRUE;
+    return offset;
+}
+
+//----------------------------------------------------------------------
+// Directory::Stat
+// 	Describe the file of the index-th entry of the directory, from the
+//	cached type and size.  Return FALSE if there are fewer entries.
+//
+//	"index" -- the number of the entry, from 0
+//	"info" -- set to the description of the file
+//----------------------------------------------------------------------
+
+bool Directory::Stat(int index, FileInfo *info)
+{
+    if(index < 0 || index >= numEntries)
+        return FALSE;
+
+    strcpy(info->name, table[index].name);
+    info->type = table[index].type;
+    info->size = table[index].size;
+    info->sector = table[index].sector;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Directory::GetType / GetSize
+// 	Return the cached type / size of the file "name".  The name must
+//	be in the directory for GetType; GetSize returns -1 otherwise.
+//----------------------------------------------------------------------
+
+fileType Directory::GetType(const char *name)
+{
+    int i = FindIndex(name);
+
+    ASSERT(i != -1);
+    return table[i].type;
+}
+
+int Directory::GetSize(const char *name)
+{
+    int i = FindIndex(name);
+
+    if(i != -1)
+        return table[i].size;
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// Directory::SetSize
+// 	Update the cached size of the file whose header is at "sector".
+//	The size is stored in place, so the directory keeps its size on
+//	disk.  Return FALSE if no entry designates that sector.
+//
+//	"sector" -- the sector of the header of the file
+//	"size" -- the new size of the file
+//----------------------------------------------------------------------
+
+bool Directory::SetSize(int sector, int size)
+{
+    for(int i = 0; i < numEntries; i++)
+    {
+        if(table[i].sector == sector && strcmp(table[i].name, ".") &&
+           strcmp(table[i].name, ".."))
         {
-            table[i].inUse = TRUE;
-            strncpy(table[i].name, name, FileNameMaxLen);
-            table[i].sector = newSector;
+            table[i].size = size;
+            bcopy((char *)&size, &image[table[i].offset + 2 * sizeof(int)], sizeof(int));
+            Touch(table[i].offset + 2 * sizeof(int), table[i].offset + 3 * sizeof(int));
             return TRUE;
         }
-    return FALSE; // no space.  Fix when we have extensible files.
+    }
+    return FALSE;
 }
 
 //----------------------------------------------------------------------
@@ -140,45 +446,163 @@ bool Directory::Add(const char *name, int newSector)
 // 	Remove a file name from the directory.  Return TRUE if successful;
 //	return FALSE if the file isn't in the directory.
 //
+//	The last entry of the table is moved into the freed slot, so that
+//	the entries in use stay contiguous.  On disk, the record becomes a
+//	hole, or is dropped if it was the last one.
+//
 //	"name" -- the file name to be removed
 //----------------------------------------------------------------------
 
 bool Directory::Remove(const char *name)
 {
     int i = FindIndex(name);
+    int last = numEntries - 1;
+    int *link, h, offset, nameLength;
 
     if(i == -1)
         return FALSE; // name not in directory
-    table[i].inUse = FALSE;
+
+    offset = table[i].offset;
+    if(offset + EntrySize(strlen(name)) < used)
+        FreeRecord(offset, EntrySize(strlen(name)));
+    else
+    {
+        // the last record: the records in use end before it, and before
+        // the holes it leaves at the end
+        used = offset;
+        headerDirty = TRUE;
+        for(h = 0; h < numHoles; h++)
+        {
+            bcopy(&image[holes[h] + 3 * sizeof(int)], (char *)&nameLength, sizeof(int));
+            if(holes[h] + EntrySize(nameLength) == used)
+            {
+                used = holes[h];
+                holes[h] = holes[--numHoles];
+                h = -1; // look again for the hole before it
+            }
+        }
+    }
+
+    // Unlink the entry from its bucket
+    for(link = &buckets[HashName(name) % tableSize]; *link != i; link = &chain[*link])
+        ;
+    *link = chain[i];
+    delete[] table[i].name;
+
+    // Move the last entry in its place
+    if(i != last)
+    {
+        for(link = &buckets[HashName(table[last].name) % tableSize]; *link != last;
+            link = &chain[*link])
+            ;
+        *link = i;
+        chain[i] = chain[last];
+        table[i] = table[last];
+    }
+    numEntries--;
     return TRUE;
 }
 
 //----------------------------------------------------------------------
-// Directory::List
-// 	List all the file names in the directory.
+// Directory::FreeRecord
+// 	Turn the "length" bytes at "offset" into a hole: a record header
+//	with -1 as its sector, and a name length covering the rest.
 //----------------------------------------------------------------------
 
-void Directory::List()
+void Directory::FreeRecord(int offset, int length)
 {
-    int total = 0;
-    FileHeader *fileHdr;
+    int sector = -1;
+    int nameLength = length - EntrySize(0);
 
-    for(int i = 0; i < tableSize; i++)
-        if(table[i].inUse)
-        {
-            fileHdr = new FileHeader;
-            fileHdr->FetchFrom(table[i].sector);
-            if (fileHdr->IsDataFile()) {
-                printf("%*dB %s\n", 4, fileHdr->FileLength(),table[i].name);
-            } else {
-                printf("%*dB \e[1;34m%s\e[0m\n", 4, fileHdr->FileLength(),table[i].name);
-            }
-            total++;
+    ASSERT(nameLength >= 0 && EntrySize(nameLength) == length);
+    bcopy((char *)&sector, &image[offset], sizeof(int));
+    bcopy((char *)&nameLength, &image[offset + 3 * sizeof(int)], sizeof(int));
+    Touch(offset, offset + EntrySize(0));
+    AddHole(offset);
+}
+
+//----------------------------------------------------------------------
+// Directory::AddHole
+// 	Remember the hole at "offset", growing the table of holes if it
+//	is full.
+//----------------------------------------------------------------------
+
+void Directory::AddHole(int offset)
+{
+    int *bigger;
+
+    if(numHoles == holesSize)
+    {
+        holesSize = (holesSize > 0) ? 2 * holesSize : 8;
+        bigger = new int[holesSize];
+        for(int h = 0; h < numHoles; h++)
+            bigger[h] = holes[h];
+        delete[] holes;
+        holes = bigger;
+    }
+    holes[numHoles++] = offset;
+}
+
+//----------------------------------------------------------------------
+// Directory::Reserve
+// 	Grow the image to hold at least "size" bytes, in whole sectors.
+//----------------------------------------------------------------------
+
+void Directory::Reserve(int size)
+{
+    char *bigger;
+    int newSize = imageSize;
+
+    if(size <= imageSize)
+        return;
+    while(newSize < size)
+        newSize *= 2;
+    newSize = divRoundUp(newSize, SectorSize) * SectorSize;
+    bigger = new char[newSize];
+    bzero(bigger, newSize);
+    bcopy(image, bigger, imageSize);
+    delete[] image;
+    image = bigger;
+    imageSize = newSize;
+}
 
-            delete fileHdr;
+//----------------------------------------------------------------------
+// Directory::Touch
+// 	Record that bytes "from" to "to" of the image changed, so that
+//	WriteBack writes their sectors.
+//----------------------------------------------------------------------
+
+void Directory::Touch(int from, int to)
+{
+    if(dirtyFrom >= dirtyTo)
+    {
+        dirtyFrom = from;
+        dirtyTo = to;
+        return;
+    }
+    if(from < dirtyFrom)
+        dirtyFrom = from;
+    if(to > dirtyTo)
+        dirtyTo = to;
+}
+
+//----------------------------------------------------------------------
+// Directory::List
+// 	List all the file names in the directory, with their cached size.
+//----------------------------------------------------------------------
+
+void Directory::List()
+{
+    for(int i = 0; i < numEntries; i++)
+    {
+        if (table[i].type == DATA_FILE) {
+            printf("%*dB %s\n", 4, table[i].size, table[i].name);
+        } else {
+            printf("%*dB \e[1;34m%s\e[0m\n", 4, table[i].size, table[i].name);
         }
+    }
 
-    DEBUG('f', "Total number of entries: %d\n", total);
+    DEBUG('f', "Total number of entries: %d\n", numEntries);
 }
 
 //----------------------------------------------------------------------
@@ -188,8 +612,8 @@ void Directory::List()
 
 bool Directory::IsEmpty()
 {
-    for(int i = 0; i < tableSize; i++)
-        if(table[i].inUse && !(!strcmp(table[i].name, ".") || !strcmp(table[i].name, ".."))) {
+    for(int i = 0; i < numEntries; i++)
+        if(!(!strcmp(table[i].name, ".") || !strcmp(table[i].name, ".."))) {
             DEBUG('f', "The file %s should not be there\n", table[i].name);
             return FALSE;
         }
@@ -208,13 +632,12 @@ void Directory::Print()
     FileHeader *hdr = new FileHeader;
 
     printf("Directory contents:\n");
-    for(int i = 0; i < tableSize; i++)
-        if(table[i].inUse)
-        {
-            printf("Name: %s, Sector: %d\n", table[i].name, table[i].sector);
-            hdr->FetchFrom(table[i].sector);
-            hdr->Print();
-        }
+    for(int i = 0; i < numEntries; i++)
+    {
+        printf("Name: %s, Sector: %d\n", table[i].name, table[i].sector);
+        hdr->FetchFrom(table[i].sector);
+        hdr->Print();
+    }
     printf("\n");
     delete hdr;
 }
@@ -17,32 +17,67 @@
 #ifndef DIRECTORY_H
 #define DIRECTORY_H
 
+#include "filehdr.h"
 #include "openfile.h"
 
-#define FileNameMaxLen 		9	// for simplicity, we assume 
-					// file names are <= 9 characters long
+#define FileNameMaxLen 		255	// file names are <= 255 characters
+					// long (the kernel string buffers
+					// are MAX_STRING_SIZE bytes)
+#define DirectoryMagic		0x44495233 // "DIR3", first word of
+					// a directory file in this format
 
 // The following class defines a "directory entry", representing a file
 // in the directory.  Each entry gives the name of the file, and where
-// the file's header is to be found on disk.
+// the file's header is to be found on disk.  It also caches the type
+// and the size of the file, so that listing a directory does not read
+// the header of every file (the size is updated when a file that
+// changed size is closed for the last time, or when a directory grows;
+// "." and ".." carry no size).
+//
+// On disk, an entry is stored as a record: the sector number, the type,
+// the size, the length of the name, and the name itself padded to a
+// multiple of sizeof(int).  The record of a removed entry is left as a
+// hole, with -1 as its sector, until an entry that fits reuses it.
 //
 // Internal data structures kept public so that Directory operations can
 // access them directly.
 
 class DirectoryEntry {
   public:
-    bool inUse;				// Is this directory entry in use?
     int sector;				// Location on disk to find the 
 					//   FileHeader for this file 
-    char name[FileNameMaxLen + 1];	// Text name for file, with +1 for 
-					// the trailing '\0'
+    fileType type;			// Type of the file
+    int size;				// Size of the file, in bytes
+    char *name;				// Text name for file
+    int offset;				// Position of its record in the
+					// directory file
+};
+
+// The following class describes a file of a directory, as returned by
+// Directory::Stat.
+
+class FileInfo {
+  public:
+    char name[FileNameMaxLen + 1];	// Text name for file
+    fileType type;			// Type of the file
+    int size;				// Size of the file, in bytes
+    int sector;				// Sector of its header
 };
 
 // The following class defines a UNIX-like "directory".  Each entry in
 // the directory describes a file, and where to find it on disk.
 //
 // The directory data structure can be stored in memory, or on disk.
-// When it is on disk, it is stored as a regular Nachos file.
+// When it is on disk, it is stored as a regular Nachos file: a format
+// tag (DirectoryMagic) and the number of bytes in use, followed by the
+// variable length records of the entries.  The file must be extended
+// (cf. FileHeader::Extend) when the directory outgrows it.
+//
+// In memory, the entries are kept in a table that grows as needed, and
+// indexed by a hash table on their name.  An image of the file is kept
+// too: Add, Remove and SetSize change their records in place, and
+// WriteBack only writes the sectors they touched, so that the journal
+// operation of a Create or a Remove does not grow with the directory.
 //
 // The constructor initializes a directory structure in memory; the
 // FetchFrom/WriteBack operations shuffle the directory information
@@ -57,11 +92,23 @@ class Directory {
     void FetchFrom(OpenFile *file);  	// Init directory contents from disk
     void WriteBack(OpenFile *file);	// Write modifications to 
 					// directory contents back to disk
+    int Size();				// Number of bytes needed to store
+					// the directory on disk (records
+					// and holes)
 
     int Find(const char *name);		// Find the sector number of the 
 					// FileHeader for file: "name"
 
-    bool Add(const char *name, int newSector);  // Add a file name into the directory
+    bool Add(const char *name, int newSector,
+             fileType type, int size);	// Add a file name into the directory
+
+    bool Stat(int index, FileInfo *info); // Describe the index-th file;
+					// FALSE past the last one
+    fileType GetType(const char *name);	// Cached type of a file
+    int GetSize(const char *name);	// Cached size of a file, -1 if
+					// the name isn't in the directory
+    bool SetSize(int sector, int size); // Update the cached size of the
+					// file whose header is at "sector"
 
     bool Remove(const char *name);	// Remove a file from the directory
 
@@ -74,11 +121,41 @@ class Directory {
 
   private:
     int tableSize;			// Number of directory entries
+					// the table can hold
+    int numEntries;			// Number of entries in use, which
+					// are table[0 .. numEntries-1]
     DirectoryEntry *table;		// Table of pairs: 
 					// <file name, file header location> 
+    int *buckets;			// Hash table: first entry of each
+					// bucket, -1 if empty (tableSize
+					// buckets)
+    int *chain;				// Next entry in the same bucket
 
     int FindIndex(const char *name);	// Find the index into the directory 
 					//  table corresponding to "name"
+    void Insert(const char *name, int newSector, fileType type,
+                int size, int offset);	// Append an entry to the table
+    void Resize(int newSize);		// Grow the table and rehash it
+
+    char *image;			// Contents of the directory file
+    int imageSize;			// Bytes allocated for "image", a
+					// multiple of SectorSize
+    int used;				// Bytes of "image" in use
+    int *holes;				// Offsets of the holes
+    int numHoles;			// Number of holes
+    int holesSize;			// Slots allocated for "holes"
+    bool headerDirty;			// Has "used" changed since the last
+					// WriteBack?
+    int dirtyFrom, dirtyTo;		// Bytes of records changed since,
+					// empty if dirtyFrom >= dirtyTo
+
+    void Reserve(int size);		// Grow "image" to "size" bytes
+    int Allocate(int length);		// Find room for a record
+    void FreeRecord(int offset, int length); // Turn a record into a hole
+    void AddHole(int offset);		// Remember a hole
+    void Touch(int from, int to);	// Mark bytes of "image" as changed
+    void WriteSectors(OpenFile *file, int from,
+                      int to);		// Write the sectors of some bytes
 };
 
 #endif // DIRECTORY_H
@@ -3,12 +3,13 @@
 //	would be called the i-node).
 //
 //	The file header is used to locate where on disk the
-//	file's data is stored.  We implement this as a fixed size
-//	table of pointers -- each entry in the table points to the
-//	disk sector containing that portion of the file data
-//	(in other words, there are no indirect or doubly indirect
-//	blocks). The table size is chosen so that the file header
-//	will be just big enough to fit in one disk sector,
+//	file's data is stored.  We implement this as a list of extents --
+//	each extent is a run of consecutive disk sectors holding a
+//	contiguous portion of the file data.  The first extents are kept
+//	in the header sector itself; the others are kept in extent blocks
+//	reached through a single double-indirect sector.  Since the file
+//	data is allocated in runs as long as possible, most files only
+//	need a few extents whatever their size.
 //
 //      Unlike in a real system, we do not keep track of file permissions,
 //	ownership, last modification date, etc., in the file header.
@@ -25,11 +26,41 @@
 #include "copyright.h"
 
 #include "filehdr.h"
-#include "openfile.h"
 #include "string.h"
 #include "system.h"
 #include <cstdio>
 
+//----------------------------------------------------------------------
+// FileHeader::FileHeader
+// 	Initialize an empty file header, and the in-memory copy of its
+//	extent list.
+//----------------------------------------------------------------------
+
+FileHeader::FileHeader() {
+    magic = FileHdrMagic;
+    type = DATA_FILE;
+    numBytes = 0;
+    numSectors = 0;
+    numExtents = 0;
+    doubleIndirect = -1;
+
+    extents = new Extent[MaxExtents];
+    extentOffsets = new int[MaxExtents];
+    extentBlocks = new int[PointersPerBlock];
+    numExtentBlocks = 0;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::~FileHeader
+// 	De-allocate the in-memory extent list.
+//----------------------------------------------------------------------
+
+FileHeader::~FileHeader() {
+    delete[] extents;
+    delete[] extentOffsets;
+    delete[] extentBlocks;
+}
+
 //----------------------------------------------------------------------
 // FileHeader::Allocate
 // 	Initialize a fresh file header for a newly created file.
@@ -43,78 +74,108 @@
 //----------------------------------------------------------------------
 
 bool FileHeader::Allocate(BitMap *freeMap, int fileSize, fileType which, const char *name) {
+    magic = FileHdrMagic;
     numBytes = 0;
     type = which;
     numSectors = 0;
+    numExtents = 0;
+    doubleIndirect = -1;
+    numExtentBlocks = 0;
+    memset(inlineData, 0, MaxInlineBytes);
 
     return Extend(freeMap, fileSize);
-} 
+}
 
 //----------------------------------------------------------------------
-// FileHeader::Deallocate / DeallocateUndirectedBlock
-// 	De-allocate all the space allocated for data blocks for this file.
+// FileHeader::Deallocate
+// 	De-allocate all the space allocated for data blocks for this file,
+//	and the extent blocks describing them.
 //
 //	"freeMap" is the bit map of free disk sectors
 //----------------------------------------------------------------------
 
 void FileHeader::Deallocate(BitMap *freeMap) {
-    FileHeader *fileHdr;
-    OpenFile *file;
-    int sector, leftNumSectors;
-    printf("Deallocate %d \n", numSectors);
-    
-    // Deallocate the sectors of the data blocks (that are not in the undirected block)
-    for (int i = 0; i < (int)(NumDirect - 1) && i < numSectors; i++) {
-        ASSERT(freeMap->Test((int)dataSectors[i])); // ought to be marked!
-        freeMap->Clear((int)dataSectors[i]);
-    }
+    int i, j;
 
-    if (numSectors >= (int)(NumDirect - 1)) { // There is an undirected block
-        fileHdr = new FileHeader();
-        fileHdr->FetchFrom(dataSectors[NumDirect - 1]);
-        leftNumSectors = numSectors - (NumDirect - 1);
-        file = new OpenFile(dataSectors[NumDirect - 1]);
-
-        // Deallocate the sectors that are in the undirected block
-        for (int i = 0; i < leftNumSectors; i++) {
-            file->Read((char *)&sector, 4);
-            ASSERT(freeMap->Test((int)sector)); // ought to be marked!
-            freeMap->Clear((int)sector);
-        }
-
-        // Deallocate the undirected block
-        ASSERT(freeMap->Test((int)dataSectors[NumDirect - 1])); // ought to be marked!
-        freeMap->Clear((int)dataSectors[NumDirect - 1]);
+    DEBUG('f', "Deallocate %d sectors in %d extents\n", numSectors, numExtents);
 
-        fileHdr->DeallocateUndirectedBlock(freeMap);
+    for (i = 0; i < numExtents; i++) {
+        for (j = 0; j < extents[i].length; j++) {
+            ASSERT(freeMap->Test(extents[i].start + j)); // ought to be marked!
+            freeMap->Clear(extents[i].start + j);
+        }
     }
-}
 
-void FileHeader::DeallocateUndirectedBlock(BitMap *freeMap) {
-    printf("Deallocate undirected block %d \n", numSectors);
-    for (int i = 0; i < numSectors; i++) {
-        ASSERT(freeMap->Test((int)dataSectors[i])); // ought to be marked!
-        freeMap->Clear((int)dataSectors[i]);
+    if (doubleIndirect != -1) {
+        for (i = 0; i < numExtentBlocks; i++) {
+            ASSERT(freeMap->Test(extentBlocks[i])); // ought to be marked!
+            freeMap->Clear(extentBlocks[i]);
+        }
+        ASSERT(freeMap->Test(doubleIndirect)); // ought to be marked!
+        freeMap->Clear(doubleIndirect);
     }
 }
 
 //----------------------------------------------------------------------
 // FileHeader::FetchFrom
-// 	Fetch contents of file header from disk.
+// 	Fetch contents of file header from disk, along with the extent
+//	blocks if there are any, and rebuild the in-memory extent list.
 //
 //	"sector" is the disk sector containing the file header
 //----------------------------------------------------------------------
 
-void FileHeader::FetchFrom(int sector) { synchDisk->ReadSector(sector, (char *)this); }
+void FileHeader::FetchFrom(int sector) {
+    int i, inlineCount;
+
+    journal->ReadSector(sector, (char *)this);
+    if (!IsValid()) {
+        DEBUG('f', "Sector %d does not hold a valid file header\n", sector);
+        numExtents = 0;
+        numExtentBlocks = 0;
+        return;
+    }
+
+    inlineCount = (numExtents < (int)NumInlineExtents) ? numExtents : (int)NumInlineExtents;
+    for (i = 0; i < inlineCount; i++)
+        extents[i] = inlineExtents[i];
+
+    numExtentBlocks = 0;
+    if (doubleIndirect != -1) {
+        numExtentBlocks = divRoundUp(numExtents - (int)NumInlineExtents, (int)ExtentsPerBlock);
+        journal->ReadSector(doubleIndirect, (char *)extentBlocks);
+        for (i = 0; i < numExtentBlocks; i++)
+            journal->ReadSector(extentBlocks[i],
+                                (char *)&extents[NumInlineExtents + i * ExtentsPerBlock]);
+    }
+
+    for (i = 0; i < numExtents; i++)
+        extentOffsets[i] = (i == 0) ? 0 : extentOffsets[i - 1] + extents[i - 1].length;
+}
 
 //----------------------------------------------------------------------
 // FileHeader::WriteBack
-// 	Write the modified contents of the file header back to disk.
+// 	Write the modified contents of the file header back to disk,
+//	along with the extent blocks if there are any.
 //
 //	"sector" is the disk sector to contain the file header
 //----------------------------------------------------------------------
 
-void FileHeader::WriteBack(int sector) { synchDisk->WriteSector(sector, (char *)this); }
+void FileHeader::WriteBack(int sector) {
+    int i, inlineCount;
+
+    inlineCount = (numExtents < (int)NumInlineExtents) ? numExtents : (int)NumInlineExtents;
+    for (i = 0; i < inlineCount; i++)
+        inlineExtents[i] = extents[i];
+
+    journal->WriteSector(sector, (char *)this);
+
+    if (doubleIndirect != -1) {
+        journal->WriteSector(doubleIndirect, (char *)extentBlocks);
+        for (i = 0; i < numExtentBlocks; i++)
+            journal->WriteSector(extentBlocks[i],
+                                 (char *)&extents[NumInlineExtents + i * ExtentsPerBlock]);
+    }
+}
 
 //----------------------------------------------------------------------
 // FileHeader::ByteToSector
@@ -123,35 +184,29 @@ void FileHeader::WriteBack(int sector) { synchDisk->WriteSector(sector, (char *)
 //	offset in the file) to a physical address (the sector where the
 //	data at the offset is stored).
 //
+//	The extent list is kept in memory, so this is a binary search on
+//	the logical index of the first sector of each extent.
+//
 //	"offset" is the location within the file of the byte in question
 //----------------------------------------------------------------------
 
 int FileHeader::ByteToSector(int offset) {
-    unsigned int entry, sector, newOffset, size;
-    OpenFile *file;
+    int entry, low, high, middle;
 
     entry = offset / SectorSize;
-    DEBUG('f', "Offset, we want to access to %d\n", offset);
-
-    if (entry < NumDirect - 1) {
-        return dataSectors[entry];
+    ASSERT(entry < numSectors);
+
+    low = 0;
+    high = numExtents - 1;
+    while (low < high) {
+        middle = (low + high + 1) / 2;
+        if (extentOffsets[middle] <= entry)
+            low = middle;
+        else
+            high = middle - 1;
     }
 
-    // Undirected block part
-    file = new OpenFile(dataSectors[NumDirect - 1]);
-    newOffset = offset - (SectorSize * (NumDirect - 1));
-    DEBUG('f', "Offset, we want to access to %d in the undirected data block of size %d\n",
-          newOffset, file->Length());
-
-    // read the sectors in the undirected blocks
-    size = file->ReadAt((char *)&sector, 4, 4 * (newOffset / SectorSize));
-    DEBUG('f', "The size read by the ByteToSector is %d\n", size);
-    ASSERT(size == 4);
-
-    DEBUG('f', "The sector read by the ByteToSector is %d\n", sector);
-
-    delete file;
-    return sector;
+    return extents[low].start + (entry - extentOffsets[low]);
 }
 
 //----------------------------------------------------------------------
@@ -161,6 +216,16 @@ int FileHeader::ByteToSector(int offset) {
 
 int FileHeader::FileLength() { return numBytes; }
 
+//----------------------------------------------------------------------
+// FileHeader::IsValid
+// 	Return if the header has been written with the current on-disk
+//	format (disks formatted by older versions are rejected)
+//----------------------------------------------------------------------
+
+bool FileHeader::IsValid() {
+    return magic == FileHdrMagic && numExtents >= 0 && numExtents <= (int)MaxExtents;
+}
+
 //----------------------------------------------------------------------
 // FileHeader::IsDataFile
 // 	Return if the file is a data file
@@ -182,6 +247,13 @@ bool FileHeader::IsDirectory() { return type == DIRECTORY || type == ROOT; }
 
 bool FileHeader::IsRoot() { return type == ROOT; }
 
+//----------------------------------------------------------------------
+// FileHeader::GetType
+// 	Return the type of the file
+//----------------------------------------------------------------------
+
+fileType FileHeader::GetType() { return type; }
+
 //----------------------------------------------------------------------
 // FileHeader::GetNumBytes
 // 	Return the number of bytes in the file
@@ -190,105 +262,226 @@ bool FileHeader::IsRoot() { return type == ROOT; }
 int FileHeader::GetNumBytes() { return numBytes; }
 
 //----------------------------------------------------------------------
-// FileHeader::Extend / ExtendUndirectedBlock
-// 	Increase the maximal size of the file (the number of sectors).
+// FileHeader::IsInline
+// 	Return TRUE if the data of the file is stored in the header sector:
+//	a data file which has no data sector.
+//----------------------------------------------------------------------
+
+bool FileHeader::IsInline() { return type == DATA_FILE && numSectors == 0; }
+
+//----------------------------------------------------------------------
+// FileHeader::Capacity
+// 	Return the number of bytes the file can hold without being given
+//	new sectors.
+//----------------------------------------------------------------------
+
+int FileHeader::Capacity() { return IsInline() ? MaxInlineBytes : numSectors * SectorSize; }
+
+//----------------------------------------------------------------------
+// FileHeader::ReadInline / WriteInline
+// 	Read/write the data of an inline file.  The header has to be
+//	written back for the changes to reach the disk.
+//
+//	"into" -- the buffer to contain the data
+//	"from" -- the buffer containing the data
+//	"count" -- the number of bytes to transfer
+//	"position" -- the offset within the file of the first byte
+//----------------------------------------------------------------------
+
+void FileHeader::ReadInline(char *into, int count, int position) {
+    ASSERT(IsInline() && position + count <= MaxInlineBytes);
+    memcpy(into, &inlineData[position], count);
+}
+
+void FileHeader::WriteInline(const char *from, int count, int position) {
+    ASSERT(IsInline() && position + count <= MaxInlineBytes);
+    memcpy(&inlineData[position], from, count);
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Extend
+// 	Increase the size of the file, giving it new sectors if the bytes
+//	added don't fit in those it already has.
+//
+//	A data file which still fits in the header sector stays inline.
+//	Otherwise an inline file is given sectors for all its bytes; the
+//	caller has to move the inline data to them.
+//
+//	If there is not enough space, the header and "freeMap" are left
+//	as they were, and FALSE is returned.
 //
 //	"freeMap" is the bit map of free disk sectors
 //	"newSize" is the size (number of bytes) we want to add to the file
 //----------------------------------------------------------------------
 
 bool FileHeader::Extend(BitMap *freeMap, int newSize) {
-    DEBUG('f', "\n\nWE WANT TO EXTEND THE FILE\n");
-    int i, j, sector, numAllocatedSectors, newNumTotalSectors, newNumSectors, undirectedIndex,
-        newUndirectedSectors;
-    FileHeader *fileHdr;
-    OpenFile *file;
-
-    undirectedIndex = NumDirect - 1;
-    newNumTotalSectors = divRoundUp(numBytes + newSize, SectorSize);
-    newNumSectors = newNumTotalSectors - numSectors;
-    numAllocatedSectors = 0;
-
-    // Allocate the sectors for the file (that are not in the undirected blocks)
-    for (i = numSectors; i < newNumTotalSectors && i < undirectedIndex; i++) {
-        if ((dataSectors[i] = freeMap->Find()) == -1) {
-            return FALSE;
-        }
-        numAllocatedSectors++;
+    int newNumSectors;
+
+    if (IsInline() && numBytes + newSize <= MaxInlineBytes) {
+        DEBUG('f', "Extending the inline file of %d bytes\n", newSize);
+        numBytes = numBytes + newSize;
+        return TRUE;
     }
 
-    if (i < newNumTotalSectors) { // Check if we need an undirected block
-        fileHdr = new FileHeader;
-        if (numSectors > undirectedIndex) { // If the undirected block already exists
-            DEBUG('f', "OLD Undirected block\n");
-            fileHdr->FetchFrom(dataSectors[undirectedIndex]);
-            newUndirectedSectors = newNumSectors;
-        } else { // If we need to allocate the header for the undirected block as it doesn't already
-                 // exists
-            DEBUG('f', "NEW Undirected block\n");
-            if ((dataSectors[undirectedIndex] = freeMap->Find()) == -1) {
-                delete fileHdr;
-                return FALSE;
-            }
-            fileHdr->Allocate(freeMap, 0, DATA_FILE, "");
-            newUndirectedSectors = newNumSectors - numAllocatedSectors;
-        }
+    // Sectors preallocated by Reserve may already hold the new bytes
+    newNumSectors = divRoundUp(numBytes + newSize, SectorSize);
+    DEBUG('f', "Extending the file of %d bytes\n", newSize);
+    if (newNumSectors > numSectors && !AllocateSectors(freeMap, newNumSectors))
+        return FALSE;
 
-        // Do the extension of the undirected block
-        if (!fileHdr->ExtendUndirectedBlock(freeMap, newUndirectedSectors)) {
-            delete fileHdr;
-            return FALSE;
-        }
+    numBytes = numBytes + newSize;
+    return TRUE;
+}
 
-        fileHdr->WriteBack(dataSectors[undirectedIndex]);
+//----------------------------------------------------------------------
+// FileHeader::Reserve
+// 	Give the file enough sectors to hold "size" bytes, without changing
+//	its length: later writes up to that size need neither the bit map
+//	nor new extents.  The sectors are allocated at once, as a single
+//	extent if the disk has a free run long enough.
+//
+//	An inline file given sectors stops being inline; the caller has to
+//	move the inline data to them.
+//
+//	If there is not enough space, the header and "freeMap" are left
+//	as they were, and FALSE is returned.
+//
+//	"freeMap" is the bit map of free disk sectors
+//	"size" is the number of bytes the file must be able to hold
+//----------------------------------------------------------------------
+
+bool FileHeader::Reserve(BitMap *freeMap, int size) {
+    if (size <= Capacity())
+        return TRUE;
 
-        file = new OpenFile(dataSectors[undirectedIndex]);
+    DEBUG('f', "Reserving room for %d bytes\n", size);
+    return AllocateSectors(freeMap, divRoundUp(size, SectorSize));
+}
 
-        // Seek to the position where we want to write the sectors in the undirected block
-        file->Seek(file->Length() - (newUndirectedSectors * 4));
+//----------------------------------------------------------------------
+// FileHeader::AllocateSectors
+// 	Increase the number of data sectors of the file to "newNumSectors".
+//	New sectors are taken right after the last extent when they are
+//	free, otherwise as one run as long as possible, so that the file
+//	stays in as few extents as possible.
+//
+//	If there is not enough space, the header and "freeMap" are left
+//	as they were, and FALSE is returned.
+//
+//	"freeMap" is the bit map of free disk sectors
+//	"newNumSectors" is the number of sectors the file must have
+//----------------------------------------------------------------------
 
-        // Write the sectors of the file in the undirected block
-        for (j = 0; j < newUndirectedSectors; j++) {
-            if ((sector = freeMap->Find()) == -1) {
-                delete fileHdr;
-                delete file;
-                return FALSE;
+bool FileHeader::AllocateSectors(BitMap *freeMap, int newNumSectors) {
+    int needed, next, start, length, neededBlocks, i;
+    int oldNumExtents = numExtents;
+    int oldLastLength = (numExtents > 0) ? extents[numExtents - 1].length : 0;
+    int oldNumExtentBlocks = numExtentBlocks;
+
+    needed = newNumSectors - numSectors;
+    DEBUG('f', "Allocating %d new sectors\n", needed);
+
+    while (needed > 0) {
+        // Grow the last extent in place as long as possible
+        if (numExtents > 0) {
+            next = extents[numExtents - 1].start + extents[numExtents - 1].length;
+            if (next < NumSectors && !freeMap->Test(next)) {
+                freeMap->Mark(next);
+                extents[numExtents - 1].length++;
+                needed--;
+                continue;
             }
-            file->Write((char *)&sector, 4);
         }
 
-        delete fileHdr;
-        delete file;
+        // Otherwise, start a new extent
+        if ((start = freeMap->FindRun(needed, &length)) == -1) {
+            DEBUG('f', "No more free sectors on the disk\n");
+            Rollback(freeMap, oldNumExtents, oldLastLength, oldNumExtentBlocks);
+            return FALSE;
+        }
+        if (!AddExtent(start, length)) {
+            DEBUG('f', "The file has too many extents\n");
+            for (i = 0; i < length; i++)
+                freeMap->Clear(start + i);
+            Rollback(freeMap, oldNumExtents, oldLastLength, oldNumExtentBlocks);
+            return FALSE;
+        }
+        needed -= length;
+    }
+
+    // Allocate the extent blocks for the extents that don't fit in the header
+    neededBlocks = 0;
+    if (numExtents > (int)NumInlineExtents)
+        neededBlocks = divRoundUp(numExtents - (int)NumInlineExtents, (int)ExtentsPerBlock);
+    if (neededBlocks > 0 && doubleIndirect == -1) {
+        if ((doubleIndirect = freeMap->Find()) == -1) {
+            Rollback(freeMap, oldNumExtents, oldLastLength, oldNumExtentBlocks);
+            return FALSE;
+        }
+    }
+    while (numExtentBlocks < neededBlocks) {
+        if ((extentBlocks[numExtentBlocks] = freeMap->Find()) == -1) {
+            Rollback(freeMap, oldNumExtents, oldLastLength, oldNumExtentBlocks);
+            return FALSE;
+        }
+        numExtentBlocks++;
     }
 
-    numBytes = numBytes + newSize;
-    numSectors = newNumTotalSectors;
-    DEBUG('f', "WE FINISHED THE EXTEND OF THE FILE\n");
+    numSectors = newNumSectors;
     return TRUE;
 }
 
-bool FileHeader::ExtendUndirectedBlock(BitMap *freeMap, int newSectors) {
-    DEBUG('f', "WE WANT TO EXTEND THE UNDIRECTED BLOCK\n");
-    int i, newNumTotalSectors;
+//----------------------------------------------------------------------
+// FileHeader::Rollback
+// 	Undo a failed Extend: give back to "freeMap" the sectors allocated
+//	since the extent list had "oldNumExtents" extents, the last one
+//	"oldLastLength" sectors long, and "oldNumExtentBlocks" extent blocks.
+//----------------------------------------------------------------------
 
-    newNumTotalSectors = divRoundUp(numBytes + (newSectors * 4), SectorSize);
-    DEBUG('f', "The size of the file is %d; %d;\n", numBytes, newSectors);
+void FileHeader::Rollback(BitMap *freeMap, int oldNumExtents, int oldLastLength,
+                          int oldNumExtentBlocks) {
+    int i, j;
 
-    if (newNumTotalSectors > (int)NumDirect) {
-        DEBUG('f', "Don't have necessary place in order to extend this file\n");
-        return FALSE;
+    for (i = numExtentBlocks - 1; i >= oldNumExtentBlocks; i--)
+        freeMap->Clear(extentBlocks[i]);
+    numExtentBlocks = oldNumExtentBlocks;
+    if (oldNumExtentBlocks == 0 && doubleIndirect != -1) {
+        freeMap->Clear(doubleIndirect);
+        doubleIndirect = -1;
     }
 
-    for (i = numSectors; i < newNumTotalSectors; i++) {
-        if ((dataSectors[i] = freeMap->Find()) == -1) {
-            return FALSE;
-        }
+    for (i = numExtents - 1; i >= oldNumExtents; i--)
+        for (j = 0; j < extents[i].length; j++)
+            freeMap->Clear(extents[i].start + j);
+    numExtents = oldNumExtents;
+
+    if (numExtents > 0) {
+        for (j = oldLastLength; j < extents[numExtents - 1].length; j++)
+            freeMap->Clear(extents[numExtents - 1].start + j);
+        extents[numExtents - 1].length = oldLastLength;
     }
+}
+
+//----------------------------------------------------------------------
+// FileHeader::AddExtent
+// 	Append a new extent at the end of the extent list.
+//	Return FALSE if the list is full.
+//
+//	"start" is the first sector of the extent
+//	"length" is the number of sectors of the extent
+//----------------------------------------------------------------------
 
-    numSectors = newNumTotalSectors;
-    numBytes = numBytes + (newSectors * 4);
+bool FileHeader::AddExtent(int start, int length) {
+    if (numExtents == (int)MaxExtents)
+        return FALSE;
 
-    DEBUG('f', "WE FINISHED THE EXTEND OF THE UNDIRECTED BLOCK\n");
+    extents[numExtents].start = start;
+    extents[numExtents].length = length;
+    if (numExtents == 0)
+        extentOffsets[numExtents] = 0;
+    else
+        extentOffsets[numExtents] = extentOffsets[numExtents - 1] + extents[numExtents - 1].length;
+    numExtents++;
     return TRUE;
 }
 
@@ -299,36 +492,22 @@ bool FileHeader::ExtendUndirectedBlock(BitMap *freeMap, int newSectors) {
 //----------------------------------------------------------------------
 
 void FileHeader::Print() {
-    int i, j, k, sector, sectorPosition;
+    int i, j, k;
     char *data = new char[SectorSize];
-    OpenFile *file;
 
-    printf("FileHeader contents.  File size: %d.  Number of sectors: %d. File blocks:\n", numBytes,
+    printf("FileHeader contents.  File size: %d.  Number of sectors: %d. File extents:\n", numBytes,
            numSectors);
-    for (i = 0; i < numSectors; i++) {
-        if (i < (int)(NumDirect - 1)) {
-            sector = dataSectors[i];
-        } else {
-            sectorPosition = i - (NumDirect - 1);
-            file = new OpenFile(dataSectors[NumDirect - 1]);
-            file->ReadAt((char *)&sector, 4, 4 * sectorPosition);
-            delete file;
-        }
-
-        printf("%d ", sector);
-    }
+    for (i = 0; i < numExtents; i++)
+        printf("[%d..%d] ", extents[i].start, extents[i].start + extents[i].length - 1);
 
     printf("\nFile contents:\n");
+    if (IsInline()) {
+        for (k = 0; k < numBytes; k++)
+            printf("%c", inlineData[k]);
+        printf("\n");
+    }
     for (i = k = 0; i < numSectors; i++) {
-        if (i < (int)(NumDirect - 1)) {
-            sector = dataSectors[i];
-        } else {
-            sectorPosition = i - (NumDirect - 1);
-            file = new OpenFile(dataSectors[NumDirect - 1]);
-            file->ReadAt((char *)&sector, 4, 4 * sectorPosition);
-            delete file;
-        }
-        synchDisk->ReadSector(sector, data);
+        journal->ReadSector(ByteToSector(i * SectorSize), data);
         for (j = 0; (j < SectorSize) && (k < numBytes); j++, k++) {
             printf("%c", data[j]);
         }
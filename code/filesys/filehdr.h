@@ -17,37 +17,63 @@
 #include "bitmap.h"
 #include "disk.h"
 
-#define NumDirect ((SectorSize - (3 * sizeof(int))) / sizeof(int))
-#define MaxFileSize (NumDirect * SectorSize)
+// Version tag stored in every file header, checked when the disk is mounted
+// (also bumped when the format of the directories changes)
+#define FileHdrMagic 0x45585434 // "EXT4"
+
+#define NumInlineExtents ((SectorSize - (6 * sizeof(int))) / sizeof(Extent))
+#define ExtentsPerBlock (SectorSize / sizeof(Extent))
+#define PointersPerBlock (SectorSize / sizeof(int))
+#define MaxExtents (NumInlineExtents + PointersPerBlock * ExtentsPerBlock)
+#define MaxFileSize (NumSectors * SectorSize)
+#define MaxInlineBytes ((int)(NumInlineExtents * sizeof(Extent)))
+                             // Data files up to this size are stored
+                             // in the header sector
 
 enum fileType { DATA_FILE, DIRECTORY, ROOT };
 
+// An extent is a run of "length" consecutive disk sectors starting
+// at sector "start".
+class Extent {
+  public:
+    int start;
+    int length;
+};
+
 // The following class defines the Nachos "file header" (in UNIX terms,
 // the "i-node"), describing where on disk to find all of the data in the file.
-// The file header is organized as a simple table of pointers to
-// data blocks.
+// The file header is organized as a list of extents.
+//
+// The first NumInlineExtents extents are stored in the header sector
+// itself.  When a file is too fragmented for that, the remaining extents
+// are stored in extent blocks (ExtentsPerBlock extents per sector), whose
+// sector numbers are listed in a single double-indirect sector.
 //
-// The file header data structure can be stored in memory or on disk.
-// When it is on disk, it is stored in a single sector -- this means
-// that we assume the size of this data structure to be the same
-// as one disk sector.  Without indirect addressing, this
-// limits the maximum file length to just under 4K bytes.
+// A data file small enough has no data sector at all: its bytes are
+// stored in the header sector, in place of the inline extents.  It is
+// given sectors when it grows beyond MaxInlineBytes.
 //
-// There is no constructor; rather the file header can be initialized
-// by allocating blocks for the file (if it is a new file), or by
-// reading it from disk.
+// When it is on disk, the header itself is stored in a single sector.
+// In memory, the whole extent list is kept along with the logical
+// index of the first sector of each extent, so that ByteToSector is a
+// binary search that never touches the disk.
+//
+// The file header can be initialized by allocating blocks for the file
+// (if it is a new file), or by reading it from disk.
 
 class FileHeader {
   public:
+    FileHeader();  // Initialize an empty in-memory header
+    ~FileHeader(); // De-allocate the in-memory extent list
+
     bool Allocate(BitMap *bitMap,
                   int fileSize,
                   fileType which,
-                  const char *name);                // Initialize a file header,
-                                                    //  including allocating space
-                                                    //  on disk for the file data
-    void Deallocate(BitMap *bitMap);                // De-allocate this file's
-                                                    //  data blocks
-    void DeallocateUndirectedBlock(BitMap *bitMap); // De-allocate the undirected block
+                  const char *name);   // Initialize a file header,
+                                       //  including allocating space
+                                       //  on disk for the file data
+    void Deallocate(BitMap *bitMap);   // De-allocate this file's
+                                       //  data and extent blocks
 
     void FetchFrom(int sectorNumber); // Initialize file header from disk
     void WriteBack(int sectorNumber); // Write modifications to file header
@@ -59,26 +85,49 @@ class FileHeader {
 
     int FileLength();                      // Return the length of the file
                                            // in bytes
-    void SetNumBytes(int newNumBytes);     // Set the numBytes field to a given value
-    void SetNumSectors(int newNumSectors); // Set the numSectors field to a given value
     void Print();                          // Print the contents of the file.
 
+    bool IsValid();     // The header has the current on-disk format
     bool IsDataFile();  // The file is a data file
     bool IsDirectory(); // The file is a directory
     bool IsRoot();      // The file is a Root
+    fileType GetType(); // Return the type of the file
     int GetNumBytes();  // Return the number of bytes of the file
+    bool IsInline();    // The data is stored in the header sector
+    int Capacity();     // Number of bytes the file can hold without
+                        // new sectors
+    void ReadInline(char *into, int count, int position);
+                        // Read/write the data of an inline file
+    void WriteInline(const char *from, int count, int position);
 
     bool Extend(BitMap *freeMap, int newSize); // Extend the file by adding 'newSize' (append)
-    bool ExtendUndirectedBlock(
-        BitMap *freeMap,
-        int newSectors); // Extend the size of the undirected block file with 'newSectors' sectors
+    bool Reserve(BitMap *freeMap, int size);   // Preallocate sectors for 'size'
+                                               // bytes, keeping the length
 
   private:
-    fileType type;              // 0 = File, 1 = Directory, 2 = root Directory
-    int numBytes;               // Number of bytes in the file
-    int numSectors;             // Number of data sectors in the file
-    int dataSectors[NumDirect]; // Disk sector numbers for each data
-                                // block in the file
+    bool AllocateSectors(BitMap *freeMap, int newNumSectors);
+                                           // Grow the file to that many sectors
+    bool AddExtent(int start, int length); // Append sectors to the extent list
+    void Rollback(BitMap *freeMap, int oldNumExtents, int oldLastLength,
+                  int oldNumExtentBlocks); // Undo a failed Extend
+
+    // On-disk part, exactly one sector
+    int magic;                           // FileHdrMagic
+    fileType type;                       // 0 = File, 1 = Directory, 2 = root Directory
+    int numBytes;                        // Number of bytes in the file
+    int numSectors;                      // Number of data sectors in the file
+    int numExtents;                      // Number of extents in the file
+    int doubleIndirect;                  // Sector listing the extent blocks, or -1
+    union {
+        Extent inlineExtents[NumInlineExtents]; // First extents of the file
+        char inlineData[MaxInlineBytes];        // or its data, if inline
+    };
+
+    // In-memory part, rebuilt by FetchFrom
+    Extent *extents;     // All the extents of the file
+    int *extentOffsets;  // Logical sector index of the start of each extent
+    int *extentBlocks;   // Sectors of the extent blocks (PointersPerBlock)
+    int numExtentBlocks; // Number of extent blocks in use
 };
 
 #endif // FILEHDR_H
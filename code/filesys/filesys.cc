@@ -19,22 +19,21 @@
 //	on bootup.
 //
 //	The file system assumes that the bitmap and directory files are
-//	kept "open" continuously while Nachos is running.
+//	kept "open" continuously while Nachos is running.  The contents of
+//	the current directory are also kept in memory.
 //
 //	For those operations (such as Create, Remove) that modify the
 //	directory and/or bitmap, if the operation succeeds, the changes
 //	are written immediately back to disk (the two files are kept
 //	open during all this time).  If the operation fails, and we have
-//	modified part of the directory and/or bitmap, we simply discard
-//	the changed version, without writing it back to disk.
+//	modified part of the bitmap, we simply discard the changed version,
+//	without writing it back to disk; a name added to the in-memory
+//	directory is removed again.
 //
 // 	Our implementation at this point has the following restrictions:
 //
 //	   there is no synchronization for concurrent accesses
 //	   files have a fixed size, set when the file is created
-//	   files cannot be bigger than about 3KB in size
-//	   there is no hierarchical directory structure, and only a limited
-//	     number of files can be added to the system
 //	   there is no attempt to make the system robust to failures
 //	    (if Nachos exits in the middle of an operation that modifies
 //	    the file system, it may corrupt the disk)
@@ -43,6 +42,7 @@
 // All rights reserved.  See copyright.h for copyright notice and limitation
 // of liability and disclaimer of warranty provisions.
 
+
 #include "copyright.h"
 
 #include "bitmap.h"
@@ -50,21 +50,17 @@
 #include "disk.h"
 #include "filehdr.h"
 #include "filesys.h"
+#include "journal.h"
 #include "openfile.h"
+#include "system.h"
 #include <cstring>
 
-// Sectors containing the file headers for the bitmap of free sectors,
-// and the directory of files.  These file headers are placed in well-known
-// sectors, so that they can be located on boot-up.
-#define FreeMapSector 0
-#define RootSector 1
-
-// Initial file sizes for the bitmap and directory; until the file system
-// supports extensible files, the directory size sets the maximum number
-// of files that can be loaded onto the disk.
+// Initial file sizes for the bitmap and directory; directory files are
+// extended when entries are added, so the initial size only needs to
+// hold the "." and ".." entries.
 #define FreeMapFileSize (NumSectors / BitsInByte)
 #define NumDirEntries 10
-#define DirectoryFileSize (sizeof(DirectoryEntry) * NumDirEntries)
+#define DirectoryFileSize SectorSize
 
 //----------------------------------------------------------------------
 // FileSystem::FileSystem
@@ -76,33 +72,42 @@
 //	If format = FALSE, we just have to open the files
 //	representing the bitmap and the directory.
 //
+//	In both cases, the contents of the current directory are then
+//	kept in memory.
+//
 //	"format" -- should we initialize the disk?
 //----------------------------------------------------------------------
 
 FileSystem::FileSystem(bool format) {
     DEBUG('f', "Initializing the file system.\n");
 
-    // Initializing the opened files bit map and static table
-    openedFileMap = new BitMap(10);
+    // Initializing the shared table of the opened files
+    for (int i = 0; i < OpenFileBuckets; i++)
+        openedFiles[i] = NULL;
     openedFileMutex = new Lock("Opened file");
+    kernelFiles = new FileTable;
     // Lock for the freeMap and the current directory
-    freeMapMutex = new Lock("Free Map");
-    directoryMutex = new Lock("Directory");
+    freeMapLock = new RWLock("Free Map");
+    directoryLock = new RWLock("Directory");
+    nameCache = new NameCache;
     // The current directory sector is the root when we start the file system
     DirectorySector = RootSector;
+    directory = new Directory(NumDirEntries);
 
     if (format) {
         BitMap *freeMap = new BitMap(NumSectors);
-        Directory *directory = new Directory(NumDirEntries);
         FileHeader *mapHdr = new FileHeader;
         FileHeader *dirHdr = new FileHeader;
 
         DEBUG('f', "Formatting the file system.\n");
+        journal->Begin();
 
         // First, allocate space for FileHeaders for the directory and bitmap
-        // (make sure no one else grabs these!)
+        // (make sure no one else grabs these!), and for the log
         freeMap->Mark(FreeMapSector);
         freeMap->Mark(RootSector);
+        for (int i = 0; i < LogSectors; i++)
+            freeMap->Mark(LogStart + i);
 
         // Second, allocate space for the data blocks containing the contents
         // of the directory and bitmap files.  There better be enough space!
@@ -139,20 +144,99 @@ FileSystem::FileSystem(bool format) {
         if (DebugIsEnabled('f')) {
             freeMap->Print();
             directory->Print();
-
-            delete freeMap;
-            delete directory;
-            delete mapHdr;
-            delete dirHdr;
         }
+
+        delete freeMap;
+        delete mapHdr;
+        delete dirHdr;
+        journal->End();
+        journal->Sync();
     } else {
+        // Refuse to mount a disk formatted with another file header layout:
+        // the bitmap and root headers would be misread
+        FileHeader *mapHdr = new FileHeader;
+        FileHeader *dirHdr = new FileHeader;
+        mapHdr->FetchFrom(FreeMapSector);
+        dirHdr->FetchFrom(RootSector);
+        if (!mapHdr->IsValid() || !dirHdr->IsValid() || !dirHdr->IsRoot()) {
+            fprintf(stderr, "The disk has an unknown file system format (expected version %x), "
+                            "format it again with -f\n",
+                    FileHdrMagic);
+            Exit(1);
+        }
+        delete mapHdr;
+        delete dirHdr;
+
         // if we are not formatting the disk, just open the files representing
         // the bitmap and directory; these are left open while Nachos is running
         freeMapFile = new OpenFile(FreeMapSector);
         directoryFile = new OpenFile(RootSector);
+        directory->FetchFrom(directoryFile);
     }
 }
 
+//----------------------------------------------------------------------
+// FileSystem::WriteDirectory
+// 	Write a directory back to its file, extending the file first if
+//	the directory has outgrown it.  The caller holds "freeMap" and is
+//	responsible for writing it back.
+//
+//	Return FALSE if the file had to be extended and there is not
+//	enough space on the disk; nothing is written in that case.
+//
+//	"dir" -- the directory to write
+//	"file" -- the file of the directory
+//	"freeMap" -- the bit map of free disk sectors
+//----------------------------------------------------------------------
+
+bool FileSystem::WriteDirectory(Directory *dir, OpenFile *file, BitMap *freeMap) {
+    int missing = dir->Size() - file->Length();
+    int self, parent;
+
+    if (missing > 0 && !file->Extend(freeMap, divRoundUp(missing, SectorSize) * SectorSize)) {
+        DEBUG('f', "No space on disk to extend the directory\n");
+        return FALSE;
+    }
+    file->Flush(); // other open files of the directory read its header
+    dir->WriteBack(file);
+
+    // The entry of a directory which grew, in its parent, caches its size
+    if (missing > 0 && (self = dir->Find(".")) != -1 && (parent = dir->Find("..")) != -1)
+        UpdateCachedSize(parent, self, file->Length());
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::UpdateCachedSize
+// 	Record the new size of a file in its entry of the directory
+//	"parent".  The entry is updated in place, so the directory does
+//	not change size.  The caller holds the directory lock for writing.
+//
+//	"parent" -- the sector of the header of the directory
+//	"sector" -- the sector of the header of the file
+//	"size" -- the new size of the file
+//----------------------------------------------------------------------
+
+void FileSystem::UpdateCachedSize(int parent, int sector, int size) {
+    Directory *parentDirectory;
+    OpenFile *parentFile;
+
+    DEBUG('f', "Size of the file at sector %d is now %d\n", sector, size);
+    if (parent == DirectorySector) {
+        if (directory->SetSize(sector, size))
+            directory->WriteBack(directoryFile);
+        return;
+    }
+
+    parentDirectory = new Directory(NumDirEntries);
+    parentFile = new OpenFile(parent);
+    parentDirectory->FetchFrom(parentFile);
+    if (parentDirectory->SetSize(sector, size))
+        parentDirectory->WriteBack(parentFile);
+    delete parentFile;
+    delete parentDirectory;
+}
+
 //----------------------------------------------------------------------
 // FileSystem::Create
 // 	Create a file in the Nachos file system (similar to UNIX create).
@@ -173,21 +257,24 @@ FileSystem::FileSystem(bool format) {
 // 	Create fails if:
 // 	    the filename is a protected name (. and ..)
 //   	filename already exist in current directory
+//	 	filename is too long
 //	 	no free space for file header
-//	 	no free entry for file in current directory
 //	 	no free space for data blocks for the file
+//	 	no free space to extend the current directory
 //
 //	"name" -- name of file to be created
 //	"initialSize" -- size of file to be created
+//	"preallocate" -- if TRUE, the file is created empty, with sectors
+//	    already allocated for "initialSize" bytes (see PreallocateUser)
 //----------------------------------------------------------------------
 
-bool FileSystem::Create(const char *name, int initialSize) {
-    Directory *directory;
+bool FileSystem::Create(const char *name, int initialSize, bool preallocate) {
     BitMap *freeMap;
     FileHeader *hdr;
     int sector;
 
-    DEBUG('f', "Creating file %s, size %d\n", name, initialSize);
+    DEBUG('f', "Creating file %s, size %d%s\n", name, initialSize,
+          preallocate ? " (preallocated)" : "");
 
     // Check if it is not a protected file (. and .. are protected names)
     if (!strcmp(name, ".") || !strcmp(name, "..")) {
@@ -195,65 +282,68 @@ bool FileSystem::Create(const char *name, int initialSize) {
         return FALSE;
     }
 
-    // Fetch the current directory
-    directory = new Directory(NumDirEntries);
-    directoryMutex->Acquire();
-    directory->FetchFrom(directoryFile);
+    journal->Begin();
+
+    directoryLock->AcquireWrite();
 
     // Check if the filename is not already used by another file
     if (directory->Find(name) != -1) {
         DEBUG('f', "The filename %s already exist\n", name);
-        delete directory;
-        directoryMutex->Release();
+        directoryLock->ReleaseWrite();
+        journal->End();
         return FALSE;
     }
 
     // Fetch the freeMap of sectors
-    freeMapMutex->Acquire();
+    freeMapLock->AcquireWrite();
     freeMap = new BitMap(NumSectors);
     freeMap->FetchFrom(freeMapFile);
     // Allocate a sector for the file header
     if ((sector = freeMap->Find()) == -1) { // If there is no space for the file header
         DEBUG('f', "No space for file header\n");
-        delete directory;
         delete freeMap;
-        freeMapMutex->Release();
-        directoryMutex->Release();
+        freeMapLock->ReleaseWrite();
+        directoryLock->ReleaseWrite();
+        journal->End();
         return FALSE;
     }
 
     // Add the file to the directory
-    if (!directory->Add(name, sector)) {
-        DEBUG('f', "No space in directory\n");
-        delete directory;
+    if (!directory->Add(name, sector, DATA_FILE, preallocate ? 0 : initialSize)) {
+        DEBUG('f', "The filename %s is too long\n", name);
         delete freeMap;
-        freeMapMutex->Release();
-        directoryMutex->Release();
+        freeMapLock->ReleaseWrite();
+        directoryLock->ReleaseWrite();
+        journal->End();
         return FALSE;
     }
 
     hdr = new FileHeader;
-    // Allocate the values to the file header
-    if (!hdr->Allocate(freeMap, initialSize, DATA_FILE, name)) { // If the allocate fails
+    // Allocate the values to the file header, then make room for the
+    // new entry in the directory file
+    if (!hdr->Allocate(freeMap, preallocate ? 0 : initialSize, DATA_FILE, name) ||
+        (preallocate && !hdr->Reserve(freeMap, initialSize)) ||
+        !WriteDirectory(directory, directoryFile, freeMap)) {
         DEBUG('f', "No space on disk for data\n");
-        delete directory;
+        directory->Remove(name);
         delete freeMap;
         delete hdr;
-        freeMapMutex->Release();
-        directoryMutex->Release();
+        freeMapLock->ReleaseWrite();
+        directoryLock->ReleaseWrite();
+        journal->End();
         return FALSE;
     }
 
     // everything worked, flush all changes back to disk
+    nameCache->Invalidate(DirectorySector, name);
     hdr->WriteBack(sector);
-    directory->WriteBack(directoryFile);
     freeMap->WriteBack(freeMapFile);
 
-    delete directory;
     delete freeMap;
     delete hdr;
-    freeMapMutex->Release();
-    directoryMutex->Release();
+    freeMapLock->ReleaseWrite();
+    directoryLock->ReleaseWrite();
+    journal->End();
 
     return TRUE;
 }
@@ -276,16 +366,17 @@ bool FileSystem::Create(const char *name, int initialSize) {
 // 	Create fails if:
 // 	    the dirname is a protected name (. and ..)
 //   	filename already exist in current directory
+//	 	filename is too long
 //	 	no free space for directory header
-//	 	no free entry for directory in current directory
 //	 	no free space for data blocks for the directory
+//	 	no free space to extend the current directory
 //
 //	"name" -- name of directory to be created
 //----------------------------------------------------------------------
 
 bool FileSystem::CreateDir(const char *name) {
     BitMap *freeMap;
-    Directory *newDirectory, *directory;
+    Directory *newDirectory;
     FileHeader *dirHdr;
     OpenFile *newDirectoryFile;
     int sector;
@@ -298,78 +389,88 @@ bool FileSystem::CreateDir(const char *name) {
         return FALSE;
     }
 
-    directoryMutex->Acquire();
-    directory = new Directory(NumDirEntries);
-    directory->FetchFrom(directoryFile);
+    journal->Begin();
+
+    directoryLock->AcquireWrite();
     // Check a file/directory doesn't have a name
     if (directory->Find(name) != -1) {
         DEBUG('f', "The filename %s already exist\n", name);
-        delete directory;
-        directoryMutex->Release();
+        directoryLock->ReleaseWrite();
+        journal->End();
         return FALSE;
     }
 
-    freeMapMutex->Acquire();
+    freeMapLock->AcquireWrite();
     freeMap = new BitMap(NumSectors);
     freeMap->FetchFrom(freeMapFile);
     sector = freeMap->Find(); // find a sector to hold the file header
     if (sector == -1) {
         DEBUG('f', "No space for directory header\n");
-        delete directory;
         delete freeMap;
-        freeMapMutex->Release();
-        directoryMutex->Release();
+        freeMapLock->ReleaseWrite();
+        directoryLock->ReleaseWrite();
+        journal->End();
         return FALSE;
     }
 
     dirHdr = new FileHeader;
     if (!dirHdr->Allocate(freeMap, DirectoryFileSize, DIRECTORY, name)) {
         DEBUG('f', "No space on disk for directory\n");
-        delete directory;
         delete freeMap;
         delete dirHdr;
-        freeMapMutex->Release();
-        directoryMutex->Release();
+        freeMapLock->ReleaseWrite();
+        directoryLock->ReleaseWrite();
+        journal->End();
         return FALSE;
     }
 
-    if (!directory->Add(name, sector)) {
-        DEBUG('f', "No space in directory\n");
-        delete directory;
+    if (!directory->Add(name, sector, DIRECTORY, DirectoryFileSize)) {
+        DEBUG('f', "The filename %s is too long\n", name);
         delete freeMap;
         delete dirHdr;
-        freeMapMutex->Release();
-        directoryMutex->Release();
+        freeMapLock->ReleaseWrite();
+        directoryLock->ReleaseWrite();
+        journal->End();
         return FALSE;
     }
 
-    newDirectory = new Directory(NumDirEntries);
+    // Update the current directory (parent), extending it if needed
+    if (!WriteDirectory(directory, directoryFile, freeMap)) {
+        directory->Remove(name);
+        delete freeMap;
+        delete dirHdr;
+        freeMapLock->ReleaseWrite();
+        directoryLock->ReleaseWrite();
+        journal->End();
+        return FALSE;
+    }
 
+    nameCache->Invalidate(DirectorySector, name);
     DEBUG('f', "Writing headers back to disk.\n");
     dirHdr->WriteBack(sector);
 
-    // Update changes of the bitmap and the current directory (parent)
-    DEBUG('f', "Writing bitmap and directory back to disk.\n");
+    // Update changes of the bitmap
+    DEBUG('f', "Writing bitmap back to disk.\n");
     freeMap->WriteBack(freeMapFile); // flush changes to disk
-    directory->WriteBack(directoryFile);
 
     // Create new directory with the . and .. directory
     // Open the new directory file
+    newDirectory = new Directory(NumDirEntries);
     newDirectoryFile = new OpenFile(sector);
 
     // Add the protected directory . and .. in the new directory
-    newDirectory->Add(".", sector);
-    newDirectory->Add("..", DirectorySector);
+    newDirectory->Add(".", sector, DIRECTORY, 0);
+    newDirectory->Add("..", DirectorySector, (DirectorySector == RootSector) ? ROOT : DIRECTORY, 0);
 
     newDirectory->WriteBack(newDirectoryFile);
 
     delete newDirectoryFile;
     delete newDirectory;
-    delete directory;
     delete freeMap;
     delete dirHdr;
-    freeMapMutex->Release();
-    directoryMutex->Release();
+    freeMapLock->ReleaseWrite();
+    directoryLock->ReleaseWrite();
+    journal->End();
 
     return TRUE;
 }
@@ -389,30 +490,216 @@ bool FileSystem::CreateDir(const char *name) {
 //----------------------------------------------------------------------
 
 OpenFile *FileSystem::Open(const char *name) {
-    Directory *directory = new Directory(NumDirEntries);
     OpenFile *openFile = NULL;
     int sector;
 
     DEBUG('f', "Opening kernel file %s\n", name);
 
-    directoryMutex->Acquire();
-    directory->FetchFrom(directoryFile);
+    directoryLock->AcquireRead();
     sector = directory->Find(name);
     if (sector >= 0)
         openFile = new OpenFile(sector); // name was found in directory
 
-    delete directory;
-    directoryMutex->Release();
+    directoryLock->ReleaseRead();
     return openFile; // return NULL if not found
 }
 
+//----------------------------------------------------------------------
+// FileSystem::CurrentFiles
+// 	Return the descriptor table of the current thread: the one of its
+//	address space, or the kernel one for threads running only in the
+//	kernel.
+//----------------------------------------------------------------------
+
+FileTable *FileSystem::CurrentFiles() {
+#ifdef USER_PROGRAM
+    if (currentThread->space != NULL)
+        return currentThread->space->files;
+#endif
+    return kernelFiles;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::AcquireEntry
+// 	Return the shared entry of the file whose header is at "sector",
+//	with one more reference.  The entry, and the in-core header of
+//	the file, are created on the first open.
+//
+//	"sector" -- the sector of the file header
+//	"parent" -- the sector of the header of the directory of the file
+//----------------------------------------------------------------------
+
+OpenFileEntry *FileSystem::AcquireEntry(int sector, int parent) {
+    OpenFileEntry *entry;
+    int bucket = sector % OpenFileBuckets;
+
+    openedFileMutex->Acquire();
+    for (entry = openedFiles[bucket]; entry != NULL; entry = entry->next)
+        if (entry->sector == sector)
+            break;
+
+    if (entry == NULL) {
+        entry = new OpenFileEntry;
+        entry->sector = sector;
+        entry->object = new OpenFile(sector);
+        entry->parent = parent;
+        entry->length = entry->object->Length();
+        entry->refCount = 0;
+        entry->lock = new RWLock("OpenFile");
+        entry->next = openedFiles[bucket];
+        openedFiles[bucket] = entry;
+    }
+    entry->refCount++;
+    openedFileMutex->Release();
+    return entry;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::ReleaseEntry
+// 	Drop a reference to a shared entry, deleting it, and the in-core
+//	header of its file, when it was the last one.
+//
+//	The header, and the size cached in the directory entry of the file,
+//	are written back while the entry is still in the table: until then
+//	an open finds the in-core header instead of the stale one on disk,
+//	and a Remove sees the file open.  The write back is a journal
+//	operation of its own, so callers must not be inside one.
+//
+//	"entry" -- the shared entry
+//----------------------------------------------------------------------
+
+void FileSystem::ReleaseEntry(OpenFileEntry *entry) {
+    OpenFileEntry **prev;
+
+    openedFileMutex->Acquire();
+    while (entry->refCount == 1 &&
+           (entry->object->IsDirty() || entry->object->Length() != entry->length)) {
+        openedFileMutex->Release();
+        WriteBackEntry(entry);
+        openedFileMutex->Acquire(); // the file may have been reopened meanwhile
+    }
+    if (--entry->refCount > 0) {
+        openedFileMutex->Release();
+        return;
+    }
+
+    for (prev = &openedFiles[entry->sector % OpenFileBuckets]; *prev != entry;
+         prev = &(*prev)->next)
+        ;
+    *prev = entry->next;
+    openedFileMutex->Release();
+
+    delete entry->object; // clean, nothing is written
+    delete entry->lock;
+    delete entry;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::WriteBackEntry
+// 	Log the in-core header of an open file if it changed, and record
+//	its length in its directory entry if it moved, in one journal
+//	operation.  The caller holds a reference to the entry.
+//
+//	"entry" -- the shared entry
+//----------------------------------------------------------------------
+
+void FileSystem::WriteBackEntry(OpenFileEntry *entry) {
+    int length;
+
+    entry->lock->AcquireWrite(); // before Begin, as writers do
+    journal->Begin();
+    entry->object->Flush();
+    length = entry->object->Length();
+    if (length != entry->length) {
+        directoryLock->AcquireWrite();
+        UpdateCachedSize(entry->parent, entry->sector, length);
+        directoryLock->ReleaseWrite();
+        entry->length = length;
+    }
+    journal->End();
+    entry->lock->ReleaseWrite();
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Sync
+// 	Write back the headers of the files still open, and commit the
+//	journal, so that nothing is lost when Nachos halts without the
+//	files being closed.
+//----------------------------------------------------------------------
+
+void FileSystem::Sync() {
+    OpenFileEntry **entries, *entry;
+    int i, count = 0;
+
+    // Hold a reference to every entry, so none goes away while it is
+    // written back
+    openedFileMutex->Acquire();
+    for (i = 0; i < OpenFileBuckets; i++)
+        for (entry = openedFiles[i]; entry != NULL; entry = entry->next)
+            count++;
+    entries = new OpenFileEntry *[count];
+    count = 0;
+    for (i = 0; i < OpenFileBuckets; i++) {
+        for (entry = openedFiles[i]; entry != NULL; entry = entry->next) {
+            entry->refCount++;
+            entries[count++] = entry;
+        }
+    }
+    openedFileMutex->Release();
+
+    for (i = 0; i < count; i++) {
+        WriteBackEntry(entries[i]);
+        ReleaseEntry(entries[i]);
+    }
+    delete[] entries;
+    journal->Sync();
+}
+
+//----------------------------------------------------------------------
+// FileSystem::IsOpen
+// 	Return TRUE if a descriptor is open on the file whose header is
+//	at "sector".
+//
+//	"sector" -- the sector of the file header
+//----------------------------------------------------------------------
+
+bool FileSystem::IsOpen(int sector) {
+    return OpenLength(sector) != -1;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::OpenLength
+// 	Return the length of the file whose header is at "sector", from its
+//	in-core header, or -1 if the file is not open.  The header of an
+//	open file, and the size cached in its directory entry, may not be
+//	up to date until it is closed, or Sync runs.
+//
+//	"sector" -- the sector of the file header
+//----------------------------------------------------------------------
+
+int FileSystem::OpenLength(int sector) {
+    OpenFileEntry *entry;
+    int length = -1;
+
+    openedFileMutex->Acquire();
+    for (entry = openedFiles[sector % OpenFileBuckets]; entry != NULL; entry = entry->next) {
+        if (entry->sector == sector) {
+            length = entry->object->Length();
+            break;
+        }
+    }
+    openedFileMutex->Release();
+    return length;
+}
+
 //----------------------------------------------------------------------
 // FileSystem::OpenUser
 // 	Open a file at user level for reading and writing.
 //	To open a file:
 //	  Find the location of the file's header, using the directory
-//	  Bring the header into memory
-//    Add it to the opened file table
+//	  Get the shared entry of the file, which brings the header into
+//	  memory if the file is not open yet
+//    Add a descriptor to the table of the current process
 //
 //	"name" -- the text name of the file to be opened
 //
@@ -421,177 +708,189 @@ OpenFile *FileSystem::Open(const char *name) {
 //----------------------------------------------------------------------
 
 int FileSystem::OpenUser(const char *name) {
-    Directory *directory = new Directory(NumDirEntries);
-    OpenFile *openFile = NULL;
-    FileHeader *fileHdr;
-    int sector, index, i;
+    UserFile *file;
+    fileType type;
+    int sector, fd;
 
     DEBUG('f', "Opening user file %s\n", name);
 
-    directoryMutex->Acquire();
-    directory->FetchFrom(directoryFile);
-    sector = directory->Find(name);
-
-    if (sector < 0) {
+    directoryLock->AcquireRead();
+    if (!LookupName(DirectorySector, name, &sector, &type)) {
         DEBUG('f', "File didn't found\n");
-        delete directory;
-        directoryMutex->Release();
+        directoryLock->ReleaseRead();
         return -1;
     }
-
-    if ((openFile = new OpenFile(sector)) == NULL) {
-        DEBUG('f', "Open file at kernel level failed\n");
-        delete directory;
-        directoryMutex->Release();
-        return -1;
-    }
-
-    delete directory;
-    directoryMutex->Release();
-
-    fileHdr = new FileHeader;
-    fileHdr->FetchFrom(sector);
-    if (!fileHdr->IsDataFile()) {
+    if (type != DATA_FILE) {
         DEBUG('f', "User can only open data files\n");
-        delete fileHdr;
+        directoryLock->ReleaseRead();
         return -1;
     }
 
-    // Checking if this same file is already opened in the open fd table
-    openedFileMutex->Acquire();
-    for (i = 0; i < MaxOpenedFiles; i++) {
-        if (openedFileMap->Test(i) && openedFiles[i].id == sector) {
-            DEBUG('f', "This file is already opened under an other fd id: %d\n", i);
-            delete fileHdr;
-            openedFileMutex->Release();
-            return -1;
-        }
-    }
-
-    if ((index = openedFileMap->Find()) == -1) {
-        DEBUG('f', "No more slots for opened files\n");
-        openedFileMutex->Release();
+    file = new UserFile;
+    file->entry = AcquireEntry(sector, DirectorySector); // before a Remove can free the file
+    directoryLock->ReleaseRead();
+    file->position = 0;
+    file->mutex = new Lock("UserFile");
+    file->users = 0;
+
+    if ((fd = CurrentFiles()->Add(file)) == -1) {
+        DEBUG('f', "No more descriptors for opened files\n");
+        ReleaseEntry(file->entry);
+        delete file->mutex;
+        delete file;
         return -1;
     }
 
-    openedFiles[index].id = sector;
-    openedFiles[index].object = openFile;
-    openedFiles[index].mutex = new Lock("OpenFile");
-
-    openedFileMutex->Release();
-    delete fileHdr;
-    return index;
+    DEBUG('f', "File %s opened under fd %d, shared by %d descriptors\n", name, fd,
+          file->entry->refCount);
+    return fd;
 }
 
 //----------------------------------------------------------------------
 // FileSystem::CloseUser
 // 	Close a file from reading and writing.
 //
-// 	"index" -- the index of the opened file to close
+// 	"index" -- the descriptor of the opened file to close
 //----------------------------------------------------------------------
 
 int FileSystem::CloseUser(int index) {
-    openedFileMutex->Acquire();
-    if (index < MaxOpenedFiles && openedFileMap->Test(index)) {
-        DEBUG('f', "The file of fd id = %d is close\n", index);
-        openedFiles[index].mutex->Acquire();
-        openedFileMap->Clear(index);
-        delete openedFiles[index].object;
-        openedFiles[index].mutex->Release();
-        delete openedFiles[index].mutex;
-        openedFileMutex->Release();
-        return 0;
+    UserFile *file;
+
+    if ((file = CurrentFiles()->Remove(index)) == NULL) {
+        DEBUG('f', "The file of fd id = %d is not open or it is out of range\n", index);
+        return -1;
     }
 
-    DEBUG('f', "The file of fd id = %d is not open or it is out of range\n", index);
-    openedFileMutex->Release();
-    return -1;
+    DEBUG('f', "The file of fd id = %d is close\n", index);
+    ReleaseEntry(file->entry); // the last close writes the header back
+    delete file->mutex;
+    delete file;
+    return 0;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::CloseAllUser
+// 	Close every descriptor left open by a process, when it ends.
+//
+// 	"files" -- the descriptor table of the process
+//----------------------------------------------------------------------
+
+void FileSystem::CloseAllUser(FileTable *files) {
+    UserFile *file;
+
+    for (int fd = 0; fd < files->Size(); fd++) {
+        if ((file = files->Remove(fd)) != NULL) {
+            ReleaseEntry(file->entry);
+            delete file->mutex;
+            delete file;
+        }
+    }
+}
+
+//----------------------------------------------------------------------
+// FileSystem::ExtendOpenFile
+// 	Add "size" bytes at the end of an open file, whose entry is locked
+//	for writing by the caller.  The bitmap is only fetched, and the
+//	change logged as a journal operation, when the new bytes don't fit
+//	in the sectors the file already has.
+//
+//	"file" -- the open file
+//	"size" -- the number of bytes to add
+//
+//	Return:
+//	    FALSE if there is not enough space on the disk
+//----------------------------------------------------------------------
+
+bool FileSystem::ExtendOpenFile(OpenFile *file, int size) {
+    BitMap *freeMap;
+    bool extended;
+
+    if (!file->NeedsSectors(size))
+        return file->Extend(NULL, size);
+
+    journal->Begin();
+    freeMapLock->AcquireWrite();
+    freeMap = new BitMap(NumSectors);
+    freeMap->FetchFrom(freeMapFile);
+    if ((extended = file->Extend(freeMap, size))) {
+        // Log the header along with the bitmap, so that the new sectors
+        // are never allocated without a header pointing to them
+        freeMap->WriteBack(freeMapFile);
+        file->Flush();
+    }
+    delete freeMap;
+    freeMapLock->ReleaseWrite();
+    journal->End();
+    return extended;
 }
 
 //----------------------------------------------------------------------
 // FileSystem::WriteUser / ReadUser
-// 	Write / Read in the given file.
+// 	Write / Read in the given file, at the seek position of the
+//	descriptor.  The file is locked for writing or reading, so that
+//	reads through different descriptors overlap.
 //
 // 	"buffer" -- the buffer for the write / read action
 // 	"size"   -- the number of byte to write / read
-// 	"index"  -- the file id in which write / read
+// 	"index"  -- the descriptor of the file in which write / read
 //----------------------------------------------------------------------
 
 int FileSystem::WriteUser(const char *buffer, int size, int index) {
     int value, sizeToExtend;
-    BitMap *freeMap;
+    UserFile *userFile;
     OpenFile *file;
-    FileHeader *fileHdr;
 
     DEBUG('f', "\nWRITE USER \n");
 
-    if (index >= MaxOpenedFiles) {
-        DEBUG('f', "Opened file %d out of range\n", index);
+    if ((userFile = CurrentFiles()->Acquire(index)) == NULL) {
+        DEBUG('f', "File index %d isn't an opened file\n", index);
         return -1;
     }
-
-    if (!openedFileMap->Test(index)) {
-        DEBUG('f', "File index %d isn't an opened file\n");
-        return -1;
+    userFile->entry->lock->AcquireWrite();
+    file = userFile->entry->object;
+
+    // Extend the in-core header of the file in place; the bit map is only
+    // needed when the new bytes don't fit in the last sector of the file,
+    // nor in the sectors preallocated for it
+    sizeToExtend = userFile->position + size - file->Length();
+    if (sizeToExtend > 0) {
+        if (!ExtendOpenFile(file, sizeToExtend)) {
+            DEBUG('j', "Need to extend file size and not enough space on the disk\n");
+            userFile->entry->lock->ReleaseWrite();
+            CurrentFiles()->Release(userFile);
+            return -1;
+        }
     }
 
-    openedFiles[index].mutex->Acquire();
-
-    freeMapMutex->Acquire();
-    freeMap = new BitMap(NumSectors);
-    freeMap->FetchFrom(freeMapFile);
-
-    fileHdr = new FileHeader;
-    fileHdr->FetchFrom(openedFiles[index].id);
-
-    sizeToExtend = openedFiles[index].object->GetSeek() + size - fileHdr->GetNumBytes();
-
-    if (sizeToExtend > 0 && fileHdr->Extend(freeMap, sizeToExtend) == FALSE) {
-        DEBUG('j', "Need to extend file size and not enough space on the disk\n");
-        delete fileHdr;
-        delete freeMap;
-        freeMapMutex->Release();
-        openedFiles[index].mutex->Release();
-        return -1;
+    value = file->WriteAt(buffer, size, userFile->position);
+    if (value > 0 && file->IsInline()) {
+        // The data of a small file lives in its header: log it now, so it
+        // is committed with the next group like any other data
+        journal->Begin();
+        file->Flush();
+        journal->End();
     }
-
-    freeMap->WriteBack(freeMapFile); // flush changes to disk
-    fileHdr->WriteBack(openedFiles[index].id);
-    delete fileHdr;
-    delete freeMap;
-    freeMapMutex->Release();
-
-    file = new OpenFile(openedFiles[index].id); // File header changed,
-                                                // so we need to reload the open file
-    fileHdr = new FileHeader;
-    fileHdr->FetchFrom(openedFiles[index].id);
-
-    delete fileHdr;
-
-    // set the seek position of the new file with the old file seek position
-    file->Seek(openedFiles[index].object->GetSeek());
-    value = file->Write(buffer, size);
-    openedFiles[index].object = file;
-    openedFiles[index].mutex->Release();
+    userFile->position += value;
+    userFile->entry->lock->ReleaseWrite();
+    CurrentFiles()->Release(userFile);
     return value;
 }
 
 int FileSystem::ReadUser(char *buffer, int size, int index) {
+    UserFile *userFile;
     int value;
 
-    if (index >= MaxOpenedFiles) {
-        DEBUG('f', "Opened file %d out of range\n", index);
+    if ((userFile = CurrentFiles()->Acquire(index)) == NULL) {
+        DEBUG('f', "File index %d isn't an opened file\n", index);
         return -1;
     }
 
-    if (!openedFileMap->Test(index)) {
-        DEBUG('f', "File index %d isn't an opened file\n");
-        return -1;
-    }
-
-    openedFiles[index].mutex->Acquire();
-    value = openedFiles[index].object->Read(buffer, size);
-    openedFiles[index].mutex->Release();
+    // Readers of the same file, through other descriptors, run in parallel
+    userFile->entry->lock->AcquireRead();
+    value = userFile->entry->object->ReadAt(buffer, size, userFile->position);
+    userFile->entry->lock->ReleaseRead();
+    userFile->position += value;
+    CurrentFiles()->Release(userFile);
     return value;
 }
 
@@ -599,25 +898,169 @@ int FileSystem::ReadUser(char *buffer, int size, int index) {
 // FileSystem::SeekUser
 //  Seek at a position (modulo the file length)
 //
-// 	"index"   -- the file id in which seek
+// 	"index"   -- the descriptor of the file in which seek
 // 	"nbBytes" -- the number of byte to seek
 //----------------------------------------------------------------------
 
 int FileSystem::SeekUser(int index, int nbBytes) {
-    if (index >= MaxOpenedFiles) {
-        DEBUG('f', "Opened file %d out of range\n", index);
+    UserFile *userFile;
+    int length;
+
+    if ((userFile = CurrentFiles()->Acquire(index)) == NULL) {
+        DEBUG('f', "File index %d isn't an opened file\n", index);
         return -1;
     }
 
-    if (!openedFileMap->Test(index)) {
-        DEBUG('f', "File index %d isn't an opened file\n");
+    userFile->entry->lock->AcquireRead();
+    length = userFile->entry->object->Length();
+    userFile->entry->lock->ReleaseRead();
+    userFile->position = (length > 0) ? nbBytes % length : 0;
+    CurrentFiles()->Release(userFile);
+    return 0;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::PreallocateUser
+//  Allocate the sectors a file needs to hold "size" bytes, in as few
+//  extents as possible, without writing them nor changing the length
+//  of the file.  Writes up to that size then only update the in-core
+//  header, with no round trip through the bitmap.
+//
+// 	"index" -- the descriptor of the file
+// 	"size"  -- the number of bytes the file must be able to hold
+//
+//	Return:
+//	    0, or -1 if the descriptor is not open or the disk is full
+//----------------------------------------------------------------------
+
+int FileSystem::PreallocateUser(int index, int size) {
+    UserFile *userFile;
+    OpenFile *file;
+    BitMap *freeMap;
+    bool reserved = TRUE;
+
+    if (size < 0)
+        return -1;
+    if ((userFile = CurrentFiles()->Acquire(index)) == NULL) {
+        DEBUG('f', "File index %d isn't an opened file\n", index);
         return -1;
     }
+    userFile->entry->lock->AcquireWrite();
+    file = userFile->entry->object;
+
+    if (file->NeedsSectors(size - file->Length())) {
+        journal->Begin();
+        freeMapLock->AcquireWrite();
+        freeMap = new BitMap(NumSectors);
+        freeMap->FetchFrom(freeMapFile);
+        if ((reserved = file->Reserve(freeMap, size))) {
+            // Log the header along with the bitmap, in the same operation
+            freeMap->WriteBack(freeMapFile);
+            file->Flush();
+        }
+        delete freeMap;
+        freeMapLock->ReleaseWrite();
+        journal->End();
+    }
 
-    openedFiles[index].mutex->Acquire();
-    openedFiles[index].object->Seek(nbBytes % openedFiles[index].object->Length());
-    openedFiles[index].mutex->Release();
-    return 0;
+    userFile->entry->lock->ReleaseWrite();
+    CurrentFiles()->Release(userFile);
+    if (!reserved)
+        DEBUG('f', "Not enough space on the disk to preallocate %d bytes\n", size);
+    return reserved ? 0 : -1;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::CopyFile
+// 	Copy the data file "from" of the current directory into a new file
+//	"to", without going through user memory:
+//	  Get the shared entry of the source, and its length
+//	  Create the destination with all its sectors preallocated, in as
+//	  few extents as possible
+//	  Move the data CopySectors sectors at a time, with the source
+//	  locked for reading and the destination for writing
+//
+//	The two entries are locked in the order of their header sectors, so
+//	that copies running in opposite directions don't deadlock.  Each
+//	journal operation (the creation, an extension if the source grew,
+//	the release of the entries) is begun at top level, never nested.
+//
+//	"from" -- the name of the file to copy
+//	"to" -- the name of the new file
+//
+//	Return:
+//	    TRUE if the file was copied; FALSE if "from" is not a data
+//	    file, "to" already exists or the disk is full
+//----------------------------------------------------------------------
+
+bool FileSystem::CopyFile(const char *from, const char *to) {
+    OpenFileEntry *source, *dest = NULL;
+    int sector, length, position, count;
+    fileType type;
+    char *buffer;
+    bool copied = FALSE;
+
+    DEBUG('f', "Copying file %s to %s\n", from, to);
+
+    directoryLock->AcquireRead();
+    if (!LookupName(DirectorySector, from, &sector, &type) || type != DATA_FILE) {
+        DEBUG('f', "%s is not a data file\n", from);
+        directoryLock->ReleaseRead();
+        return FALSE;
+    }
+    source = AcquireEntry(sector, DirectorySector); // before a Remove can free the file
+    directoryLock->ReleaseRead();
+
+    source->lock->AcquireRead();
+    length = source->object->Length();
+    source->lock->ReleaseRead();
+
+    if (Create(to, length, TRUE)) {
+        directoryLock->AcquireRead();
+        if (LookupName(DirectorySector, to, &sector, &type))
+            dest = AcquireEntry(sector, DirectorySector);
+        directoryLock->ReleaseRead();
+    }
+
+    if (dest != NULL) {
+        if (source->sector < dest->sector) {
+            source->lock->AcquireRead();
+            dest->lock->AcquireWrite();
+        } else {
+            dest->lock->AcquireWrite();
+            source->lock->AcquireRead();
+        }
+
+        // The source may have grown since the destination was created
+        length = source->object->Length();
+        if (length <= dest->object->Length() ||
+            ExtendOpenFile(dest->object, length - dest->object->Length())) {
+            buffer = new char[CopySectors * SectorSize];
+            for (position = 0; position < length; position += count) {
+                count = CopySectors * SectorSize;
+                if (count > length - position)
+                    count = length - position;
+                count = source->object->ReadAt(buffer, count, position);
+                if (count <= 0 || dest->object->WriteAt(buffer, count, position) != count)
+                    break;
+            }
+            delete[] buffer;
+            copied = (position >= length);
+        }
+
+        dest->lock->ReleaseWrite();
+        source->lock->ReleaseRead();
+    }
+
+    if (dest != NULL)
+        ReleaseEntry(dest); // writes the header back
+    ReleaseEntry(source);
+
+    if (dest != NULL && !copied) {
+        DEBUG('f', "Copy of %s failed, removing %s\n", from, to);
+        Remove(to);
+    }
+    return copied;
 }
 
 //----------------------------------------------------------------------
@@ -635,18 +1078,17 @@ int FileSystem::SeekUser(int index, int nbBytes) {
 //----------------------------------------------------------------------
 
 bool FileSystem::Remove(const char *name) {
-    Directory *directory;
     BitMap *freeMap;
     FileHeader *fileHdr;
-    int sector, i;
+    int sector;
 
-    directoryMutex->Acquire();
-    directory = new Directory(NumDirEntries);
-    directory->FetchFrom(directoryFile);
+    journal->Begin();
+
+    directoryLock->AcquireWrite();
     sector = directory->Find(name);
     if (sector == -1) {
-        delete directory;
-        directoryMutex->Release();
+        directoryLock->ReleaseWrite();
+        journal->End();
         return FALSE; // file not found
     }
 
@@ -654,42 +1096,38 @@ bool FileSystem::Remove(const char *name) {
     fileHdr->FetchFrom(sector);
 
     if (!fileHdr->IsDataFile()) {
-        delete directory;
         delete fileHdr;
-        directoryMutex->Release();
+        directoryLock->ReleaseWrite();
+        journal->End();
         return FALSE;
     }
 
-    // Checking if this same file is already opened in the open fd table
-    openedFileMutex->Acquire();
-    for (i = 0; i < MaxOpenedFiles; i++) {
-        if (openedFileMap->Test(i) && openedFiles[i].id == sector) {
-            DEBUG('f', "This %s file is actually opened\n", name);
-            delete directory;
-            delete fileHdr;
-            openedFileMutex->Release();
-            directoryMutex->Release();
-            return FALSE;
-        }
+    // Checking if this same file is opened by a process
+    if (IsOpen(sector)) {
+        DEBUG('f', "This %s file is actually opened\n", name);
+        delete fileHdr;
+        directoryLock->ReleaseWrite();
+        journal->End();
+        return FALSE;
     }
-    openedFileMutex->Release();
 
     freeMap = new BitMap(NumSectors);
-    freeMapMutex->Acquire();
+    freeMapLock->AcquireWrite();
     freeMap->FetchFrom(freeMapFile);
 
     fileHdr->Deallocate(freeMap); // remove data blocks
     freeMap->Clear(sector);       // remove header block
     directory->Remove(name);
+    nameCache->Invalidate(DirectorySector, name);
 
-    freeMap->WriteBack(freeMapFile);     // flush to disk
-    directory->WriteBack(directoryFile); // flush to disk
+    WriteDirectory(directory, directoryFile, freeMap); // flush to disk
+    freeMap->WriteBack(freeMapFile);                   // flush to disk
 
     delete fileHdr;
-    delete directory;
     delete freeMap;
-    freeMapMutex->Release();
-    directoryMutex->Release();
+    freeMapLock->ReleaseWrite();
+    directoryLock->ReleaseWrite();
+    journal->End();
     return TRUE;
 }
 
@@ -708,21 +1146,21 @@ bool FileSystem::Remove(const char *name) {
 //----------------------------------------------------------------------
 
 bool FileSystem::RemoveDir(const char *name) {
-    Directory *directory, *toDelete;
+    Directory *toDelete;
     OpenFile *toDeleteFile;
     BitMap *freeMap;
     FileHeader *fileHdr;
     int sector;
 
-    directory = new Directory(NumDirEntries);
-    directoryMutex->Acquire();
-    directory->FetchFrom(directoryFile);
+    journal->Begin();
+
+    directoryLock->AcquireWrite();
     sector = directory->Find(name);
 
     if (sector == -1) {
         DEBUG('f', "File %s doesn't exist\n", name);
-        delete directory;
-        directoryMutex->Release();
+        directoryLock->ReleaseWrite();
+        journal->End();
         return FALSE;
     }
 
@@ -731,42 +1169,45 @@ bool FileSystem::RemoveDir(const char *name) {
 
     if (!fileHdr->IsDirectory() || fileHdr->IsRoot()) {
         DEBUG('f', "The file %s is not a directory\n", name);
-        delete directory;
         delete fileHdr;
-        directoryMutex->Release();
+        directoryLock->ReleaseWrite();
+        journal->End();
         return FALSE;
     }
 
     toDelete = new Directory(NumDirEntries);
     toDeleteFile = new OpenFile(sector);
     toDelete->FetchFrom(toDeleteFile);
+    delete toDeleteFile;
 
     if (!toDelete->IsEmpty()) {
         DEBUG('f', "The directory %s is not empty\n", name);
-        delete directory;
         delete fileHdr;
         delete toDelete;
-        directoryMutex->Release();
+        directoryLock->ReleaseWrite();
+        journal->End();
         return FALSE;
     }
 
     freeMap = new BitMap(NumSectors);
-    freeMapMutex->Acquire();
+    freeMapLock->AcquireWrite();
     freeMap->FetchFrom(freeMapFile);
 
     fileHdr->Deallocate(freeMap); // remove data blocks
     freeMap->Clear(sector);       // remove header block
     directory->Remove(name);
+    nameCache->Invalidate(DirectorySector, name);
+    nameCache->InvalidateParent(sector);
 
-    freeMap->WriteBack(freeMapFile);     // flush to disk
-    directory->WriteBack(directoryFile); // flush to disk
+    WriteDirectory(directory, directoryFile, freeMap); // flush to disk
+    freeMap->WriteBack(freeMapFile);                   // flush to disk
 
-    delete directory;
     delete fileHdr;
     delete toDelete;
     delete freeMap;
-    freeMapMutex->Release();
-    directoryMutex->Release();
+    freeMapLock->ReleaseWrite();
+    directoryLock->ReleaseWrite();
+    journal->End();
     return TRUE;
 }
 
@@ -793,12 +1234,12 @@ PathParsed *FileSystem::ParsePath(char *pathName) {
         }
     }
 
-    path = new char *[nbWord];
-
     if (i == 0) { // If the path is empty
         return NULL;
     }
 
+    path = new char *[nbWord];
+
     // Cut the path name
     word = strtok(pathName, "/");
     nbFolders = 0;
@@ -815,59 +1256,89 @@ PathParsed *FileSystem::ParsePath(char *pathName) {
     return pathParsed;
 }
 
+//----------------------------------------------------------------------
+// FileSystem::LookupName
+//  Find a name in a directory, and the type of the file it designates.
+//  The result is taken from the name cache if possible; otherwise the
+//  directory is read (the current directory is already in memory), its
+//  entry giving the type of the file, and the result is added to the
+//  cache.
+//
+//	"parent" -- the sector of the header of the directory
+//	"name" -- the name to look up
+//	"sector" -- set to the sector of the header of the file found
+//	"type" -- set to the type of the file found
+//
+//	Return:
+//	    True if the name exists in the directory
+//----------------------------------------------------------------------
+
+bool FileSystem::LookupName(int parent, const char *name, int *sector, fileType *type) {
+    Directory *parentDirectory;
+    OpenFile *parentFile;
+
+    if (nameCache->Lookup(parent, name, sector, type))
+        return TRUE;
+
+    if (parent == DirectorySector) {
+        if ((*sector = directory->Find(name)) != -1)
+            *type = directory->GetType(name);
+    } else {
+        parentDirectory = new Directory(NumDirEntries);
+        parentFile = new OpenFile(parent);
+        parentDirectory->FetchFrom(parentFile);
+        if ((*sector = parentDirectory->Find(name)) != -1)
+            *type = parentDirectory->GetType(name);
+        delete parentFile;
+        delete parentDirectory;
+    }
+
+    if (*sector == -1)
+        return FALSE;
+
+    nameCache->Insert(parent, name, *sector, *type);
+    return TRUE;
+}
+
 //----------------------------------------------------------------------
 // FileSystem::ChangeDirRec
-//  Change the current directory to the next one.
+//  Follow the path names one directory after the other.
 //
-//	"from" -- the directory we are currently inside
+//	"from" -- the sector of the directory we are currently inside
 //	"paths" -- all the path we want to go inside
 //	"len" -- the number of directory in paths
 //	"to" -- the index of the folder we want to go inside
 //
 //	Return:
-//	    True if we succefully pass through every directory of paths
+//	    The sector of the last directory of paths, or -1 if we can't
+//	    pass through every directory of paths
 //----------------------------------------------------------------------
 
-bool FileSystem::ChangeDirRec(OpenFile *from, char **paths, int len, int to) {
+int FileSystem::ChangeDirRec(int from, char **paths, int len, int to) {
     int sector;
-
-    Directory *directory = new Directory(NumDirEntries);
-    directory->FetchFrom(from);
+    fileType type;
 
     if (to >= len) {
-        return TRUE;
+        return from;
     }
 
-    if ((sector = directory->Find(paths[to])) < 0) { // Check if the directory doesn't exist
+    if (!LookupName(from, paths[to], &sector, &type)) { // Check if the directory doesn't exist
         DEBUG('f', "The directory %s doesn't exist\n", paths[to]);
-        delete directory;
-        return FALSE; // file not found
-    } else {
-
-        FileHeader *hdr = new FileHeader;
-        hdr->FetchFrom(sector);
-        if (!hdr->IsDirectory() && !hdr->IsRoot()) { // Check if it is not a directory
-            DEBUG('f', "The file %s is not a directory\n", paths[to]);
-            delete directory;
-            return FALSE; // file not found
-        }
-
-        DirectorySector = sector;
-        OpenFile *newDirectoryFile = new OpenFile(DirectorySector);
-
-        delete directory;
-        delete hdr;
-
-        directoryFile = newDirectoryFile;
-        DirectorySector = sector;
+        return -1; // file not found
+    }
 
-        return ChangeDirRec(newDirectoryFile, paths, len, to + 1);
+    if (type == DATA_FILE) { // Check if it is not a directory
+        DEBUG('f', "The file %s is not a directory\n", paths[to]);
+        return -1; // file not found
     }
+
+    return ChangeDirRec(sector, paths, len, to + 1);
 }
 
 //----------------------------------------------------------------------
 // FileSystem::ChangeDir
-//  Change the current directory to the wanted one.
+//  Change the current directory to the wanted one.  A path starting
+//  with '/' is followed from the root directory.
 //
 //	"name" -- the path to the directory we want to change to
 //
@@ -876,36 +1347,35 @@ bool FileSystem::ChangeDirRec(OpenFile *from, char **paths, int len, int to) {
 //----------------------------------------------------------------------
 
 bool FileSystem::ChangeDir(char *name) {
-    int tmpSector;
-    bool success;
-    OpenFile *tmpFile;
+    int from, sector;
     PathParsed *pathParsed;
 
+    from = (name[0] == '/') ? RootSector : -1;
     if ((pathParsed = ParsePath(name)) == NULL) {
         return FALSE;
     }
 
-    directoryMutex->Acquire();
-    // Keep the current directory in case if ChangeDirRec fails
-    tmpFile = new OpenFile(DirectorySector);
-    tmpSector = DirectorySector;
+    directoryLock->AcquireWrite();
+    if (from == -1)
+        from = DirectorySector;
 
-    // Realize the changes of directories
-    success = ChangeDirRec(directoryFile, pathParsed->path, pathParsed->nbFolders, 0);
+    // Find the directory, then move into it
+    sector = ChangeDirRec(from, pathParsed->path, pathParsed->nbFolders, 0);
 
-    if (success == FALSE) {
+    if (sector == -1) {
         DEBUG('f', "cd didn't work\n");
-        delete directoryFile;
-        directoryFile = tmpFile;
-        DirectorySector = tmpSector;
-    } else {
+    } else if (sector != DirectorySector) {
         DEBUG('f', "cd work\n");
-        delete tmpFile;
+        delete directoryFile;
+        directoryFile = new OpenFile(sector);
+        DirectorySector = sector;
+        directory->FetchFrom(directoryFile);
     }
 
-    directoryMutex->Release();
+    directoryLock->ReleaseWrite();
+    delete[] pathParsed->path;
     delete pathParsed;
-    return success;
+    return sector != -1;
 }
 
 //----------------------------------------------------------------------
@@ -914,72 +1384,47 @@ bool FileSystem::ChangeDir(char *name) {
 //----------------------------------------------------------------------
 
 bool FileSystem::FileExists(const char *name) {
-    Directory *directory = new Directory(NumDirEntries);
     int sector;
 
-    directoryMutex->Acquire();
-    directory->FetchFrom(directoryFile);
+    directoryLock->AcquireRead();
     sector = directory->Find(name);
-    directoryMutex->Release();
-    delete directory;
+    directoryLock->ReleaseRead();
     return sector != -1;
 }
 
 //----------------------------------------------------------------------
 // FileSystem::GetFileSize
-//  Return the size of the given file
+//  Return the size of the given file, without reading its header
 //----------------------------------------------------------------------
 
 int FileSystem::GetFileSize(const char *name) {
-    Directory *directory = new Directory(NumDirEntries);
     int sector, size;
 
-    directoryMutex->Acquire();
-    directory->FetchFrom(directoryFile);
-    sector = directory->Find(name);
-
-    if (sector == -1){
-        directoryMutex->Release();
+    directoryLock->AcquireRead();
+    if ((sector = directory->Find(name)) == -1) {
+        directoryLock->ReleaseRead();
         return -1;
     }
 
-    FileHeader *hdr = new FileHeader;
-    hdr->FetchFrom(sector);
-    size = hdr->FileLength();
-
-    delete hdr;
-    delete directory;
-    directoryMutex->Release();
+    // The size cached in the directory, unless the file is open
+    if ((size = OpenLength(sector)) == -1)
+        size = directory->GetSize(name);
+    directoryLock->ReleaseRead();
 
     return size;
 }
 
 //----------------------------------------------------------------------
 // FileSystem::IsDataFile
-//  Return if the given file is a data file
+//  Return if the given file is a data file, without reading its header
 //----------------------------------------------------------------------
 
 bool FileSystem::IsDataFile(const char *name) {
-    Directory *directory = new Directory(NumDirEntries);
-    int sector;
     bool isData;
 
-    directoryMutex->Acquire();
-    directory->FetchFrom(directoryFile);
-    sector = directory->Find(name);
-
-    if (sector == -1){
-        directoryMutex->Release();
-        return FALSE;
-    }
-
-    FileHeader *hdr = new FileHeader;
-    hdr->FetchFrom(sector);
-    isData = hdr->IsDataFile();
-
-    delete hdr;
-    delete directory;
-    directoryMutex->Release();
+    directoryLock->AcquireRead();
+    isData = (directory->Find(name) != -1) && directory->GetType(name) == DATA_FILE;
+    directoryLock->ReleaseRead();
 
     return isData;
 }
@@ -990,14 +1435,50 @@ bool FileSystem::IsDataFile(const char *name) {
 //----------------------------------------------------------------------
 
 void FileSystem::List() {
-    Directory *directory = new Directory(NumDirEntries);
+    FileInfo *infos = new FileInfo[ListBatch];
+    int from = 0, count;
+
+    while ((count = ReadDirectory(from, infos, ListBatch)) > 0) {
+        for (int i = 0; i < count; i++) {
+            if (infos[i].type == DATA_FILE)
+                printf("%*dB %s\n", 4, infos[i].size, infos[i].name);
+            else
+                printf("%*dB \e[1;34m%s\e[0m\n", 4, infos[i].size, infos[i].name);
+        }
+        from += count;
+    }
+    delete[] infos;
+}
 
-    directoryMutex->Acquire();
-    directory->FetchFrom(directoryFile);
-    directory->List();
-    directoryMutex->Release();
+//----------------------------------------------------------------------
+// FileSystem::ReadDirectory
+// 	Describe up to "count" files of the current directory, starting
+//	with its from-th entry, in a single scan of the in-memory
+//	directory: the types and sizes come from the directory entries,
+//	and the sizes of open files from their in-core headers.  No file
+//	header is read.
+//
+//	Entries are numbered in the order of the directory; a file
+//	created or removed between two calls may be missed or seen twice.
+//
+//	"from" -- the number of the first entry to describe
+//	"infos" -- the table to fill
+//	"count" -- the size of "infos"
+//
+//	Return:
+//	    The number of files described, 0 past the last entry
+//----------------------------------------------------------------------
 
-    delete directory;
+int FileSystem::ReadDirectory(int from, FileInfo *infos, int count) {
+    int i, length;
+
+    directoryLock->AcquireRead();
+    for (i = 0; i < count && directory->Stat(from + i, &infos[i]); i++) {
+        if (infos[i].type == DATA_FILE && (length = OpenLength(infos[i].sector)) != -1)
+            infos[i].size = length;
+    }
+    directoryLock->ReleaseRead();
+    return i;
 }
 
 //----------------------------------------------------------------------
@@ -1014,7 +1495,6 @@ void FileSystem::Print() {
     FileHeader *bitHdr = new FileHeader;
     FileHeader *dirHdr = new FileHeader;
     BitMap *freeMap = new BitMap(NumSectors);
-    Directory *directory = new Directory(NumDirEntries);
 
     printf("Bit map file header:\n");
     bitHdr->FetchFrom(FreeMapSector);
@@ -1024,20 +1504,18 @@ void FileSystem::Print() {
     dirHdr->FetchFrom(DirectorySector);
     dirHdr->Print();
 
-    freeMapMutex->Acquire();
+    freeMapLock->AcquireRead();
     freeMap->FetchFrom(freeMapFile);
     freeMap->Print();
-    freeMapMutex->Release();
+    freeMapLock->ReleaseRead();
 
-    directoryMutex->Acquire();
-    directory->FetchFrom(directoryFile);
+    directoryLock->AcquireRead();
     directory->Print();
-    directoryMutex->Release();
+    directoryLock->ReleaseRead();
 
     delete bitHdr;
     delete dirHdr;
     delete freeMap;
-    delete directory;
 }
 
 //----------------------------------------------------------------------
@@ -1050,15 +1528,10 @@ void FileSystem::Print() {
 //----------------------------------------------------------------------
 
 void FileSystem::PrintDirectory() {
-    Directory *directory = new Directory(NumDirEntries);
-    
-    directoryMutex->Acquire();
-    directory->FetchFrom(directoryFile);
+    directoryLock->AcquireRead();
     printf("\nInformation of the directory of sector %d:\n", DirectorySector);
     printf("Directory files:\n");
     directory->List();
     directory->Print();
-    directoryMutex->Release();
-    
-    delete directory;
+    directoryLock->ReleaseRead();
 }
@@ -37,11 +37,12 @@
 
 #include "bitmap.h"
 #include "copyright.h"
+#include "directory.h"
+#include "filetable.h"
+#include "namecache.h"
 #include "openfile.h"
 #include "synch.h"
 
-#define MaxOpenedFiles 10
-
 #ifdef FILESYS_STUB // Temporarily implement file system calls as
                     // calls to UNIX, until the real file system
                     // implementation is available
@@ -49,7 +50,7 @@ class FileSystem {
   public:
     FileSystem(bool format) {}
 
-    bool Create(const char *name, int initialSize) {
+    bool Create(const char *name, int initialSize, bool preallocate = FALSE) {
         int fileDescriptor = OpenForWrite(name);
 
         if (fileDescriptor == -1)
@@ -71,11 +72,15 @@ class FileSystem {
 
 #else // FILESYS
 
-typedef struct {
-    OpenFile *object;
-    int id;
-    Lock *mutex;
-} UserFile;
+// Sectors containing the file headers for the bitmap of free sectors,
+// and the directory of files.  These file headers are placed in well-known
+// sectors, so that they can be located on boot-up.  The log of the
+// journal follows them (see journal.h).
+#define FreeMapSector 0
+#define RootSector 1
+
+#define CopySectors 8 // Sectors moved at a time by CopyFile
+#define ListBatch 16   // Files described at a time by List
 
 typedef struct {
     char **path;
@@ -88,7 +93,8 @@ class FileSystem {
                              // *after* "synchDisk" has been initialized. If "format", there is
                              // nothing on the disk, so initialize the directory and the bitmap of
                              // free blocks.
-    bool Create(const char *name, int initialSize); // Create a file (UNIX create)
+    bool Create(const char *name, int initialSize,
+                bool preallocate = FALSE);          // Create a file (UNIX create)
     bool CreateDir(const char *name);               // Create a directory (UNIX mkdir)
 
     OpenFile *Open(const char *name); // Open a file (kernel level)
@@ -99,34 +105,67 @@ class FileSystem {
     int ReadUser(char *buffer, int size, int index);        // Read in a file (UNIX read)
                                                      // return the read size
     int SeekUser(int index, int nbBytes); // Seek at a position in a file (modulo the file size)
+    int PreallocateUser(int index, int size); // Reserve disk space for a file
+                                              // (UNIX fallocate, keeping the size)
+    void CloseAllUser(FileTable *files);  // Close every descriptor of a process
 
+    bool CopyFile(const char *from, const char *to); // Copy a file into a
+                                                     // new one (cp)
     bool Remove(const char *name);    // Delete a file (UNIX unlink)
     bool RemoveDir(const char *name); // Delete a directory (UNIX unlink)
 
     PathParsed *ParsePath(char *pathName); // Parse a path name
     bool ChangeDir(char *name);                        // Change the current directory (UNIX cd)
-    bool ChangeDirRec(OpenFile *from,
-                      char **paths,
-                      int len,
-                      int to); // Change
-                               // the current directory including path names
+    int ChangeDirRec(int from,
+                     char **paths,
+                     int len,
+                     int to); // Find the directory
+                              // reached by following path names
 
     bool FileExists(const char *name); // Check if a file exists in the current directory
     int GetFileSize(const char *name); // Return the size of a file
     bool IsDataFile(const char *name); // Check if a file is a data file
 
     void List();  // List all the files in the file system
+    int ReadDirectory(int from, FileInfo *infos,
+                      int count); // Describe the files of the
+                                  // current directory, from the cache
     void Print(); // List all the files and their contents
     void PrintDirectory();
+    void Sync(); // Write back the headers of the open files, and
+                 // commit the journal (before halting)
   private:
+    bool WriteDirectory(Directory *dir, OpenFile *file,
+                        BitMap *freeMap); // Write a directory back,
+                                          // extending its file if needed
+    bool LookupName(int parent, const char *name, int *sector,
+                    fileType *type); // Find a name in a directory,
+                                     // through the name cache
+    FileTable *CurrentFiles(); // Descriptor table of the current thread
+    OpenFileEntry *AcquireEntry(int sector, int parent); // Get the shared
+                                             // entry of a file, opening it if needed
+    void ReleaseEntry(OpenFileEntry *entry); // Drop a reference to an entry
+    void WriteBackEntry(OpenFileEntry *entry); // Log the header of an open
+                                               // file, and its cached size
+    bool ExtendOpenFile(OpenFile *file, int size); // Add bytes at the end
+                                                   // of a file, logged
+    bool IsOpen(int sector);                 // Is the file open at user level?
+    int OpenLength(int sector);              // In-core length of an open file
+    void UpdateCachedSize(int parent, int sector,
+                          int size); // Record a new size in a directory entry
+
     OpenFile *freeMapFile; // Bit map of free disk blocks, represented as a file
-    Lock *freeMapMutex;
+    RWLock *freeMapLock;
     OpenFile *directoryFile; // Current directory
-    Lock *directoryMutex;
+    Directory *directory;    // Contents of the current directory
+    RWLock *directoryLock;
+    NameCache *nameCache; // Results of the name lookups
     int DirectorySector;   // Sector of the current directory
-    BitMap *openedFileMap; // Bit map of the opened files
+    OpenFileEntry *openedFiles[OpenFileBuckets]; // Shared table of the opened
+                                                 // files, hashed on the sector
     Lock *openedFileMutex;
-    UserFile openedFiles[MaxOpenedFiles]; // Static table of opened files
+    FileTable *kernelFiles; // Descriptors of the threads without an
+                            // address space
 };
 
 #endif // FILESYS
@@ -0,0 +1,151 @@
+// filetable.cc
+//	Routines to manage the descriptor table of a process.
+//
+//	The table lock protects the slots, and the count of the threads
+//	using each descriptor.  A descriptor is used with its mutex held,
+//	taken after the table lock is released, so that a thread waiting
+//	for a busy descriptor doesn't hold up the others.  Remove frees the
+//	slot, then waits until the descriptor has no more users: it is
+//	never closed while another thread of the process is reading or
+//	writing through it.
+
+#include "copyright.h"
+#include "filetable.h"
+
+//----------------------------------------------------------------------
+// FileTable::FileTable
+// 	Initialize an empty descriptor table.
+//----------------------------------------------------------------------
+
+FileTable::FileTable()
+{
+    size = InitialUserFiles;
+    files = new UserFile *[size];
+    for (int i = 0; i < size; i++)
+        files[i] = NULL;
+    lock = new Lock("file table");
+    released = new Condition("file table released");
+}
+
+//----------------------------------------------------------------------
+// FileTable::~FileTable
+// 	De-allocate the descriptor table.
+//----------------------------------------------------------------------
+
+FileTable::~FileTable()
+{
+    for (int i = 0; i < size; i++)
+        ASSERT(files[i] == NULL);
+    delete[] files;
+    delete lock;
+    delete released;
+}
+
+//----------------------------------------------------------------------
+// FileTable::Add
+// 	Give the lowest free descriptor to "file", doubling the size of
+//	the table if every slot is used.
+//
+//	Return the descriptor, or -1 if the process already has
+//	MaxUserFiles open descriptors.
+//
+//	"file" -- the open file
+//----------------------------------------------------------------------
+
+int
+FileTable::Add(UserFile *file)
+{
+    UserFile **bigger;
+    int fd;
+
+    lock->Acquire();
+    for (fd = 0; fd < size; fd++)
+        if (files[fd] == NULL)
+            break;
+
+    if (fd == size) {
+        if (size >= MaxUserFiles) {
+            lock->Release();
+            return -1;
+        }
+        bigger = new UserFile *[size * 2];
+        for (int i = 0; i < size * 2; i++)
+            bigger[i] = (i < size) ? files[i] : NULL;
+        delete[] files;
+        files = bigger;
+        size *= 2;
+        DEBUG('f', "Descriptor table grown to %d slots\n", size);
+    }
+
+    files[fd] = file;
+    lock->Release();
+    return fd;
+}
+
+//----------------------------------------------------------------------
+// FileTable::Acquire
+// 	Return the file of the descriptor "fd", with its mutex held.
+//	The caller must give it back with Release when done.
+//
+//	"fd" -- the descriptor
+//----------------------------------------------------------------------
+
+UserFile *
+FileTable::Acquire(int fd)
+{
+    UserFile *file = NULL;
+
+    lock->Acquire();
+    if (fd >= 0 && fd < size && files[fd] != NULL) {
+        file = files[fd];
+        file->users++; // keeps the file from being deleted
+    }
+    lock->Release();
+
+    if (file != NULL)
+        file->mutex->Acquire();
+    return file;
+}
+
+//----------------------------------------------------------------------
+// FileTable::Release
+// 	Release the mutex of a file returned by Acquire, and wake up a
+//	Remove waiting for its last user.
+//
+//	"file" -- the file
+//----------------------------------------------------------------------
+
+void
+FileTable::Release(UserFile *file)
+{
+    file->mutex->Release();
+    lock->Acquire();
+    if (--file->users == 0)
+        released->Broadcast(lock);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// FileTable::Remove
+// 	Free the descriptor "fd", once no thread uses it anymore, and
+//	return its file.  The caller drops the reference to the shared
+//	entry and deletes the file.
+//
+//	"fd" -- the descriptor
+//----------------------------------------------------------------------
+
+UserFile *
+FileTable::Remove(int fd)
+{
+    UserFile *file = NULL;
+
+    lock->Acquire();
+    if (fd >= 0 && fd < size && files[fd] != NULL) {
+        file = files[fd];
+        files[fd] = NULL; // no new user can find it
+        while (file->users > 0)
+            released->Wait(lock);
+    }
+    lock->Release();
+    return file;
+}
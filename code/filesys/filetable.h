@@ -0,0 +1,78 @@
+// filetable.h
+//	Data structures for the files opened at user level.
+//
+//	Opening files is done in two levels, as in UNIX.  The file system
+//	keeps a single table of the open files, with one entry per file
+//	header, shared by every descriptor on that file: opening the same
+//	file twice only reads its header once.  Each process then has its
+//	own table of descriptors, each with its own seek position and a
+//	pointer to the shared entry.
+//
+//	Shared entries are reference counted: the file system deletes an
+//	entry when the last descriptor pointing to it is closed.
+
+#ifndef FILETABLE_H
+#define FILETABLE_H
+
+#include "copyright.h"
+#include "openfile.h"
+#include "synch.h"
+
+#define OpenFileBuckets 64 // number of hash buckets of the open file table
+#define InitialUserFiles 16 // initial size of a descriptor table
+#define MaxUserFiles 1024   // maximum number of descriptors per process
+
+// The following class defines an entry of the open file table: the
+// in-core header of the file whose header is at "sector", used by
+// "refCount" descriptors.
+
+class OpenFileEntry {
+  public:
+    int sector;          // Sector of the file header
+    int parent;          // Sector of the header of its directory
+    OpenFile *object;    // The file, with its in-core header
+    int length;          // Length of the file when it was opened, as
+                         // cached in its directory entry
+    int refCount;        // Number of descriptors on this entry
+    RWLock *lock;        // Protects the data and the header of the file
+    OpenFileEntry *next; // Next entry of the bucket
+};
+
+// The following class defines a descriptor of an open file.
+
+class UserFile {
+  public:
+    OpenFileEntry *entry; // The shared open file
+    int position;         // Seek position of this descriptor
+    Lock *mutex;          // Serializes the uses of this descriptor
+    int users;            // Threads using it, or waiting for its mutex;
+                          // counted under the lock of the table
+};
+
+// The following class defines the descriptor table of a process.
+// Descriptors are small integers, indexes in a table which is grown
+// (up to MaxUserFiles entries) when it is full.
+
+class FileTable {
+  public:
+    FileTable();  // Initialize an empty table
+    ~FileTable(); // De-allocate the table; every descriptor
+                  // must have been closed before
+
+    int Add(UserFile *file); // Give a descriptor to "file";
+                             // return -1 if the table is full
+    UserFile *Acquire(int fd); // Return the file of "fd", with its
+                               // mutex held; NULL if "fd" is not open
+    void Release(UserFile *file); // Done with a file returned by Acquire
+    UserFile *Remove(int fd);  // Free the descriptor "fd" and return
+                               // its file; NULL if "fd" is not open
+    int Size() { return size; } // Number of slots of the table
+
+  private:
+    UserFile **files; // Table of the descriptors, NULL if free
+    int size;         // Number of slots of "files"
+    Lock *lock;       // Mutual exclusion on the table
+    Condition *released; // Signaled when a file has no more users
+};
+
+#endif // FILETABLE_H
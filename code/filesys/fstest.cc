@@ -7,6 +7,7 @@
 //	   Perftest -- a stress test for the Nachos file system
 //		read and write a really large file in tiny chunks
 //		(won't work on baseline system!)
+//	   Benchmark -- a reproducible set of timed file system workloads
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation
@@ -14,6 +15,8 @@
 
 #include "copyright.h"
 
+#include <sys/time.h>
+
 #include "disk.h"
 #include "filesys.h"
 #include "stats.h"
@@ -200,6 +203,297 @@ void PerformanceTest() {
     stats->Print();
 }
 
+//----------------------------------------------------------------------
+// FileSystemBenchmark
+// 	Run a fixed set of workloads on the Nachos file system, and print
+//	one line per run, so that the results can be compared from one
+//	version of the file system to the next:
+//
+//	  bench <run> size=<bytes> chunk=<bytes> ticks=<simulated ticks>
+//	        reads=<disk reads> writes=<disk writes> wall_us=<host time>
+//	        bytes=<bytes moved> kb_per_sim_sec=<..> kb_per_wall_sec=<..>
+//
+//	Each run ends with a journal Sync, so that the disk writes it
+//	caused are all counted.  Random offsets come from Random, and so
+//	are repeatable for a given -rs seed.
+//
+//	The workloads are:
+//	  seqwrite, seqread, randwrite, randread -- one file, for several
+//		file and transfer sizes
+//	  createstorm -- create then remove many empty files
+//	  deeplookup -- change to a deeply nested directory by its path
+//	  listing -- look up the size and type of every file of a
+//		directory, as "ls -l" does
+//	  concurrent -- writer and reader kernel threads at the same time
+//
+//	"only" -- if not NULL, run only the workloads whose name starts
+//		with this string
+//----------------------------------------------------------------------
+
+#define BenchFile "BenchFile"
+#define BenchStormFiles 64     // files of the create/remove storm
+#define BenchListFiles 32      // files of the listed directory
+#define BenchListRounds 8      // listings of that directory
+#define BenchDepth 8           // nesting of the deep lookup directories
+#define BenchLookups 64        // number of deep lookups
+#define BenchThreads 4         // threads of the concurrent run, half of
+                               // them writers
+#define BenchThreadSize 4096   // bytes written or read by each thread
+
+static const int benchSizes[] = {1024, 8192, 32768};
+static const int benchChunks[] = {16, SectorSize, 4 * SectorSize};
+
+static long long benchTicks;   // stats at the start of the run
+static int benchReads, benchWrites, benchSectors;
+static long long benchWall;
+
+static long long BenchWallMicros() {
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return (long long)now.tv_sec * 1000000 + now.tv_usec;
+}
+
+static void BenchStart() {
+    benchTicks = stats->totalTicks;
+    benchReads = stats->numDiskReads;
+    benchWrites = stats->numDiskWrites;
+    benchSectors = stats->numDiskSectorsRead + stats->numDiskSectorsWritten;
+    benchWall = BenchWallMicros();
+}
+
+static void BenchReport(const char *run, int size, int chunk, int bytes) {
+    long long ticks, wall;
+
+    journal->Sync();
+    ticks = stats->totalTicks - benchTicks;
+    wall = BenchWallMicros() - benchWall;
+    if (ticks <= 0)
+        ticks = 1;
+    if (wall <= 0)
+        wall = 1;
+
+    // A tick stands for a microsecond (see stats.h)
+    // reads= and writes= count requests, sectors= what they moved
+    printf("bench %s size=%d chunk=%d ticks=%lld reads=%d writes=%d sectors=%d wall_us=%lld "
+           "bytes=%d kb_per_sim_sec=%.1f kb_per_wall_sec=%.1f\n",
+           run, size, chunk, ticks, stats->numDiskReads - benchReads,
+           stats->numDiskWrites - benchWrites,
+           stats->numDiskSectorsRead + stats->numDiskSectorsWritten - benchSectors, wall, bytes,
+           bytes * 1000000.0 / 1024 / ticks, bytes * 1000000.0 / 1024 / wall);
+}
+
+static bool BenchSelected(const char *run, const char *only) {
+    return only == NULL || !strncmp(run, only, strlen(only));
+}
+
+// Move "size" bytes of the file "fd" in "chunk" byte transfers, at
+// sequential or random chunk aligned positions.  Return the number of
+// bytes moved.
+
+static int BenchTransfer(int fd, int size, int chunk, bool write, bool random) {
+    char *buffer = new char[chunk];
+    int done = 0, n;
+
+    memset(buffer, 'b', chunk);
+    for (int i = 0; i < size / chunk; i++) {
+        if (random)
+            fileSystem->SeekUser(fd, (Random() % (size / chunk)) * chunk);
+        if (write)
+            n = fileSystem->WriteUser(buffer, chunk, fd);
+        else
+            n = fileSystem->ReadUser(buffer, chunk, fd);
+        if (n <= 0)
+            break;
+        done += n;
+    }
+    delete[] buffer;
+    return done;
+}
+
+static void BenchFileRuns(const char *only) {
+    int size, chunk, fd, bytes;
+
+    for (unsigned s = 0; s < sizeof(benchSizes) / sizeof(int); s++) {
+        for (unsigned c = 0; c < sizeof(benchChunks) / sizeof(int); c++) {
+            size = benchSizes[s];
+            chunk = benchChunks[c];
+            fileSystem->Remove(BenchFile);
+            if (!fileSystem->Create(BenchFile, 0) ||
+                (fd = fileSystem->OpenUser(BenchFile)) == -1) {
+                printf("Benchmark: can't create %s\n", BenchFile);
+                return;
+            }
+
+            // The sequential write also fills the file for the other runs
+            BenchStart();
+            bytes = BenchTransfer(fd, size, chunk, TRUE, FALSE);
+            if (BenchSelected("seqwrite", only))
+                BenchReport("seqwrite", size, chunk, bytes);
+
+            fileSystem->SeekUser(fd, 0);
+            BenchStart();
+            bytes = BenchTransfer(fd, size, chunk, FALSE, FALSE);
+            if (BenchSelected("seqread", only))
+                BenchReport("seqread", size, chunk, bytes);
+
+            if (BenchSelected("randwrite", only)) {
+                BenchStart();
+                bytes = BenchTransfer(fd, size, chunk, TRUE, TRUE);
+                BenchReport("randwrite", size, chunk, bytes);
+            }
+
+            if (BenchSelected("randread", only)) {
+                BenchStart();
+                bytes = BenchTransfer(fd, size, chunk, FALSE, TRUE);
+                BenchReport("randread", size, chunk, bytes);
+            }
+
+            fileSystem->CloseUser(fd);
+        }
+    }
+    fileSystem->Remove(BenchFile);
+}
+
+static void BenchCreateStorm() {
+    char name[16];
+
+    BenchStart();
+    for (int i = 0; i < BenchStormFiles; i++) {
+        snprintf(name, sizeof(name), "storm%d", i);
+        fileSystem->Create(name, 0);
+    }
+    for (int i = 0; i < BenchStormFiles; i++) {
+        snprintf(name, sizeof(name), "storm%d", i);
+        fileSystem->Remove(name);
+    }
+    BenchReport("createstorm", BenchStormFiles, 0, 0);
+}
+
+static void BenchDeepLookup() {
+    char path[BenchDepth * 4 + 2], scratch[BenchDepth * 4 + 2], name[4];
+
+    // Build the directories /b0/b1/.../b<BenchDepth-1>
+    path[0] = '\0';
+    fileSystem->ChangeDir((char *)"/");
+    for (int i = 0; i < BenchDepth; i++) {
+        snprintf(name, sizeof(name), "b%d", i);
+        fileSystem->CreateDir(name);
+        fileSystem->ChangeDir(name);
+        strcat(path, "/");
+        strcat(path, name);
+    }
+
+    BenchStart();
+    for (int i = 0; i < BenchLookups; i++) {
+        fileSystem->ChangeDir((char *)"/");
+        strcpy(scratch, path); // ParsePath cuts the path it is given
+        fileSystem->ChangeDir(scratch);
+    }
+    BenchReport("deeplookup", BenchDepth, 0, 0);
+
+    // Remove the directories, the deepest first
+    for (int i = BenchDepth - 1; i >= 0; i--) {
+        fileSystem->ChangeDir((char *)"..");
+        snprintf(name, sizeof(name), "b%d", i);
+        fileSystem->RemoveDir(name);
+    }
+}
+
+static void BenchListing() {
+    char name[16];
+    int total = 0;
+
+    for (int i = 0; i < BenchListFiles; i++) {
+        snprintf(name, sizeof(name), "list%d", i);
+        fileSystem->Create(name, i * 16);
+    }
+
+    BenchStart();
+    for (int r = 0; r < BenchListRounds; r++) {
+        for (int i = 0; i < BenchListFiles; i++) {
+            snprintf(name, sizeof(name), "list%d", i);
+            if (fileSystem->IsDataFile(name))
+                total += fileSystem->GetFileSize(name);
+        }
+    }
+    BenchReport("listing", BenchListFiles, 0, 0);
+    DEBUG('f', "Listing benchmark saw %d bytes\n", total);
+
+    for (int i = 0; i < BenchListFiles; i++) {
+        snprintf(name, sizeof(name), "list%d", i);
+        fileSystem->Remove(name);
+    }
+}
+
+static Semaphore *benchDone; // V'ed by each thread of the concurrent run
+
+static void BenchThread(int which) {
+    char name[16];
+    int fd;
+    bool writer = (which % 2 == 0);
+
+    // Writers fill their own file; readers all read the shared one
+    if (writer)
+        snprintf(name, sizeof(name), "conc%d", which);
+    else
+        snprintf(name, sizeof(name), "%s", BenchFile);
+
+    if ((fd = fileSystem->OpenUser(name)) != -1) {
+        BenchTransfer(fd, BenchThreadSize, SectorSize, writer, FALSE);
+        fileSystem->CloseUser(fd);
+    }
+    benchDone->V();
+}
+
+static void BenchConcurrent() {
+    char name[16];
+    int fd;
+
+    fileSystem->Remove(BenchFile);
+    fileSystem->Create(BenchFile, 0);
+    if ((fd = fileSystem->OpenUser(BenchFile)) != -1) {
+        BenchTransfer(fd, BenchThreadSize, SectorSize, TRUE, FALSE);
+        fileSystem->CloseUser(fd);
+    }
+    for (int i = 0; i < BenchThreads; i += 2) {
+        snprintf(name, sizeof(name), "conc%d", i);
+        fileSystem->Create(name, 0);
+    }
+
+    benchDone = new Semaphore("bench done", 0);
+    BenchStart();
+    for (int i = 0; i < BenchThreads; i++) {
+        Thread *t = new Thread("bench");
+        t->Fork(BenchThread, i);
+    }
+    for (int i = 0; i < BenchThreads; i++)
+        benchDone->P();
+    BenchReport("concurrent", BenchThreads, SectorSize, BenchThreads * BenchThreadSize);
+    delete benchDone;
+
+    for (int i = 0; i < BenchThreads; i += 2) {
+        snprintf(name, sizeof(name), "conc%d", i);
+        fileSystem->Remove(name);
+    }
+    fileSystem->Remove(BenchFile);
+}
+
+void FileSystemBenchmark(const char *only) {
+    fileSystem->ChangeDir((char *)"/");
+    if (BenchSelected("seqwrite", only) || BenchSelected("seqread", only) ||
+        BenchSelected("randwrite", only) || BenchSelected("randread", only))
+        BenchFileRuns(only);
+    if (BenchSelected("createstorm", only))
+        BenchCreateStorm();
+    if (BenchSelected("deeplookup", only))
+        BenchDeepLookup();
+    if (BenchSelected("listing", only))
+        BenchListing();
+    if (BenchSelected("concurrent", only))
+        BenchConcurrent();
+}
+
 void FileSystemTest() {
     int nbWord;
     int i, j;
@@ -0,0 +1,450 @@
+// journal.cc
+//	Routines to log the metadata updates of the file system.
+//
+//	The latest copy of every sector updated since the last checkpoint
+//	is kept in memory, so that reads see the updates whether they are
+//	still in the group being built, committed in the log, or already
+//	in their home sector.  A sector changed several times in the same
+//	group takes a single block of the log.
+//
+//	Commits run in the thread ending the operation which fills the
+//	group, or in a kernel thread woken up when the commit delay of the
+//	group expires.  The delay is simulated like a disk interrupt, so
+//	that Nachos doesn't halt while a group is waiting to be committed.
+//
+//	Log layout on disk:
+//	    LogStart                       log header (LogHeaderSectors)
+//	    LogStart + LogHeaderSectors    blocks, in commit order
+
+#include "copyright.h"
+#include "journal.h"
+#include "system.h"
+
+#include <strings.h> /* for bcopy */
+
+//----------------------------------------------------------------------
+// JournalTimerHandler / JournalDaemon
+// 	The commit delay of a group expired: wake up the kernel thread
+//	that commits it.  Interrupt handlers can't wait for the disk.
+//----------------------------------------------------------------------
+
+static void
+JournalTimerHandler(int arg)
+{
+    ((Journal *)arg)->TimerExpired();
+}
+
+static void
+JournalDaemon(int arg)
+{
+    for (;;)
+        ((Journal *)arg)->CommitOnTimeout();
+}
+
+//----------------------------------------------------------------------
+// Journal::Journal
+// 	Initialize the journal.  When formatting, the log is emptied;
+//	otherwise the blocks of the groups committed before the last
+//	shutdown, or crash, are written to their home sectors.
+//
+//	"format" -- is the disk being formatted?
+//----------------------------------------------------------------------
+
+Journal::Journal(bool format)
+{
+    Thread *daemon;
+    char *buf;
+    int i;
+
+    header = new LogHeader;
+    for (i = 0; i < NumSectors; i++)
+        blocks[i] = NULL;
+    groupSize = 0;
+    activeOps = 0;
+    commitWanted = FALSE;
+    timerPending = FALSE;
+    checkpoints = 0;
+    lock = new Lock("journal");
+    changed = new Condition("journal");
+    wakeup = new Semaphore("journal timer", 0);
+
+    synchDisk->ReadSectors(LogStart, LogHeaderSectors, (char *)header);
+    if (format) {
+        DEBUG('f', "Initializing an empty log\n");
+        header->magic = JournalMagic;
+        header->count = 0;
+        synchDisk->WriteSectors(LogStart, LogHeaderSectors, (char *)header);
+    } else if (header->magic != JournalMagic || header->count < 0 ||
+               header->count > LogBlocks) {
+        // Sectors of the log may be used by files on this disk
+        fprintf(stderr, "The disk has no metadata log, format it again with -f\n");
+        Exit(1);
+    } else if (header->count > 0) {
+        // Replay: the last copy of each sector wins, and the checkpoint
+        // writes them all in sector order
+        DEBUG('f', "Replaying %d logged blocks\n", header->count);
+        buf = new char[header->count * SectorSize];
+        synchDisk->ReadSectors(LogStart + LogHeaderSectors, header->count, buf);
+        for (i = 0; i < header->count; i++) {
+            if (header->home[i] == -1)
+                continue;
+            if (blocks[header->home[i]] == NULL)
+                blocks[header->home[i]] = new JournalBlock;
+            bcopy(&buf[i * SectorSize], blocks[header->home[i]]->data, SectorSize);
+            blocks[header->home[i]]->inGroup = FALSE;
+        }
+        delete[] buf;
+        Checkpoint();
+    }
+
+    daemon = new Thread("journal");
+    daemon->Fork(JournalDaemon, (int)this);
+}
+
+//----------------------------------------------------------------------
+// Journal::~Journal
+// 	De-allocate the journal.  Updates that were not committed are
+//	lost, as in a crash.
+//----------------------------------------------------------------------
+
+Journal::~Journal()
+{
+    for (int i = 0; i < NumSectors; i++)
+        delete blocks[i];
+    delete header;
+    delete wakeup;
+    delete changed;
+    delete lock;
+}
+
+//----------------------------------------------------------------------
+// Journal::Begin
+// 	Start an operation that changes the metadata.  Wait while a
+//	commit is pending, and commit first if the log may not have room
+//	for the updates of the operation.
+//----------------------------------------------------------------------
+
+void
+Journal::Begin()
+{
+    lock->Acquire();
+    while (commitWanted)
+        changed->Wait(lock);
+    if (header->count + groupSize + JournalOpBlocks > LogBlocks)
+        CommitWhenIdle();
+    activeOps++;
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::End
+// 	End an operation that changes the metadata.  The group is
+//	committed once it is big enough.
+//----------------------------------------------------------------------
+
+void
+Journal::End()
+{
+    lock->Acquire();
+    ASSERT(activeOps > 0);
+    activeOps--;
+    if (activeOps == 0)
+        changed->Broadcast(lock);
+    if (groupSize >= JournalGroupBlocks && !commitWanted)
+        CommitWhenIdle();
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::ReadSector / ReadSectors
+// 	Read sectors, with the latest updates of the logged ones.  The
+//	disk is not read if all of them are in memory.
+//
+//	The disk is read without holding the journal lock; if a
+//	checkpoint happened meanwhile, the sectors are read again.
+//
+//	"sector" -- the first sector to read
+//	"count" -- the number of consecutive sectors
+//	"data" -- the buffer to contain the sectors
+//----------------------------------------------------------------------
+
+void
+Journal::ReadSector(int sector, char *data)
+{
+    ReadSectors(sector, 1, data);
+}
+
+void
+Journal::ReadSectors(int sector, int count, char *data)
+{
+    int i, cached, generation;
+
+    lock->Acquire();
+    for (;;) {
+        for (i = cached = 0; i < count; i++)
+            if (blocks[sector + i] != NULL)
+                cached++;
+        if (cached == count)
+            break;
+
+        generation = checkpoints;
+        lock->Release();
+        synchDisk->ReadSectors(sector, count, data);
+        lock->Acquire();
+        if (generation == checkpoints)
+            break;
+    }
+
+    for (i = 0; i < count; i++)
+        if (blocks[sector + i] != NULL)
+            bcopy(blocks[sector + i]->data, &data[i * SectorSize], SectorSize);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::WriteSector / WriteSectors
+// 	Add the new contents of metadata sectors to the group being
+//	built.  A sector already in the group is simply updated.
+//
+//	If the log is full in the middle of an operation, the sector is
+//	written in place: the operation is then no longer atomic, but the
+//	file system stays correct unless Nachos crashes.
+//
+//	"sector" -- the first sector to write
+//	"count" -- the number of consecutive sectors
+//	"data" -- the new contents of the sectors
+//----------------------------------------------------------------------
+
+void
+Journal::WriteSector(int sector, const char *data)
+{
+    JournalBlock *block;
+
+    lock->Acquire();
+    block = blocks[sector];
+    if (block != NULL && block->inGroup) {
+        bcopy(data, block->data, SectorSize);
+        lock->Release();
+        return;
+    }
+
+    if (header->count + groupSize == LogBlocks) {
+        if (activeOps == 0) {
+            CommitWhenIdle();
+        } else {
+            DEBUG('f', "Log full, writing sector %d in place\n", sector);
+            if (block != NULL)
+                bcopy(data, block->data, SectorSize);
+            synchDisk->WriteSector(sector, (char *)data);
+            lock->Release();
+            return;
+        }
+    }
+
+    if ((block = blocks[sector]) == NULL)
+        block = blocks[sector] = new JournalBlock;
+    bcopy(data, block->data, SectorSize);
+    block->inGroup = TRUE;
+    group[groupSize++] = sector;
+
+    // Start the commit delay with the first update of the group
+    if (groupSize == 1 && !timerPending) {
+        timerPending = TRUE;
+        interrupt->Schedule(JournalTimerHandler, (int)this, JournalCommitDelay, DiskInt);
+    }
+    lock->Release();
+}
+
+void
+Journal::WriteSectors(int sector, int count, const char *data)
+{
+    for (int i = 0; i < count; i++)
+        WriteSector(sector + i, &data[i * SectorSize]);
+}
+
+//----------------------------------------------------------------------
+// Journal::WriteData
+// 	Write file data directly to disk, revoking first the logged
+//	copies of the sectors: they belonged to metadata since freed.
+//
+//	"sector" -- the first sector to write
+//	"count" -- the number of consecutive sectors
+//	"data" -- the new contents of the sectors
+//----------------------------------------------------------------------
+
+void
+Journal::WriteData(int sector, int count, const char *data)
+{
+    lock->Acquire();
+    for (int i = 0; i < count; i++)
+        if (blocks[sector + i] != NULL)
+            Revoke(sector + i);
+    lock->Release();
+    synchDisk->WriteSectors(sector, count, (char *)data);
+}
+
+//----------------------------------------------------------------------
+// Journal::Sync
+// 	Commit the group being built, write all the logged blocks to
+//	their home sectors, and flush the disk, so that a mapped disk
+//	reaches its UNIX file.  Called before Nachos halts.
+//----------------------------------------------------------------------
+
+void
+Journal::Sync()
+{
+    lock->Acquire();
+    CommitWhenIdle();
+    Checkpoint();
+    synchDisk->Flush();
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::TimerExpired
+// 	The commit delay of the group expired: wake up the journal
+//	thread.  Called from the interrupt handler.
+//----------------------------------------------------------------------
+
+void
+Journal::TimerExpired()
+{
+    timerPending = FALSE;
+    wakeup->V();
+}
+
+//----------------------------------------------------------------------
+// Journal::CommitOnTimeout
+// 	Body of the journal thread: wait for the commit delay of a group
+//	to expire, and commit it unless that was done meanwhile.
+//----------------------------------------------------------------------
+
+void
+Journal::CommitOnTimeout()
+{
+    wakeup->P();
+    lock->Acquire();
+    if (groupSize > 0 && !commitWanted)
+        CommitWhenIdle();
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::CommitWhenIdle
+// 	Keep new operations from starting, wait for the running ones to
+//	end, then commit.  The journal lock is held.
+//----------------------------------------------------------------------
+
+void
+Journal::CommitWhenIdle()
+{
+    commitWanted = TRUE;
+    while (activeOps > 0)
+        changed->Wait(lock);
+    Commit();
+    commitWanted = FALSE;
+    changed->Broadcast(lock);
+}
+
+//----------------------------------------------------------------------
+// Journal::Commit
+// 	Append the blocks of the group to the log in one disk request,
+//	then write the log header: the group is committed once the header
+//	is on disk.  The log is checkpointed when it has no room left for
+//	another group.  The journal lock is held and no operation runs.
+//----------------------------------------------------------------------
+
+void
+Journal::Commit()
+{
+    int i, n;
+    char *buf;
+
+    ASSERT(activeOps == 0);
+    if (groupSize == 0)
+        return;
+
+    buf = new char[groupSize * SectorSize];
+    for (i = n = 0; i < groupSize; i++) {
+        if (group[i] == -1)
+            continue; // revoked
+        bcopy(blocks[group[i]]->data, &buf[n * SectorSize], SectorSize);
+        blocks[group[i]]->inGroup = FALSE;
+        header->home[header->count + n] = group[i];
+        n++;
+    }
+
+    DEBUG('f', "Committing %d blocks at log position %d\n", n, header->count);
+    if (n > 0)
+        synchDisk->WriteSectors(LogStart + LogHeaderSectors + header->count, n, buf);
+    header->count += n;
+    synchDisk->WriteSectors(LogStart, LogHeaderSectors, (char *)header);
+    groupSize = 0;
+    delete[] buf;
+
+    if (header->count + JournalGroupBlocks + JournalOpBlocks > LogBlocks)
+        Checkpoint();
+}
+
+//----------------------------------------------------------------------
+// Journal::Checkpoint
+// 	Write the latest copy of each logged sector to its home sector,
+//	in sector order and one disk request per run of consecutive
+//	sectors, then empty the log.  The journal lock is held and the
+//	group is empty.
+//----------------------------------------------------------------------
+
+void
+Journal::Checkpoint()
+{
+    int i, count;
+    char *buf = new char[NumSectors * SectorSize];
+
+    ASSERT(groupSize == 0);
+    DEBUG('f', "Checkpointing %d logged blocks\n", header->count);
+
+    for (i = 0; i < NumSectors; i += count) {
+        for (count = 0; i + count < NumSectors && blocks[i + count] != NULL; count++)
+            bcopy(blocks[i + count]->data, &buf[count * SectorSize], SectorSize);
+        if (count == 0) {
+            count = 1;
+            continue;
+        }
+        synchDisk->WriteSectors(i, count, buf);
+    }
+    checkpoints++;
+
+    for (i = 0; i < NumSectors; i++) {
+        delete blocks[i];
+        blocks[i] = NULL;
+    }
+    header->count = 0;
+    synchDisk->WriteSectors(LogStart, LogHeaderSectors, (char *)header);
+    delete[] buf;
+}
+
+//----------------------------------------------------------------------
+// Journal::Revoke
+// 	Forget the copies of a sector in the group and in the log.  The
+//	log header is written with the next commit or checkpoint: until
+//	then, a replay gives the sector back to the metadata which still
+//	owns it in the committed bitmap.  The journal lock is held.
+//
+//	"sector" -- the sector whose copies are revoked
+//----------------------------------------------------------------------
+
+void
+Journal::Revoke(int sector)
+{
+    int i;
+
+    DEBUG('f', "Revoking the logged copies of sector %d\n", sector);
+    for (i = 0; i < groupSize; i++)
+        if (group[i] == sector)
+            group[i] = -1;
+    for (i = 0; i < header->count; i++)
+        if (header->home[i] == sector)
+            header->home[i] = -1;
+    delete blocks[sector];
+    blocks[sector] = NULL;
+}
@@ -0,0 +1,110 @@
+// journal.h
+//	Data structures for the write-ahead log of the file system
+//	metadata.
+//
+//	File headers, directories and the bitmap of free sectors are not
+//	written in place when they change.  Their new contents are kept
+//	in memory and gathered into groups; a whole group is then
+//	committed by appending it to a log region of the disk, in a single
+//	sequential write, followed by the write of the log header which
+//	lists the home sector of every block of the log.  Once the log is
+//	nearly full, its blocks are written to their home sectors (the
+//	checkpoint), once each however many times they were changed.
+//
+//	A group is committed when it is big enough, or some time after its
+//	first update.  When the file system is mounted, the blocks of the
+//	committed groups that were not checkpointed yet are replayed.
+//
+//	Operations that change the metadata are bracketed by Begin and
+//	End, so that a group only holds whole operations: after a crash,
+//	an operation is either entirely replayed or entirely lost.
+//
+//	Data sectors of files are written directly to disk; a data write
+//	to a sector still in the log (a metadata sector freed and reused
+//	by a file) revokes its logged copies.
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "copyright.h"
+#include "disk.h"
+#include "synch.h"
+
+#define JournalMagic 0x4a524e4c // "JRNL"
+
+#define LogStart 2         // First sector of the log, after the headers
+                           // of the bitmap and of the root directory
+#define LogHeaderSectors 2 // Sectors of the log header
+#define LogBlocks ((LogHeaderSectors * SectorSize) / (int)sizeof(int) - 2)
+                           // Number of blocks the log can hold
+#define LogSectors (LogHeaderSectors + LogBlocks) // Size of the log region
+
+#define JournalGroupBlocks 16    // Commit a group once it has this many blocks
+#define JournalOpBlocks 8        // Log space kept free for an operation
+#define JournalCommitDelay 20000 // Commit a group at most this many ticks
+                                 // after its first update
+
+// The following class defines the log header, as stored on disk: the
+// home sector of each of the "count" blocks of the log, -1 for the
+// revoked ones.
+
+class LogHeader {
+  public:
+    int magic;           // JournalMagic if the log was initialized
+    int count;           // Number of committed blocks in the log
+    int home[LogBlocks]; // Home sector of each block of the log
+};
+
+// The following class defines the in-memory copy of a metadata
+// sector that was updated since the last checkpoint.
+
+class JournalBlock {
+  public:
+    char data[SectorSize]; // Latest contents of the sector
+    bool inGroup;          // Changed in the group being built?
+};
+
+// The following class defines the journal.
+
+class Journal {
+  public:
+    Journal(bool format); // Initialize the log, or replay it if the
+                          // disk is not being formatted
+    ~Journal();           // De-allocate the in-memory structures
+
+    void Begin(); // Start an operation that changes the metadata
+    void End();   // End it; the group may be committed
+
+    void ReadSector(int sector, char *data);    // Read sectors, as last
+    void ReadSectors(int sector, int count, char *data); // written
+    void WriteSector(int sector, const char *data); // Log a metadata sector
+    void WriteSectors(int sector, int count, const char *data);
+    void WriteData(int sector, int count, const char *data);
+                                  // Write file data directly to disk
+
+    void Sync(); // Commit the current group and checkpoint the log;
+                 // must not be called inside an operation
+    void TimerExpired();    // Called when the commit delay has passed
+    void CommitOnTimeout(); // Commit after the delay (journal thread)
+
+  private:
+    void CommitWhenIdle(); // Wait for the operations, then commit
+    void Commit();         // Append the group to the log
+    void Checkpoint();     // Write the log blocks to their home sectors
+    void Revoke(int sector); // Forget the logged copies of a sector
+
+    LogHeader *header;          // In-memory copy of the log header
+    JournalBlock *blocks[NumSectors]; // Latest copy of the logged sectors
+    int group[LogBlocks];       // Sectors of the group being built
+    int groupSize;              // Number of sectors in "group"
+    int activeOps;              // Operations between Begin and End
+    bool commitWanted;          // Is a thread waiting to commit?
+    bool timerPending;          // Is a commit delay running?
+    int checkpoints;            // Number of checkpoints done so far
+    Lock *lock;                 // Mutual exclusion on the journal
+    Condition *changed;         // Signaled when operations end or a
+                                // group is committed
+    Semaphore *wakeup;          // Wakes the thread committing on timeouts
+};
+
+#endif // JOURNAL_H
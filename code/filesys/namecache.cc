@@ -0,0 +1,173 @@
+// namecache.cc
+//	Routines to manage the cache of file name lookups.
+//
+//	The cache is a hash table on (parent directory sector, name).
+//	Each bucket holds a short list ordered from the most to the least
+//	recently used entry, so that a hit is moved to the front and the
+//	entry replaced on a miss is the last one.
+
+#include "copyright.h"
+#include "namecache.h"
+
+#include <cstring>
+
+//----------------------------------------------------------------------
+// HashEntry
+// 	Hash function on (parent, name) (djb2 seeded with the parent).
+//----------------------------------------------------------------------
+
+static unsigned int
+HashEntry(int parent, const char *name)
+{
+    unsigned int hash = 5381 + parent;
+
+    while (*name != '\0')
+        hash = hash * 33 + (unsigned char)*name++;
+    return hash % NameCacheBuckets;
+}
+
+//----------------------------------------------------------------------
+// NameCache::NameCache
+// 	Initialize an empty name cache.
+//----------------------------------------------------------------------
+
+NameCache::NameCache()
+{
+    for (int i = 0; i < NameCacheBuckets; i++)
+        buckets[i] = NULL;
+    lock = new Lock("name cache");
+}
+
+//----------------------------------------------------------------------
+// NameCache::~NameCache
+// 	De-allocate the name cache.
+//----------------------------------------------------------------------
+
+NameCache::~NameCache()
+{
+    NameCacheEntry *entry;
+
+    for (int i = 0; i < NameCacheBuckets; i++) {
+        while ((entry = buckets[i]) != NULL) {
+            buckets[i] = entry->next;
+            delete[] entry->name;
+            delete entry;
+        }
+    }
+    delete lock;
+}
+
+//----------------------------------------------------------------------
+// NameCache::Lookup
+// 	Look "name" up in the directory whose header is at "parent".
+//	Return FALSE if the result is not in the cache; otherwise set
+//	"sector" and "type" and move the entry to the front of its bucket.
+//----------------------------------------------------------------------
+
+bool
+NameCache::Lookup(int parent, const char *name, int *sector, fileType *type)
+{
+    NameCacheEntry **link, *entry;
+    unsigned int bucket = HashEntry(parent, name);
+
+    lock->Acquire();
+    for (link = &buckets[bucket]; (entry = *link) != NULL; link = &entry->next) {
+        if (entry->parent == parent && !strcmp(entry->name, name)) {
+            *link = entry->next;
+            entry->next = buckets[bucket];
+            buckets[bucket] = entry;
+
+            *sector = entry->sector;
+            *type = entry->type;
+            lock->Release();
+            return TRUE;
+        }
+    }
+    lock->Release();
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// NameCache::Insert
+// 	Add the result of a lookup at the front of its bucket, replacing
+//	the least recently used entry if the bucket is full.
+//----------------------------------------------------------------------
+
+void
+NameCache::Insert(int parent, const char *name, int sector, fileType type)
+{
+    NameCacheEntry **link, *entry;
+    unsigned int bucket = HashEntry(parent, name);
+    int ways;
+
+    Invalidate(parent, name);
+
+    lock->Acquire();
+    for (ways = 1, link = &buckets[bucket]; *link != NULL; link = &(*link)->next, ways++) {
+        if (ways == NameCacheWays) {
+            entry = *link;
+            *link = NULL;
+            delete[] entry->name;
+            delete entry;
+            break;
+        }
+    }
+
+    entry = new NameCacheEntry;
+    entry->parent = parent;
+    entry->name = new char[strlen(name) + 1];
+    strcpy(entry->name, name);
+    entry->sector = sector;
+    entry->type = type;
+    entry->next = buckets[bucket];
+    buckets[bucket] = entry;
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// NameCache::Invalidate
+// 	Forget the lookup of "name" in the directory at "parent".
+//----------------------------------------------------------------------
+
+void
+NameCache::Invalidate(int parent, const char *name)
+{
+    NameCacheEntry **link, *entry;
+
+    lock->Acquire();
+    for (link = &buckets[HashEntry(parent, name)]; (entry = *link) != NULL; link = &entry->next) {
+        if (entry->parent == parent && !strcmp(entry->name, name)) {
+            *link = entry->next;
+            delete[] entry->name;
+            delete entry;
+            break;
+        }
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// NameCache::InvalidateParent
+// 	Forget every lookup made in the directory at "parent" (when the
+//	directory is removed, its sector may be reused).
+//----------------------------------------------------------------------
+
+void
+NameCache::InvalidateParent(int parent)
+{
+    NameCacheEntry **link, *entry;
+
+    lock->Acquire();
+    for (int i = 0; i < NameCacheBuckets; i++) {
+        link = &buckets[i];
+        while ((entry = *link) != NULL) {
+            if (entry->parent == parent) {
+                *link = entry->next;
+                delete[] entry->name;
+                delete entry;
+            } else
+                link = &entry->next;
+        }
+    }
+    lock->Release();
+}
@@ -0,0 +1,60 @@
+// namecache.h
+//	Data structures for caching the results of file name lookups.
+//
+//	Resolving a path means, for each of its components, looking the
+//	name up in the parent directory (whose contents have to be read
+//	from disk), then reading the file header found to know whether it
+//	is a directory.  The name cache keeps the result of these lookups,
+//	keyed by the sector of the parent directory and the name, so that
+//	resolving the same paths again needs no disk access.
+//
+//	The file system must invalidate an entry whenever the name is
+//	removed from, or added to, its parent directory.
+
+#ifndef NAMECACHE_H
+#define NAMECACHE_H
+
+#include "copyright.h"
+#include "filehdr.h"
+#include "synch.h"
+
+#define NameCacheBuckets 64 // number of hash buckets
+#define NameCacheWays 4     // number of entries kept per bucket
+
+// The following class defines an entry of the name cache: the file
+// "name" of the directory whose header is at "parent" has its header
+// at "sector", and is of type "type".
+
+class NameCacheEntry {
+  public:
+    int parent;           // Sector of the parent directory header
+    char *name;           // Name in the parent directory
+    int sector;           // Sector of the file header
+    fileType type;        // Type of the file
+    NameCacheEntry *next; // Next entry of the bucket
+};
+
+// The following class defines the name cache.  Each bucket is a list
+// of at most NameCacheWays entries, most recently used first; when a
+// bucket is full, its least recently used entry is replaced.
+
+class NameCache {
+  public:
+    NameCache();  // Initialize an empty cache
+    ~NameCache(); // De-allocate the cache
+
+    bool Lookup(int parent, const char *name, int *sector,
+                fileType *type); // Find "name" in "parent"; return FALSE
+                                 // if it is not in the cache
+    void Insert(int parent, const char *name, int sector,
+                fileType type);                  // Add a lookup result
+    void Invalidate(int parent, const char *name); // Forget a name
+    void InvalidateParent(int parent);           // Forget every name of
+                                                 // a directory
+
+  private:
+    NameCacheEntry *buckets[NameCacheBuckets]; // Hash table
+    Lock *lock;                                // Mutual exclusion
+};
+
+#endif // NAMECACHE_H
@@ -5,7 +5,9 @@
 //	the OpenFile data structure).
 //
 //	Also as in UNIX, for convenience, we keep the file header in
-//	memory while the file is open.
+//	memory while the file is open.  Extending the file only changes
+//	this in-core header; it is written back by Flush, or when the
+//	file is closed.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation
@@ -30,15 +32,23 @@ OpenFile::OpenFile(int sector)
 {
     hdr = new FileHeader;
     hdr->FetchFrom(sector);
+    hdrSector = sector;
     seekPosition = 0;
+    dirty = FALSE;
+    metadata = !hdr->IsDataFile() || sector == FreeMapSector;
 }
 
 //----------------------------------------------------------------------
 // OpenFile::~OpenFile
 // 	Close a Nachos file, de-allocating any in-memory data structures.
+//	The header is written back first if it changed.
 //----------------------------------------------------------------------
 
-OpenFile::~OpenFile() { delete hdr; }
+OpenFile::~OpenFile()
+{
+    Flush();
+    delete hdr;
+}
 
 //----------------------------------------------------------------------
 // OpenFile::Seek
@@ -106,7 +116,7 @@ int OpenFile::Write(const char *into, int numBytes)
 int OpenFile::ReadAt(char *into, int numBytes, int position)
 {
     int fileLength = hdr->FileLength();
-    int i, firstSector, lastSector, numSectors;
+    int i, firstSector, lastSector, numSectors, sector, count;
     char *buf;
 
     if((numBytes <= 0) || (position >= fileLength))
@@ -115,16 +125,24 @@ int OpenFile::ReadAt(char *into, int numBytes, int position)
         numBytes = fileLength - position;
     DEBUG('f', "Reading %d bytes at %d, from file of length %d.\n", numBytes, position, fileLength);
 
+    if(hdr->IsInline())
+    { // the data is in the header, no disk access
+        hdr->ReadInline(into, numBytes, position);
+        return numBytes;
+    }
+
     firstSector = divRoundDown(position, SectorSize);
     lastSector = divRoundDown(position + numBytes - 1, SectorSize);
     numSectors = 1 + lastSector - firstSector;
 
-    // read in all the full and partial sectors that we need
+    // read in all the full and partial sectors that we need, one disk
+    // request per run of consecutive sectors
     buf = new char[numSectors * SectorSize];
-    for(i = firstSector; i <= lastSector; i++){
-        synchDisk->ReadSector(hdr->ByteToSector(i * SectorSize),
-                              &buf[(i - firstSector) * SectorSize]);
-                              }
+    for(i = firstSector; i <= lastSector; i += count)
+    {
+        count = SectorRun(i, lastSector, &sector);
+        journal->ReadSectors(sector, count, &buf[(i - firstSector) * SectorSize]);
+    }
 
     // copy the part we want
     bcopy(&buf[position - (firstSector * SectorSize)], into, numBytes);
@@ -135,7 +153,7 @@ int OpenFile::ReadAt(char *into, int numBytes, int position)
 int OpenFile::WriteAt(const char *from, int numBytes, int position)
 {
     int fileLength = hdr->FileLength();
-    int i, firstSector, lastSector, numSectors;
+    int i, firstSector, lastSector, numSectors, sector, count;
     bool firstAligned, lastAligned;
     char *buf;
 
@@ -145,6 +163,13 @@ int OpenFile::WriteAt(const char *from, int numBytes, int position)
         numBytes = fileLength - position;
     DEBUG('f', "Writing %d bytes at %d, from file of length %d.\n", numBytes, position, fileLength);
 
+    if(hdr->IsInline())
+    { // the data is in the header, written back with it
+        hdr->WriteInline(from, numBytes, position);
+        dirty = TRUE;
+        return numBytes;
+    }
+
     firstSector = divRoundDown(position, SectorSize);
     lastSector = divRoundDown(position + numBytes - 1, SectorSize);
     numSectors = 1 + lastSector - firstSector;
@@ -163,14 +188,41 @@ int OpenFile::WriteAt(const char *from, int numBytes, int position)
     // copy in the bytes we want to change
     bcopy(from, &buf[position - (firstSector * SectorSize)], numBytes);
 
-    // write modified sectors back
-    for(i = firstSector; i <= lastSector; i++)
-        synchDisk->WriteSector(hdr->ByteToSector(i * SectorSize),
-                               &buf[(i - firstSector) * SectorSize]);
+    // write modified sectors back, one disk request per run of
+    // consecutive sectors; the sectors of the metadata files go
+    // through the log
+    for(i = firstSector; i <= lastSector; i += count)
+    {
+        count = SectorRun(i, lastSector, &sector);
+        if(metadata)
+            journal->WriteSectors(sector, count, &buf[(i - firstSector) * SectorSize]);
+        else
+            journal->WriteData(sector, count, &buf[(i - firstSector) * SectorSize]);
+    }
     delete[] buf;
     return numBytes;
 }
 
+//----------------------------------------------------------------------
+// OpenFile::SectorRun
+// 	Return the number of file sectors, from the "from"th to at most the
+//	"to"th, which are also consecutive on disk.
+//
+//	"from" -- the first file sector of the run
+//	"to" -- the last file sector that may be part of the run
+//	"sector" -- set to the disk sector of the "from"th file sector
+//----------------------------------------------------------------------
+
+int OpenFile::SectorRun(int from, int to, int *sector)
+{
+    int count = 1;
+
+    *sector = hdr->ByteToSector(from * SectorSize);
+    while(from + count <= to && hdr->ByteToSector((from + count) * SectorSize) == *sector + count)
+        count++;
+    return count;
+}
+
 //----------------------------------------------------------------------
 // OpenFile::Length
 // 	Return the number of bytes in the file.
@@ -178,6 +230,104 @@ int OpenFile::WriteAt(const char *from, int numBytes, int position)
 
 int OpenFile::Length() { return hdr->FileLength(); }
 
+//----------------------------------------------------------------------
+// OpenFile::Extend
+// 	Add "newSize" bytes at the end of the file, allocating the sectors
+//	out of "freeMap".  Only the in-core header is updated; the caller
+//	is responsible for writing "freeMap" back, and the header is
+//	written back by Flush.  "freeMap" may be NULL when NeedsSectors
+//	is FALSE: the new bytes then fit in the last sector of the file,
+//	or in its header.
+//
+//	A file whose data was in its header and which no longer fits
+//	there gets sectors, and its data is moved to them.
+//	Return FALSE if there is not enough space on the disk.
+//----------------------------------------------------------------------
+
+bool OpenFile::Extend(BitMap *freeMap, int newSize)
+{
+    char inlineData[MaxInlineBytes];
+    int length = hdr->FileLength();
+    bool promote = hdr->IsInline() && NeedsSectors(newSize);
+
+    ASSERT(freeMap != NULL || !NeedsSectors(newSize));
+    if(promote)
+        hdr->ReadInline(inlineData, length, 0);
+    if(!hdr->Extend(freeMap, newSize))
+        return FALSE;
+    dirty = TRUE;
+
+    if(promote && length > 0)
+    {
+        DEBUG('f', "Moving %d bytes out of the header at sector %d\n", length, hdrSector);
+        WriteAt(inlineData, length, 0);
+    }
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::Reserve
+// 	Give the file enough sectors to hold "size" bytes, out of
+//	"freeMap", without changing its length; writes up to that size
+//	then extend the file in place.  As for Extend, the caller writes
+//	"freeMap" back and the header is written back by Flush.
+//
+//	A file whose data was in its header gets its data moved to the
+//	new sectors.  Return FALSE if there is not enough space on the
+//	disk.
+//----------------------------------------------------------------------
+
+bool OpenFile::Reserve(BitMap *freeMap, int size)
+{
+    char inlineData[MaxInlineBytes];
+    int length = hdr->FileLength();
+    bool promote = hdr->IsInline() && size > hdr->Capacity();
+
+    if(promote)
+        hdr->ReadInline(inlineData, length, 0);
+    if(!hdr->Reserve(freeMap, size))
+        return FALSE;
+    dirty = TRUE;
+
+    if(promote && length > 0)
+    {
+        DEBUG('f', "Moving %d bytes out of the header at sector %d\n", length, hdrSector);
+        WriteAt(inlineData, length, 0);
+    }
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::NeedsSectors
+// 	Return TRUE if adding "newSize" bytes at the end of the file needs
+//	new disk sectors, FALSE if they fit in the last sector, or in the
+//	header of a small file.
+//----------------------------------------------------------------------
+
+bool OpenFile::NeedsSectors(int newSize) { return hdr->FileLength() + newSize > hdr->Capacity(); }
+
+//----------------------------------------------------------------------
+// OpenFile::IsInline
+// 	Return TRUE if the data of the file is stored in its header, so
+//	that it only reaches the disk when the header is written back.
+//----------------------------------------------------------------------
+
+bool OpenFile::IsInline() { return hdr->IsInline(); }
+
+//----------------------------------------------------------------------
+// OpenFile::Flush
+// 	Write the header back to disk, if it changed since it was read.
+//----------------------------------------------------------------------
+
+void OpenFile::Flush()
+{
+    if(!dirty)
+        return;
+    DEBUG('f', "Writing back the header at sector %d\n", hdrSector);
+    hdr->WriteBack(hdrSector);
+    dirty = FALSE;
+}
+
 //----------------------------------------------------------------------
 // OpenFile::GetSeek
 // 	Return the number the current seek position value.
@@ -66,6 +66,7 @@ class OpenFile {
 
 #else // FILESYS
 class FileHeader;
+class BitMap;
 
 class OpenFile {
   public:
@@ -92,8 +93,23 @@ class OpenFile {
                    // than the UNIX idiom -- lseek to
                    // end of file, tell, lseek back
     int GetSeek(); // Return the current seek position
+
+    bool Extend(BitMap *freeMap, int newSize); // Add "newSize" bytes at
+                                               // the end of the file
+    bool Reserve(BitMap *freeMap, int size); // Preallocate sectors for
+                                             // "size" bytes
+    bool NeedsSectors(int newSize); // Does adding "newSize" bytes need
+                                    // new disk sectors?
+    void Flush();                   // Write the header back if it changed
+    bool IsDirty() { return dirty; } // Has it changed since it was written?
+    bool IsInline();                // Is the data stored in the header?
   private:
+    int SectorRun(int from, int to, int *sector); // Number of file sectors
+                                                  // consecutive on disk
     FileHeader *hdr;  // Header for this file
+    int hdrSector;    // Sector of the header on disk
+    bool dirty;       // Has the header changed since it was read?
+    bool metadata;    // Directory or bitmap, written through the log?
     int seekPosition; // Current position within the file
 };
 
@@ -5,10 +5,13 @@
 //	the disk providing a synchronous interface (requests wait until
 //	the request completes).
 //
-//	Use a semaphore to synchronize the interrupt handlers with the
-//	pending requests.  And, because the physical disk can only
-//	handle one operation at a time, use a lock to enforce mutual
-//	exclusion.
+//	Because the physical disk can only handle one operation at a
+//	time, requests arriving while it is busy are kept in a queue.
+//	Each time the disk interrupts, the handler picks the next request
+//	according to the scheduling policy and starts it, then wakes up
+//	the thread that made the completed request, which was waiting on
+//	its own semaphore.  The queue is shared with the interrupt
+//	handler, so it is protected by disabling interrupts.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -16,6 +19,7 @@
 
 #include "copyright.h"
 #include "synchdisk.h"
+#include "system.h"
 
 //----------------------------------------------------------------------
 // DiskRequestDone
@@ -38,13 +42,18 @@ DiskRequestDone (int arg)
 //
 //	"name" -- UNIX file name to be used as storage for the disk data
 //	   (usually, "DISK")
+//	"diskPolicy" -- order in which the queued requests are served
+//	"mapped" -- map the UNIX file in memory (cf. disk.h)
 //----------------------------------------------------------------------
 
-SynchDisk::SynchDisk(const char* name)
+SynchDisk::SynchDisk(const char* name, DiskPolicy diskPolicy, bool mapped)
 {
-    semaphore = new Semaphore("synch disk", 0);
-    lock = new Lock("synch disk lock");
-    disk = new Disk(name, DiskRequestDone, (int) this);
+    policy = diskPolicy;
+    pending = NULL;
+    current = NULL;
+    headSector = 0;
+    sweepUp = TRUE;
+    disk = new Disk(name, DiskRequestDone, (int) this, mapped);
 }
 
 //----------------------------------------------------------------------
@@ -56,8 +65,6 @@ SynchDisk::SynchDisk(const char* name)
 SynchDisk::~SynchDisk()
 {
     delete disk;
-    delete lock;
-    delete semaphore;
 }
 
 //----------------------------------------------------------------------
@@ -72,10 +79,7 @@ SynchDisk::~SynchDisk()
 void
 SynchDisk::ReadSector(int sectorNumber, char* data)
 {
-    lock->Acquire();			// only one disk I/O at a time
-    disk->ReadRequest(sectorNumber, data);
-    semaphore->P();			// wait for interrupt
-    lock->Release();
+    Submit(sectorNumber, 1, data, FALSE);
 }
 
 //----------------------------------------------------------------------
@@ -90,20 +94,187 @@ SynchDisk::ReadSector(int sectorNumber, char* data)
 void
 SynchDisk::WriteSector(int sectorNumber, char* data)
 {
-    lock->Acquire();			// only one disk I/O at a time
-    disk->WriteRequest(sectorNumber, data);
-    semaphore->P();			// wait for interrupt
-    lock->Release();
+    Submit(sectorNumber, 1, data, TRUE);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::ReadSectors
+// 	Read the contents of "count" consecutive disk sectors into a
+//	buffer, with a single disk request.  Return only after the data
+//	has been read.
+//
+//	"sectorNumber" -- the first disk sector to read
+//	"count" -- the number of sectors to read
+//	"data" -- the buffer to hold the contents of the disk sectors
+//----------------------------------------------------------------------
+
+void
+SynchDisk::ReadSectors(int sectorNumber, int count, char* data)
+{
+    Submit(sectorNumber, count, data, FALSE);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::WriteSectors
+// 	Write the contents of a buffer into "count" consecutive disk
+//	sectors, with a single disk request.  Return only after the data
+//	has been written.
+//
+//	"sectorNumber" -- the first disk sector to be written
+//	"count" -- the number of sectors to write
+//	"data" -- the new contents of the disk sectors
+//----------------------------------------------------------------------
+
+void
+SynchDisk::WriteSectors(int sectorNumber, int count, char* data)
+{
+    Submit(sectorNumber, count, data, TRUE);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Flush
+// 	Make sure every sector written so far has reached the UNIX file
+//	simulating the disk (the disk may be mapped in memory).
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Flush()
+{
+    disk->Flush();
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Submit
+// 	Send a request to the disk if it is idle, otherwise queue it.
+//	Return only once the request has been served, and account its
+//	latency (queueing included) in the statistics.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Submit(int sectorNumber, int count, char* data, bool writing)
+{
+    DiskRequest *request = new DiskRequest;
+    IntStatus oldLevel;
+
+    request->sector = sectorNumber;
+    request->count = count;
+    request->data = data;
+    request->writing = writing;
+    request->arrival = stats->totalTicks;
+    request->done = new Semaphore("synch disk request", 0);
+    request->next = NULL;
+
+    oldLevel = interrupt->SetLevel(IntOff);
+    if (current == NULL)
+        Start(request);
+    else {
+        request->next = pending;
+        pending = request;
+    }
+    (void) interrupt->SetLevel(oldLevel);
+
+    request->done->P();			// wait for interrupt
+    stats->RecordDiskLatency(stats->totalTicks - request->arrival);
+
+    delete request->done;
+    delete request;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Start
+// 	Send a request to the raw disk.  Called with interrupts disabled.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Start(DiskRequest *request)
+{
+    DEBUG('d', "Starting disk request at sector %d (%d sectors)\n",
+          request->sector, request->count);
+    current = request;
+    if (request->writing)
+        disk->WriteSectors(request->sector, request->count, request->data);
+    else
+        disk->ReadSectors(request->sector, request->count, request->data);
+    headSector = request->sector + request->count - 1;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::NextRequest
+// 	Remove from the queue and return the request to serve next, or
+//	NULL if there is none.  The queue is kept newest first, so on
+//	ties the oldest request (the last one found) wins.
+//
+//	FIFO -- the oldest request
+//	SSTF -- the request on the track closest to the head
+//	SCAN -- the closest request in the direction the head is
+//		moving, turning back when there is none
+//	C-SCAN -- the closest request at or above the head, going back
+//		to the lowest request when there is none
+//----------------------------------------------------------------------
+
+DiskRequest *
+SynchDisk::NextRequest()
+{
+    DiskRequest *best = NULL, *lowest = NULL, *r, **link;
+    int headTrack = headSector / SectorsPerTrack;
+    int distance, bestDistance = 0;
+
+    if (pending == NULL)
+        return NULL;
+
+    for (r = pending; r != NULL; r = r->next) {
+        switch (policy) {
+          case DiskFIFO:
+            best = r;
+            break;
+          case DiskSSTF:
+            distance = abs(r->sector / SectorsPerTrack - headTrack);
+            if (best == NULL || distance <= bestDistance) {
+                best = r;
+                bestDistance = distance;
+            }
+            break;
+          case DiskSCAN:
+          case DiskCSCAN:
+            distance = sweepUp ? r->sector - headSector : headSector - r->sector;
+            if (distance >= 0 && (best == NULL || distance <= bestDistance)) {
+                best = r;
+                bestDistance = distance;
+            }
+            if (lowest == NULL || r->sector <= lowest->sector)
+                lowest = r;
+            break;
+        }
+    }
+
+    if (best == NULL) {		// nothing left in the sweep direction
+        if (policy == DiskSCAN) {
+            sweepUp = !sweepUp;
+            return NextRequest();
+        }
+        best = lowest;		// C-SCAN: back to the lowest sector
+    }
+
+    for (link = &pending; *link != best; link = &(*link)->next)
+        ;
+    *link = best->next;
+    return best;
 }
 
 //----------------------------------------------------------------------
 // SynchDisk::RequestDone
-// 	Disk interrupt handler.  Wake up any thread waiting for the disk
-//	request to finish.
+// 	Disk interrupt handler.  Start the next queued request, then wake
+//	up the thread waiting for the request that just finished.
 //----------------------------------------------------------------------
 
 void
 SynchDisk::RequestDone()
-{ 
-    semaphore->V();
+{
+    DiskRequest *finished = current;
+    DiskRequest *next;
+
+    current = NULL;
+    if ((next = NextRequest()) != NULL)
+        Start(next);
+    finished->done->V();
 }
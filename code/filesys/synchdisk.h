@@ -14,6 +14,27 @@
 #include "disk.h"
 #include "synch.h"
 
+// Order in which the pending disk requests are served
+enum DiskPolicy {
+    DiskFIFO,  // arrival order
+    DiskSSTF,  // shortest seek (closest track) first
+    DiskSCAN,  // elevator: sweep up then down across the tracks
+    DiskCSCAN  // circular elevator: sweep up, then jump back to track 0
+};
+
+// A disk request waiting in the SynchDisk queue.  The requesting thread
+// sleeps on "done" until the request has been served.
+class DiskRequest {
+  public:
+    int sector;           // First sector of the request
+    int count;            // Number of consecutive sectors
+    char *data;           // Buffer to read into / write from
+    bool writing;         // Write request?
+    long long arrival;    // Time (ticks) the request was submitted
+    Semaphore *done;      // Signaled when the request completes
+    DiskRequest *next;    // Next pending request
+};
+
 // The following class defines a "synchronous" disk abstraction.
 // As with other I/O devices, the raw physical disk is an asynchronous device --
 // requests to read or write portions of the disk return immediately,
@@ -23,10 +44,14 @@
 //
 // This class provides the abstraction that for any individual thread
 // making a request, it waits around until the operation finishes before
-// returning.
+// returning.  Requests made while the disk is busy are queued, and
+// served in the order given by the scheduling policy each time the
+// disk completes a request.
 class SynchDisk {
   public:
-    SynchDisk(const char* name);    		// Initialize a synchronous disk,
+    SynchDisk(const char* name, DiskPolicy diskPolicy = DiskCSCAN,
+              bool mapped = FALSE);
+    					// Initialize a synchronous disk,
 					// by initializing the raw Disk.
     ~SynchDisk();			// De-allocate the synch disk data
     
@@ -37,17 +62,32 @@ class SynchDisk {
     					// Disk::ReadRequest/WriteRequest and
 					// then wait until the request is done.
     void WriteSector(int sectorNumber, char* data);
+
+    void ReadSectors(int sectorNumber, int count, char* data);
+    					// Read/write "count" consecutive
+					// sectors in a single disk request
+    void WriteSectors(int sectorNumber, int count, char* data);
     
+    void Flush();			// Make sure the data written so far
+					// is in the UNIX file of the disk
+
     void RequestDone();			// Called by the disk device interrupt
 					// handler, to signal that the
 					// current disk operation is complete.
 
   private:
+    void Submit(int sectorNumber, int count, char* data, bool writing);
+    					// Queue a request and wait for it
+    void Start(DiskRequest *request);	// Send a request to the disk
+    DiskRequest *NextRequest();		// Dequeue the next request to serve,
+					// according to the policy
+
     Disk *disk;		  		// Raw disk device
-    Semaphore *semaphore; 		// To synchronize requesting thread 
-					// with the interrupt handler
-    Lock *lock;		  		// Only one read/write request
-					// can be sent to the disk at a time
+    DiskPolicy policy;			// How to pick the next request
+    DiskRequest *pending;		// Requests waiting for the disk
+    DiskRequest *current;		// Request being served, NULL if idle
+    int headSector;			// Sector where the head stands
+    bool sweepUp;			// SCAN: is the head moving up?
 };
 
 #endif // SYNCHDISK_H
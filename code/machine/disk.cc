@@ -38,9 +38,11 @@ static void DiskDone(int arg) { ((Disk *)arg)->HandleInterrupt(); }
 //      "callWhenDone" -- interrupt handler to be called when disk read/write
 //         request completes
 //      "callArg" -- argument to pass the interrupt handler
+//      "mapped" -- map the UNIX file in memory rather than reading and
+//         writing it with system calls
 //----------------------------------------------------------------------
 
-Disk::Disk(const char *name, VoidFunctionPtr callWhenDone, int callArg) {
+Disk::Disk(const char *name, VoidFunctionPtr callWhenDone, int callArg, bool mapped) {
     int magicNum;
     int tmp = 0;
 
@@ -64,6 +66,11 @@ Disk::Disk(const char *name, VoidFunctionPtr callWhenDone, int callArg) {
         WriteFile(fileno, (char *)&tmp, sizeof(int));
     }
     active = FALSE;
+
+    image = NULL;
+    if (mapped && (image = MapFile(fileno, DiskSize)) == NULL)
+        fprintf(stderr, "Warning: could not map the disk %s, -dmap ignored "
+                        "(using read/write)\n", name);
 }
 
 //----------------------------------------------------------------------
@@ -72,7 +79,25 @@ Disk::Disk(const char *name, VoidFunctionPtr callWhenDone, int callArg) {
 //      disk.
 //----------------------------------------------------------------------
 
-Disk::~Disk() { Close(fileno); }
+Disk::~Disk() {
+    if (image != NULL) {
+        SyncMappedFile(image, DiskSize);
+        UnmapFile(image, DiskSize);
+    }
+    Close(fileno);
+}
+
+//----------------------------------------------------------------------
+// Disk::Flush()
+//      Write the modified parts of a mapped disk back to the UNIX file.
+//      Reads and writes go straight to the file otherwise, so there is
+//      nothing to do.
+//----------------------------------------------------------------------
+
+void Disk::Flush() {
+    if (image != NULL)
+        SyncMappedFile(image, DiskSize);
+}
 
 //----------------------------------------------------------------------
 // Disk::PrintSector()
@@ -106,39 +131,66 @@ static void PrintSector(bool writing, int sector, char *data) {
 //      "data" -- the bytes to be written, the buffer to hold the incoming bytes
 //----------------------------------------------------------------------
 
-void Disk::ReadRequest(int sectorNumber, char *data) {
-    int ticks = ComputeLatency(sectorNumber, FALSE);
+void Disk::ReadRequest(int sectorNumber, char *data) { ReadSectors(sectorNumber, 1, data); }
+
+void Disk::WriteRequest(int sectorNumber, char *data) { WriteSectors(sectorNumber, 1, data); }
+
+//----------------------------------------------------------------------
+// Disk::ReadSectors/WriteSectors
+//      Simulate a request to read/write "count" consecutive disk sectors.
+//      The whole range is transferred to the UNIX file with a single
+//      positioned read/write, and a single interrupt signals the end of
+//      the request.
+//
+//      "sectorNumber" -- the first disk sector to read/write
+//      "count" -- the number of sectors to read/write
+//      "data" -- the bytes to be written, the buffer to hold the incoming
+//         bytes (count * SectorSize bytes)
+//----------------------------------------------------------------------
+
+void Disk::ReadSectors(int sectorNumber, int count, char *data) {
+    int ticks = ComputeLatency(sectorNumber, count, FALSE);
 
     ASSERT(!active); // only one request at a time
-    ASSERT((sectorNumber >= 0) && (sectorNumber < NumSectors));
+    ASSERT((sectorNumber >= 0) && (count > 0) && (sectorNumber + count <= NumSectors));
 
-    DEBUG('d', "Reading from sector %d\n", sectorNumber);
-    Lseek(fileno, SectorSize * sectorNumber + MagicSize, 0);
-    Read(fileno, data, SectorSize);
+    DEBUG('d', "Reading %d sectors from sector %d\n", count, sectorNumber);
+    if (image != NULL)
+        memcpy(data, &image[SectorSize * sectorNumber + MagicSize], count * SectorSize);
+    else
+        PRead(fileno, data, count * SectorSize, SectorSize * sectorNumber + MagicSize);
     if (DebugIsEnabled('d'))
-        PrintSector(FALSE, sectorNumber, data);
+        for (int i = 0; i < count; i++)
+            PrintSector(FALSE, sectorNumber + i, &data[i * SectorSize]);
 
     active = TRUE;
     UpdateLast(sectorNumber);
+    UpdateLast(sectorNumber + count - 1);
     stats->numDiskReads++;
+    stats->numDiskSectorsRead += count;
     interrupt->Schedule(DiskDone, (int)this, ticks, DiskInt);
 }
 
-void Disk::WriteRequest(int sectorNumber, char *data) {
-    int ticks = ComputeLatency(sectorNumber, TRUE);
+void Disk::WriteSectors(int sectorNumber, int count, char *data) {
+    int ticks = ComputeLatency(sectorNumber, count, TRUE);
 
     ASSERT(!active);
-    ASSERT((sectorNumber >= 0) && (sectorNumber < NumSectors));
+    ASSERT((sectorNumber >= 0) && (count > 0) && (sectorNumber + count <= NumSectors));
 
-    DEBUG('d', "Writing to sector %d\n", sectorNumber);
-    Lseek(fileno, SectorSize * sectorNumber + MagicSize, 0);
-    WriteFile(fileno, data, SectorSize);
+    DEBUG('d', "Writing %d sectors to sector %d\n", count, sectorNumber);
+    if (image != NULL)
+        memcpy(&image[SectorSize * sectorNumber + MagicSize], data, count * SectorSize);
+    else
+        PWrite(fileno, data, count * SectorSize, SectorSize * sectorNumber + MagicSize);
     if (DebugIsEnabled('d'))
-        PrintSector(TRUE, sectorNumber, data);
+        for (int i = 0; i < count; i++)
+            PrintSector(TRUE, sectorNumber + i, &data[i * SectorSize]);
 
     active = TRUE;
     UpdateLast(sectorNumber);
+    UpdateLast(sectorNumber + count - 1);
     stats->numDiskWrites++;
+    stats->numDiskSectorsWritten += count;
     interrupt->Schedule(DiskDone, (int)this, ticks, DiskInt);
 }
 
@@ -234,6 +286,22 @@ int Disk::ComputeLatency(int newSector, bool writing) {
     return (seek + rotation + RotationTime);
 }
 
+//----------------------------------------------------------------------
+// Disk::ComputeLatency()
+//      Return how long will it take to read/write "count" consecutive
+//      sectors starting at newSector: the latency of the first sector,
+//      then one rotation per following sector, plus a one track seek
+//      each time the range crosses to the next track.
+//----------------------------------------------------------------------
+
+int Disk::ComputeLatency(int newSector, int count, bool writing) {
+    int lastTrack = (newSector + count - 1) / SectorsPerTrack;
+    int tracksCrossed = lastTrack - newSector / SectorsPerTrack;
+
+    return ComputeLatency(newSector, writing) + (count - 1) * RotationTime +
+           tracksCrossed * SeekTime;
+}
+
 //----------------------------------------------------------------------
 // Disk::UpdateLast
 //      Keep track of the most recently requested sector.  So we can know
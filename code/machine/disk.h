@@ -45,6 +45,10 @@
 // disks these days now come with a track buffer.
 //
 // The track buffer simulation can be disabled by compiling with -DNOTRACKBUF
+//
+// Optionally, the UNIX file can be mapped in memory once and for all,
+// so that sector transfers are memory copies instead of system calls.
+// The simulated timing is the same either way.
 
 #define SectorSize 128     // number of bytes per disk sector
 #define SectorsPerTrack 32 // number of sectors per disk track
@@ -54,10 +58,12 @@
 
 class Disk {
   public:
-    Disk(const char *name, VoidFunctionPtr callWhenDone, int callArg);
+    Disk(const char *name, VoidFunctionPtr callWhenDone, int callArg,
+         bool mapped = FALSE);
     // Create a simulated disk.
     // Invoke (*callWhenDone)(callArg)
     // every time a request completes.
+    // If "mapped", map the UNIX file in memory.
     ~Disk(); // Deallocate the disk.
 
     void ReadRequest(int sectorNumber, char *data);
@@ -67,6 +73,16 @@ class Disk {
     // Only one request allowed at a time!
     void WriteRequest(int sectorNumber, char *data);
 
+    void ReadSectors(int sectorNumber, int count, char *data);
+    // Read/write "count" consecutive sectors
+    // starting at "sectorNumber" in a single
+    // request: one seek, then the sectors
+    // pass under the head one after the other.
+    void WriteSectors(int sectorNumber, int count, char *data);
+
+    void Flush(); // Make sure the UNIX file is up to date
+                  // (only needed when it is mapped)
+
     void HandleInterrupt(); // Interrupt handler, invoked when
     // disk request finishes.
 
@@ -74,9 +90,12 @@ class Disk {
     // Return how long a request to
     // newSector will take:
     // (seek + rotational delay + transfer)
+    int ComputeLatency(int newSector, int count, bool writing);
+    // Same for "count" consecutive sectors
 
   private:
     int fileno;              // UNIX file number for simulated disk
+    char *image;             // The UNIX file mapped in memory, or NULL
     VoidFunctionPtr handler; // Interrupt handler, to be invoked
     // when any disk request finishes
     int handlerArg; // Argument to interrupt handler
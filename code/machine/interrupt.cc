@@ -64,6 +64,8 @@ Interrupt::Interrupt() {
     inHandler = FALSE;
     yieldOnReturn = FALSE;
     status = SystemMode;
+    idleHandler = NULL;
+    idleArg = 0;
 }
 
 //----------------------------------------------------------------------
@@ -201,6 +203,12 @@ void Interrupt::YieldOnReturn() {
 void Interrupt::Idle() {
     DEBUG('i', "Machine idling; checking for interrupts.\n");
     status = IdleMode;
+    if (idleHandler != NULL) { // let a device wait for host events
+        long long when;        // until the next interrupt is due
+
+        if (pending->FirstKey(&when) && when > stats->totalTicks)
+            (*idleHandler)(idleArg, (int)(when - stats->totalTicks));
+    }
     if (CheckIfDue(TRUE)) {       // check for any pending interrupts
         while (CheckIfDue(FALSE)) // check for any other pending
             ;                     // interrupts
@@ -232,6 +240,22 @@ void Interrupt::Halt() {
     Cleanup(); // Never returns.
 }
 
+//----------------------------------------------------------------------
+// Interrupt::SetIdleHandler
+//      Arrange for "handler" to be called each time the machine idles,
+//      before simulated time is rolled forward to the next interrupt.
+//      The network uses it to wait for packets on the host, instead of
+//      spinning through simulated time.
+//
+//      "handler" is the procedure to call, NULL for none
+//      "arg" is the argument to pass to the procedure
+//----------------------------------------------------------------------
+
+void Interrupt::SetIdleHandler(IdleFunctionPtr handler, int arg) {
+    idleHandler = handler;
+    idleArg = arg;
+}
+
 //----------------------------------------------------------------------
 // Interrupt::Schedule
 //      Arrange for the CPU to be interrupted when simulated time
@@ -81,6 +81,13 @@ class PendingInterrupt {
 // or disabled, and any hardware interrupts that are scheduled to occur
 // in the future.
 
+// The following type is a procedure called when the machine idles,
+// before simulated time is advanced to the next pending interrupt:
+// "ticks" is how far that interrupt is.  It can block the host process
+// for a while, and schedule an earlier interrupt if a device has work.
+
+typedef void (*IdleFunctionPtr)(int arg, int ticks);
+
 class Interrupt {
   public:
     Interrupt();  // initialize the interrupt simulation
@@ -119,6 +126,9 @@ class Interrupt {
 
     void OneTick(); // Advance simulated time
 
+    void SetIdleHandler(IdleFunctionPtr handler, // Call "handler" each
+                        int arg); // time the machine idles; NULL for none
+
   private:
     IntStatus level; // are interrupts enabled or disabled?
     List *pending;   // the list of interrupts scheduled
@@ -127,6 +137,8 @@ class Interrupt {
     bool yieldOnReturn; // TRUE if we are to context switch
     // on return from the interrupt handler
     MachineStatus status; // idle, kernel mode, user mode
+    IdleFunctionPtr idleHandler; // called when the machine idles
+    int idleArg;                 // argument of "idleHandler"
 
     // these functions are internal to the interrupt simulation code
 
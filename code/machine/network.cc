@@ -13,6 +13,83 @@
 
 #include <strings.h> /* for bzero */
 
+int wireSize = DefaultWireSize; // largest packet that can go out on the wire
+
+// Put a packet at the end of the queue
+void PacketQueue::Append(Packet *pkt)
+{
+    pkt->next = NULL;
+    if (last == NULL)
+        first = pkt;
+    else
+        last->next = pkt;
+    last = pkt;
+}
+
+// Take the first packet off the queue; NULL if it is empty
+Packet *PacketQueue::Remove()
+{
+    Packet *pkt = first;
+
+    if (pkt != NULL) {
+        first = pkt->next;
+        if (first == NULL)
+            last = NULL;
+    }
+    return pkt;
+}
+
+// Allocate the packets of the pool, each as large as the wire allows
+PacketPool::PacketPool(int size)
+{
+    allocated = 0;
+    for (int i = 0; i < size; i++) {
+        Packet *pkt = new Packet;
+        pkt->buffer = new char[MaxWireSize];
+        freePackets.Append(pkt);
+        allocated++;
+    }
+}
+
+// De-allocate the packets given back to the pool
+PacketPool::~PacketPool()
+{
+    Packet *pkt;
+
+    while ((pkt = freePackets.Remove()) != NULL) {
+        delete[] pkt->buffer;
+        delete pkt;
+    }
+}
+
+// Take a packet out of the pool.  Interrupts are disabled, as the
+// network interrupt handler takes packets too.  The pool only grows
+// when every packet is in use.
+Packet *PacketPool::Alloc()
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    Packet *pkt = freePackets.Remove();
+
+    if (pkt == NULL) {
+        pkt = new Packet;
+        pkt->buffer = new char[MaxWireSize];
+        allocated++;
+        DEBUG('n', "Packet pool grown to %d packets\n", allocated);
+    }
+    (void)interrupt->SetLevel(oldLevel);
+    pkt->tag = 0;
+    return pkt;
+}
+
+// Give a packet back to the pool
+void PacketPool::Free(Packet *pkt)
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    freePackets.Append(pkt);
+    (void)interrupt->SetLevel(oldLevel);
+}
+
 // Dummy functions because C++ can't call member functions indirectly
 static void NetworkReadPoll(int arg)
 {
@@ -20,6 +97,24 @@ static void NetworkReadPoll(int arg)
     net->CheckPktAvail();
 }
 
+static void NetworkArrived(int arg)
+{
+    Network *net = (Network *)arg;
+    net->PacketsArrived();
+}
+
+static void NetworkSwitchArrival(int arg)
+{
+    Network *net = (Network *)arg;
+    net->SwitchArrival();
+}
+
+static void NetworkIdleWait(int arg, int ticks)
+{
+    Network *net = (Network *)arg;
+    net->IdleWait(ticks);
+}
+
 static void NetworkSendDone(int arg)
 {
     Network *net = (Network *)arg;
@@ -47,105 +142,339 @@ Network::Network(NetworkAddress addr, double reliability,
     readHandler = readAvail;
     handlerArg = callArg;
     sendBusy = FALSE;
-    inHdr.length = 0;
+    batchSize = 0;
+    peers = NULL;
+    numPeers = 0;
+    numArrived = 0;
+    arrivalPending = FALSE;
+    idleTicks = 0;
+
+    if (packetSwitch != NULL) {
+        // machines simulated in this process: packets go through the
+        // switch, and are pushed to us; there is nothing to poll
+        sock = events = -1;
+        packetSwitch->Attach(ident, this);
+        return;
+    }
 
     sock = OpenSocket();
     sprintf(sockName, "SOCKET_%d", (int)addr);
     AssignNameToSocket(sockName, sock); // Bind socket to a filename
     // in the current directory.
+    events = OpenSocketEvents(sock);
 
-    // start polling for incoming packets
-    interrupt->Schedule(NetworkReadPoll, (int)this, NetworkTime,
+    // wait for incoming packets whenever the machine idles, and check
+    // for them from time to time when it does not
+    interrupt->SetIdleHandler(NetworkIdleWait, (int)this);
+    interrupt->Schedule(NetworkReadPoll, (int)this, NetworkPollTime,
                         NetworkRecvInt);
 }
 
 Network::~Network()
 {
-    CloseSocket(sock);
-    DeAssignNameToSocket(sockName);
+    Packet *pkt;
+
+    if (packetSwitch != NULL)
+        packetSwitch->Detach(ident);
+    else {
+        interrupt->SetIdleHandler(NULL, 0);
+        CloseSocketEvents(events);
+        CloseSocket(sock);
+        DeAssignNameToSocket(sockName);
+    }
+    while ((pkt = arrived.Remove()) != NULL)
+        packetPool->Free(pkt);
+    while ((pkt = inbound.Remove()) != NULL)
+        packetPool->Free(pkt);
+    for (int i = 0; i < numPeers; i++)
+        if (peers[i] != NULL)
+            DeleteSocketAddress(peers[i]);
+    delete[] peers;
 }
 
-// if a packet is already buffered, we simply delay reading
-// the incoming packet.  In real life, the incoming
-// packet might be dropped if we can't read it in time.
+// check for incoming packets, in case the machine keeps busy and
+// never idles
 void Network::CheckPktAvail()
 {
-    // schedule the next time to poll for a packet
-    interrupt->Schedule(NetworkReadPoll, (int)this, NetworkTime,
+    // schedule the next time to poll for packets
+    interrupt->Schedule(NetworkReadPoll, (int)this, NetworkPollTime,
                         NetworkRecvInt);
+    ReadPackets();
+}
+
+// packets were seen on the socket while the machine idled
+void Network::PacketsArrived()
+{
+    arrivalPending = FALSE;
+    ReadPackets();
+}
+
+// the machine has nothing to do for "ticks": instead of rolling
+// simulated time forward at once, block on the socket for the matching
+// host time (IdleTicksPerMs), and raise an interrupt right away if a
+// packet arrives meanwhile.
+//
+// Host waits are counted in milliseconds, so short idle periods add up
+// until a whole one is due.  A long period, such as a retransmission or
+// disconnection timer, waits at most IdleWaitMaxMs: the timer then fires
+// as soon as nothing else can happen, as it would without the network.
+void Network::IdleWait(int ticks)
+{
+    int timeout;
 
-    if (inHdr.length != 0) // do nothing if packet is already buffered
+    if (arrivalPending || numArrived >= RecvBatch)
+        return; // the packets already seen must be taken first
+    idleTicks += ticks;
+    timeout = idleTicks / IdleTicksPerMs;
+    if (timeout == 0)
         return;
-    if (!PollSocket(sock)) // do nothing if no packet to be read
+    idleTicks %= IdleTicksPerMs;
+    if (timeout > IdleWaitMaxMs)
+        timeout = IdleWaitMaxMs;
+
+    if (WaitSocketEvents(events, timeout)) {
+        idleTicks = 0;
+        arrivalPending = TRUE;
+        interrupt->Schedule(NetworkArrived, (int)this, 1, NetworkRecvInt);
+    }
+}
+
+// read the packets waiting on the socket, several at a time, straight
+// into buffers of the pool: they are passed as is to the post office.
+//
+// if RecvBatch packets are already buffered, we simply delay reading
+// the incoming ones.  In real life, they might be dropped if we can't
+// read them in time.
+void Network::ReadPackets()
+{
+    Packet *pkts[RecvBatch];
+    char *buffers[RecvBatch];
+    int sizes[RecvBatch];
+    int count = RecvBatch - numArrived;
+    int n;
+
+    if (count <= 0) // do nothing if enough packets are buffered
+        return;
+    if (!WaitSocketEvents(events, 0)) // do nothing if no packet to be read
         return;
 
-    // otherwise, read packet in
-    char *buffer = new char[MaxWireSize];
-    ReadFromSocket(sock, buffer, MaxWireSize);
+    for (int i = 0; i < count; i++) {
+        pkts[i] = packetPool->Alloc();
+        buffers[i] = pkts[i]->buffer;
+    }
+    n = ReadManyFromSocket(sock, buffers, sizes, count, MaxWireSize);
+    for (int i = n; i < count; i++)
+        packetPool->Free(pkts[i]);
 
-    // divide packet into header and data
-    inHdr = *(PacketHeader *)buffer;
-    ASSERT((inHdr.to == ident) && (inHdr.length <= MaxPacketSize));
-    bcopy(buffer + sizeof(PacketHeader), inbox, inHdr.length);
-    delete[] buffer;
+    for (int i = 0; i < n; i++) {
+        PacketHeader *hdr = pkts[i]->Header();
 
-    DEBUG('n', "Network received packet from %d, length %d...\n",
-          (int)inHdr.from, inHdr.length);
-    stats->numPacketsRecvd++;
+        ASSERT(sizes[i] >= (int)sizeof(PacketHeader));
+        ASSERT((hdr->to == ident) &&
+               (hdr->length <= sizes[i] - sizeof(PacketHeader)));
+        arrived.Append(pkts[i]);
+        numArrived++;
 
-    // tell post office that the packet has arrived
-    (*readHandler)(handlerArg);
+        DEBUG('n', "Network received packet from %d, length %d...\n",
+              (int)hdr->from, hdr->length);
+        stats->numPacketsRecvd++;
+    }
+
+    // tell post office that the packets have arrived, once for each
+    for (int i = 0; i < n; i++)
+        (*readHandler)(handlerArg);
 }
 
 // notify user that another packet can be sent
 void Network::SendDone()
 {
     sendBusy = FALSE;
-    stats->numPacketsSent++;
+    stats->numPacketsSent += batchSize;
     (*writeHandler)(handlerArg);
 }
 
-// send a packet by concatenating hdr and data, and schedule
-// an interrupt to tell the user when the next packet can be sent
-//
-// Note we always pad out a packet to MaxWireSize before putting it into
-// the socket, because it's simpler at the receive end.
-void Network::Send(PacketHeader hdr, char *data)
+// return the address of the socket of machine "to", built the first
+// time a packet is sent to it
+void *Network::PeerAddress(NetworkAddress to)
+{
+    ASSERT(to >= 0);
+    if (to >= numPeers) {
+        int size = (2 * numPeers > to) ? 2 * numPeers : to + 1;
+        void **grown = new void *[size];
+
+        for (int i = 0; i < size; i++)
+            grown[i] = (i < numPeers) ? peers[i] : NULL;
+        delete[] peers;
+        peers = grown;
+        numPeers = size;
+    }
+    if (peers[to] == NULL) {
+        char toName[32];
+
+        sprintf(toName, "SOCKET_%d", (int)to);
+        peers[to] = NewSocketAddress(toName);
+    }
+    return peers[to];
+}
+
+// a packet from the packet switch: it is ours from now on, and arrives
+// "delay" ticks from now, once it is done being sent
+void Network::Inject(Packet *pkt, int delay)
+{
+    inbound.Append(pkt);
+    interrupt->Schedule(NetworkSwitchArrival, (int)this, delay,
+                        NetworkRecvInt);
+}
+
+// the oldest packet on its way from the switch has arrived
+void Network::SwitchArrival()
+{
+    Packet *pkt = inbound.Remove();
+    PacketHeader *hdr = pkt->Header();
+
+    ASSERT(hdr->to == ident);
+    arrived.Append(pkt);
+    numArrived++;
+
+    DEBUG('n', "Network received packet from %d, length %d...\n",
+          (int)hdr->from, hdr->length);
+    stats->numPacketsRecvd++;
+
+    // tell post office that the packet has arrived
+    (*readHandler)(handlerArg);
+}
+
+// send a packet, whose header is already in front of its data
+void Network::Send(Packet *pkt)
 {
-    char toName[32];
+    SendMany(&pkt, 1);
+}
 
-    sprintf(toName, "SOCKET_%d", (int)hdr.to);
+// send a batch of packets, each with its header already in front of
+// its data, and schedule an interrupt to tell the user when the next
+// batch can be sent
+//
+// Only the header and "hdr.length" bytes of data of each packet go out
+// on the wire.  The time to send the batch grows with their size; the
+// fixed cost of a send is paid once per batch.
+void Network::SendMany(Packet **pkts, int count)
+{
+    char *buffers[SendBatch];
+    int sizes[SendBatch];
+    void *toAddrs[SendBatch];
+    int n = 0, bytes = 0, delay, dropped;
 
     ASSERT(sendBusy == FALSE);
-    ASSERT(hdr.length > 0);
-    ASSERT(hdr.length <= MaxPacketSize);
-    ASSERT(hdr.from == ident);
-    DEBUG('n', "Sending to addr %d, %d bytes... ", hdr.to, hdr.length);
+    ASSERT((count > 0) && (count <= SendBatch));
+
+    for (int i = 0; i < count; i++) {
+        PacketHeader *hdr = pkts[i]->Header();
+        int size = sizeof(PacketHeader) + hdr->length;
+
+        ASSERT(hdr->length > 0);
+        ASSERT(hdr->length <= MaxPacketSize);
+        ASSERT(hdr->from == ident);
+        DEBUG('n', "Sending to addr %d, %d bytes... ", hdr->to, hdr->length);
+        bytes += size;
+
+        if (Random() % 100 >= chanceToWork * 100)
+        { // emulate a lost packet
+            DEBUG('n', "oops, lost it!\n");
+            continue;
+        }
+        // header and data are already together, send them out
+        buffers[n] = pkts[i]->buffer;
+        sizes[n] = size;
+        toAddrs[n] = (packetSwitch == NULL) ? PeerAddress(hdr->to) : NULL;
+        n++;
+    }
 
-    interrupt->Schedule(NetworkSendDone, (int)this, NetworkTime,
-                        NetworkSendInt);
+    sendBusy = TRUE;
+    batchSize = count;
+    delay = NetworkTime + bytes / NetworkBytesPerTick;
+    interrupt->Schedule(NetworkSendDone, (int)this, delay, NetworkSendInt);
 
-    if (Random() % 100 >= chanceToWork * 100)
-    { // emulate a lost packet
-        DEBUG('n', "oops, lost it!\n");
+    if (n == 0)
+        return;
+    if (packetSwitch == NULL) {
+        // the retransmissions of the post office make up for the packets
+        // a full socket queue dropped
+        if ((dropped = SendManyToSocket(sock, buffers, sizes, toAddrs, n)) > 0)
+            DEBUG('n', "Socket queue full, %d packets lost\n", dropped);
         return;
     }
 
-    // concatenate hdr and data into a single buffer, and send it out
-    char *buffer = new char[MaxWireSize];
-    *(PacketHeader *)buffer = hdr;
-    bcopy(data, buffer + sizeof(PacketHeader), hdr.length);
-    SendToSocket(sock, buffer, MaxWireSize, toName);
-    delete[] buffer;
+    // through the packet switch: each packet is copied into a packet
+    // of the pool, handed over to the destination machine
+    for (int i = 0; i < n; i++) {
+        Network *dest = packetSwitch->Port(((PacketHeader *)buffers[i])->to);
+        Packet *copy;
+
+        if (dest == NULL) {
+            DEBUG('n', "No machine %d on the switch, packet lost\n",
+                  ((PacketHeader *)buffers[i])->to);
+            continue;
+        }
+        copy = packetPool->Alloc();
+        bcopy(buffers[i], copy->buffer, sizes[i]);
+        dest->Inject(copy, delay);
+    }
 }
 
-// read a packet, if one is buffered
-PacketHeader Network::Receive(char *data)
+// hand the oldest arrived packet over to the caller, if one is
+// buffered
+Packet *Network::Receive()
 {
-    PacketHeader hdr = inHdr;
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    Packet *pkt = arrived.Remove();
 
-    inHdr.length = 0;
-    if (hdr.length != 0)
-        bcopy(inbox, data, hdr.length);
-    return hdr;
-}
\ No newline at end of file
+    if (pkt != NULL)
+        numArrived--;
+    (void)interrupt->SetLevel(oldLevel);
+    return pkt;
+}
+
+// create a packet switch, with no machine attached yet
+PacketSwitch::PacketSwitch()
+{
+    ports = NULL;
+    numPorts = 0;
+}
+
+PacketSwitch::~PacketSwitch()
+{
+    delete[] ports;
+}
+
+// connect the network of machine "addr"; there can only be one
+void PacketSwitch::Attach(NetworkAddress addr, Network *net)
+{
+    ASSERT(addr >= 0);
+    if (addr >= numPorts) {
+        int size = (2 * numPorts > addr) ? 2 * numPorts : addr + 1;
+        Network **grown = new Network *[size];
+
+        for (int i = 0; i < size; i++)
+            grown[i] = (i < numPorts) ? ports[i] : NULL;
+        delete[] ports;
+        ports = grown;
+        numPorts = size;
+    }
+    ASSERT(ports[addr] == NULL);
+    ports[addr] = net;
+}
+
+// disconnect machine "addr": packets sent to it are lost from now on
+void PacketSwitch::Detach(NetworkAddress addr)
+{
+    ASSERT(addr >= 0 && addr < numPorts);
+    ports[addr] = NULL;
+}
+
+// return the network of machine "addr", NULL if it is not attached
+Network *PacketSwitch::Port(NetworkAddress addr)
+{
+    if (addr < 0 || addr >= numPorts)
+        return NULL;
+    return ports[addr];
+}
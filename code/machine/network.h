@@ -1,7 +1,9 @@
 // network.h
 //      Data structures to emulate a physical network connection.
 //      The network provides the abstraction of ordered, unreliable,
-//      fixed-size packet delivery to other machines on the network.
+//      packet delivery to other machines on the network.  Packets are
+//      at most "wireSize" bytes long, header included; every machine
+//      of the network must use the same size.
 //
 //      You may note that the interface to the network is similar to
 //      the console device -- both are full duplex channels.
@@ -37,10 +39,79 @@ class PacketHeader {
     // MailHeader prepended by the post office)
 };
 
-#define MaxWireSize 64 // largest packet that can go out on the wire
+#define DefaultWireSize 64  // default, and smallest, wire size
+#define MaxWireLimit 65507  // largest wire size: the data of a UDP datagram
+
+extern int wireSize; // largest packet that can go out on the wire,
+                     // set at startup (-mtu)
+
+#define MaxWireSize wireSize
 #define MaxPacketSize (MaxWireSize - sizeof(struct PacketHeader))
 // data "payload" of the largest packet
 
+#define PacketPoolSize 128 // packet buffers allocated at startup
+#define RecvBatch 16       // packets read from the socket at once, and
+                           // kept until the post office takes them
+#define SendBatch 16       // packets sent to the socket at once
+#define NetworkPollTime NetworkTime // how often a busy machine checks
+                           // for packets (one non-blocking read); an idle
+                           // one waits for them
+#define IdleTicksPerMs 1000 // simulated ticks per millisecond of host
+                           // time spent waiting for packets when idle
+#define IdleWaitMaxMs 20   // longest host wait for one idle period; the
+                           // rest of the period is skipped at once
+
+// The following class defines a packet buffer, as it goes out on the
+// wire: the PacketHeader, followed by the data.  Packets come from the
+// pool, and are passed from the network driver to its users and back
+// without being copied.
+
+class Packet {
+  public:
+    char *buffer; // MaxWireSize bytes
+    Packet *next; // Next packet of the queue or of the free list
+    int tag;      // Free for the users of the packet
+
+    PacketHeader *Header() { return (PacketHeader *)buffer; }
+    char *Data() { return buffer + sizeof(PacketHeader); }
+};
+
+// The following class defines a queue of packets, linked through
+// their "next" field: queueing a packet allocates nothing.  The queue
+// is not synchronized.
+
+class PacketQueue {
+  public:
+    PacketQueue() { first = last = NULL; }
+
+    void Append(Packet *pkt);   // Put a packet at the end of the queue
+    Packet *Remove();           // Take the first packet, NULL if empty
+    Packet *First() { return first; } // First packet, to walk the queue
+    bool IsEmpty() { return first == NULL; }
+
+  private:
+    Packet *first; // Head of the queue, NULL if empty
+    Packet *last;  // Last packet of the queue
+};
+
+// The following class defines the pool of packet buffers.  The pool
+// holds PacketPoolSize packets at first; it only grows if they are all
+// in use at once, so that in steady state no packet is allocated.
+// Packets can be taken and given back from interrupt handlers.
+
+class PacketPool {
+  public:
+    PacketPool(int size); // Allocate "size" packets
+    ~PacketPool();        // De-allocate the free packets
+
+    Packet *Alloc();        // Take a packet out of the pool
+    void Free(Packet *pkt); // Give a packet back
+
+  private:
+    PacketQueue freePackets; // Packets not in use
+    int allocated;           // Packets allocated so far
+};
+
 // The following class defines a physical network device.  The network
 // is capable of delivering fixed sized packets, in order but unreliably,
 // to other machines connected to the network.
@@ -58,26 +129,37 @@ class Network {
     // Allocate and initialize network driver
     ~Network(); // De-allocate the network driver data
 
-    void Send(PacketHeader hdr, char *data);
-    // Send the packet data to a remote machine,
-    // specified by "hdr".  Returns immediately.
+    void Send(Packet *pkt);
+    // Send the packet to a remote machine,
+    // specified by its header.  Returns immediately;
+    // the caller keeps the packet.
     // "writeHandler" is invoked once the next
     // packet can be sent.  Note that writeHandler
     // is called whether or not the packet is
-    // dropped, and note that the "from" field of
-    // the PacketHeader is filled in automatically
-    // by Send().
+    // dropped.
+    void SendMany(Packet **pkts, int count);
+    // Send "count" packets, at most SendBatch, at
+    // once; "writeHandler" is invoked once, when
+    // the whole batch is sent.  The time to send a
+    // batch is NetworkTime, whatever the number of
+    // packets, plus the time to put its bytes on
+    // the wire.
 
-    PacketHeader Receive(char *data);
-    // Poll the network for incoming messages.
-    // If there is a packet waiting, copy the
-    // packet into "data" and return the header.
-    // If no packet is waiting, return a header
-    // with length 0.
+    Packet *Receive();
+    // Return the oldest packet that has arrived,
+    // if any, or NULL.  The caller owns the packet, and
+    // gives it back to the pool when done.
 
     void SendDone(); // Interrupt handler, called when message is
     // sent
-    void CheckPktAvail(); // Check if there is an incoming packet
+    void CheckPktAvail(); // Check if there are incoming packets,
+    // periodically
+    void PacketsArrived(); // Interrupt handler, called when packets
+    // were seen while the machine idled
+    void IdleWait(int ticks); // The machine idles for "ticks": wait
+    // for packets on the host meanwhile
+    void SwitchArrival(); // Interrupt handler, called when a packet
+    // from the packet switch arrives
 
   private:
     NetworkAddress ident;         // This machine's network address
@@ -93,8 +175,44 @@ class Network {
     bool sendBusy;    // Packet is being sent.
     bool packetAvail; // Packet has arrived, can be pulled off of
     //   network
-    PacketHeader inHdr;        // Information about arrived packet
-    char inbox[MaxPacketSize]; // Data for arrived packet
+    int events;          // Handle to wait for packets on "sock"
+    void **peers;        // Address of the socket of each machine packets
+                         // were sent to, indexed by network address
+    int numPeers;        // Number of entries of "peers"
+    int batchSize;       // Number of packets of the batch being sent
+    void *PeerAddress(NetworkAddress to); // Socket address of "to"
+    PacketQueue inbound; // Packets on their way from the packet switch
+    void Inject(Packet *pkt, int delay); // Make a packet from the switch
+                         // arrive in "delay" ticks
+    PacketQueue arrived; // Arrived packets, not taken yet
+    int numArrived;      // Number of packets in "arrived"
+    bool arrivalPending; // Is PacketsArrived scheduled?
+    int idleTicks;       // Idle ticks not yet spent waiting on the host
+    void ReadPackets();  // Read the packets waiting on "sock"
+};
+
+// The following class defines an in-memory packet switch, which connects
+// the networks of several machines simulated in the same process, in
+// place of UNIX sockets.  A packet reaches its destination when it is
+// done being sent, in simulated time: no host process, socket file nor
+// host timing is involved, so that runs are deterministic.
+//
+// A packet sent to an address with no machine attached is lost.
+
+class PacketSwitch {
+  public:
+    PacketSwitch();  // Create a switch with no machine attached
+    ~PacketSwitch(); // De-allocate the switch
+
+    void Attach(NetworkAddress addr, Network *net); // Connect the network
+    // of machine "addr"
+    void Detach(NetworkAddress addr); // Disconnect it
+    Network *Port(NetworkAddress addr); // Network of machine "addr",
+    // NULL if none
+
+  private:
+    Network **ports; // Network of each machine, indexed by address
+    int numPorts;    // Number of entries of "ports"
 };
 
 #endif // NETWORK_H
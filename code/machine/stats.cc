@@ -19,8 +19,49 @@
 Statistics::Statistics() {
     totalTicks = idleTicks = systemTicks = userTicks = 0;
     numDiskReads = numDiskWrites = 0;
+    numDiskSectorsRead = numDiskSectorsWritten = 0;
     numConsoleCharsRead = numConsoleCharsWritten = 0;
     numPageFaults = numPacketsSent = numPacketsRecvd = 0;
+    numLoopbackMessages = 0;
+    numDiskRequests = 0;
+    diskLatencyTicks = diskLatencyMax = 0;
+    for (int i = 0; i < DiskLatencyBuckets; i++)
+        diskLatencyHistogram[i] = 0;
+}
+
+//----------------------------------------------------------------------
+// Statistics::RecordDiskLatency
+//      Account a completed disk request, which took "ticks" from its
+//      submission to its completion.
+//----------------------------------------------------------------------
+
+void Statistics::RecordDiskLatency(long long ticks) {
+    int bucket = ticks / DiskLatencyStep;
+
+    if (bucket >= DiskLatencyBuckets)
+        bucket = DiskLatencyBuckets - 1;
+    numDiskRequests++;
+    diskLatencyTicks += ticks;
+    if (ticks > diskLatencyMax)
+        diskLatencyMax = ticks;
+    diskLatencyHistogram[bucket]++;
+}
+
+//----------------------------------------------------------------------
+// Statistics::DiskLatencyPercentile
+//      Return the upper bound of the latency bucket reached by "percent"%
+//      of the disk requests (the maximum latency for the last bucket).
+//----------------------------------------------------------------------
+
+long long Statistics::DiskLatencyPercentile(int percent) {
+    int seen = 0;
+
+    for (int i = 0; i < DiskLatencyBuckets - 1; i++) {
+        seen += diskLatencyHistogram[i];
+        if (seen * 100LL >= (long long)numDiskRequests * percent)
+            return (long long)(i + 1) * DiskLatencyStep;
+    }
+    return diskLatencyMax;
 }
 
 //----------------------------------------------------------------------
@@ -37,10 +78,17 @@ void Statistics::Print() {
            idleTicks, systemTicks, userTicks);
     // End of correction
 
-    printf("Disk I/O: reads %d, writes %d\n", numDiskReads, numDiskWrites);
+    printf("Disk I/O: reads %d (%d sectors), writes %d (%d sectors)\n", numDiskReads,
+           numDiskSectorsRead, numDiskWrites, numDiskSectorsWritten);
+    if (numDiskRequests > 0)
+        printf("Disk requests: %d, latency average %lld, 99th percentile %lld, max %lld\n",
+               numDiskRequests, diskLatencyTicks / numDiskRequests,
+               DiskLatencyPercentile(99), diskLatencyMax);
     printf("Console I/O: reads %d, writes %d\n", numConsoleCharsRead,
            numConsoleCharsWritten);
     printf("Paging: faults %d\n", numPageFaults);
     printf("Network I/O: packets received %d, sent %d\n", numPacketsRecvd,
            numPacketsSent);
+    if (numLoopbackMessages > 0)
+        printf("Network loopback: messages %d\n", numLoopbackMessages);
 }
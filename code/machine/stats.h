@@ -13,6 +13,11 @@
 
 #include "copyright.h"
 
+// Disk request latencies are counted in buckets of DiskLatencyStep ticks,
+// the last bucket holding all the longer ones
+#define DiskLatencyBuckets 64
+#define DiskLatencyStep 1000
+
 // The following class defines the statistics that are to be kept
 // about Nachos behavior -- how much time (ticks) elapsed, how
 // many user instructions executed, etc.
@@ -39,14 +44,28 @@ class Statistics {
 
     int numDiskReads;           // number of disk read requests
     int numDiskWrites;          // number of disk write requests
+    int numDiskSectorsRead;     // number of sectors these requests moved;
+    int numDiskSectorsWritten;  // a request may cover several sectors
     int numConsoleCharsRead;    // number of characters read from the keyboard
     int numConsoleCharsWritten; // number of characters written to the display
     int numPageFaults;          // number of virtual memory page faults
     int numPacketsSent;         // number of packets sent over the network
     int numPacketsRecvd;        // number of packets received over the network
+    int numLoopbackMessages;    // number of messages a machine sent to
+                                // itself, delivered without the network
+
+    int numDiskRequests;        // number of requests served by the synch disk
+    long long diskLatencyTicks; // total time these requests took, queueing
+                                // included
+    long long diskLatencyMax;   // longest of these requests
+    int diskLatencyHistogram[DiskLatencyBuckets]; // requests per latency range
 
     Statistics(); // initialize everything to zero
 
+    void RecordDiskLatency(long long ticks); // account one disk request
+    long long DiskLatencyPercentile(int percent); // upper bound of the
+                                                  // latency of "percent"%
+                                                  // of the requests
     void Print(); // print collected statistics
 };
 
@@ -63,7 +82,10 @@ class Statistics {
 #define RotationTime 500 // time disk takes to rotate one sector
 #define SeekTime 500     // time disk takes to seek past one track
 #define ConsoleTime 100  // time to read or write one character
-#define NetworkTime 100  // time to send or receive one packet
+#define NetworkTime 100  // time to send or receive one packet, whatever
+                         // its size
+#define NetworkBytesPerTick 8 // bytes of a packet sent per tick, on top
+                              // of NetworkTime
 #define TimerTicks 100   // (average) time between timer interrupts
 
 #endif // STATS_H
@@ -40,6 +40,9 @@ extern "C" {
 #include <sys/types.h>
 #include <sys/un.h>
 #include <unistd.h>
+#ifdef LINUX
+#include <sys/epoll.h>
+#endif
 
 // UNIX routines called by procedures in this file
 
@@ -205,6 +208,23 @@ void Lseek(int fd, int offset, int whence) {
     ASSERT(retVal >= 0);
 }
 
+//----------------------------------------------------------------------
+// PRead / PWrite
+//      Read/write characters at a given location of an open file, in a
+//      single system call and without moving the file offset.
+//      Abort if the transfer is incomplete.
+//----------------------------------------------------------------------
+
+void PRead(int fd, char *buffer, int nBytes, int offset) {
+    int retVal = pread(fd, buffer, nBytes, offset);
+    ASSERT(retVal == nBytes);
+}
+
+void PWrite(int fd, const char *buffer, int nBytes, int offset) {
+    int retVal = pwrite(fd, buffer, nBytes, offset);
+    ASSERT(retVal == nBytes);
+}
+
 //----------------------------------------------------------------------
 // Tell
 //      Report the current location within an open file.
@@ -235,6 +255,42 @@ void Close(int fd) {
 
 bool Unlink(const char *name) { return unlink(name); }
 
+//----------------------------------------------------------------------
+// MapFile
+//      Map the first "size" bytes of an open file in memory, shared with
+//      the file so that stores end up in the file.  Return NULL if the
+//      file can't be mapped.
+//----------------------------------------------------------------------
+
+char *MapFile(int fd, int size) {
+    void *address = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if (address == MAP_FAILED)
+        return NULL;
+    return (char *)address;
+}
+
+//----------------------------------------------------------------------
+// SyncMappedFile
+//      Write the modified pages of a mapped file back to the file.
+//      Abort on error.
+//----------------------------------------------------------------------
+
+void SyncMappedFile(char *address, int size) {
+    int retVal = msync(address, size, MS_SYNC);
+    ASSERT(retVal == 0);
+}
+
+//----------------------------------------------------------------------
+// UnmapFile
+//      Remove the mapping of a file from memory.
+//----------------------------------------------------------------------
+
+void UnmapFile(char *address, int size) {
+    int retVal = munmap(address, size);
+    ASSERT(retVal == 0);
+}
+
 //----------------------------------------------------------------------
 // OpenSocket
 //      Open an interprocess communication (IPC) connection.  For now,
@@ -303,9 +359,10 @@ bool PollSocket(int sockID) {
 
 //----------------------------------------------------------------------
 // ReadFromSocket
-//      Read a fixed size packet off the IPC port.  Abort on error.
+//      Read a packet of at most "packetSize" bytes off the IPC port, and
+//      return its size.  Abort on error.
 //----------------------------------------------------------------------
-void ReadFromSocket(int sockID, char *buffer, int packetSize) {
+int ReadFromSocket(int sockID, char *buffer, int packetSize) {
     int retVal;
     /* extern int errno; modif norme ANSI */
     struct sockaddr_un uName;
@@ -325,16 +382,124 @@ void ReadFromSocket(int sockID, char *buffer, int packetSize) {
     retVal = recvfrom(sockID, buffer, packetSize, 0, (struct sockaddr *)&uName,
                       &size);
 
-    if (retVal != packetSize) {
+    if (retVal < 0) {
         perror("in recvfrom");
         printf("called: %p, got back %d, %d\n", buffer, retVal, errno);
     }
-    ASSERT(retVal == packetSize);
+    ASSERT(retVal >= 0);
+    return retVal;
+}
+
+//----------------------------------------------------------------------
+// OpenSocketEvents
+//      Return a handle to wait for messages arriving on the IPC port
+//      "sockID".  On Linux, it is an epoll instance watching the
+//      socket; elsewhere, the socket itself.
+//----------------------------------------------------------------------
+int OpenSocketEvents(int sockID) {
+#ifdef LINUX
+    struct epoll_event event;
+    int eventsID = epoll_create1(0);
+
+    ASSERT(eventsID >= 0);
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = sockID;
+    ASSERT(epoll_ctl(eventsID, EPOLL_CTL_ADD, sockID, &event) == 0);
+    return eventsID;
+#else
+    return sockID;
+#endif
+}
+
+//----------------------------------------------------------------------
+// CloseSocketEvents
+//      Release the handle returned by OpenSocketEvents.
+//----------------------------------------------------------------------
+void CloseSocketEvents(int eventsID) {
+#ifdef LINUX
+    (void)close(eventsID);
+#endif
+}
+
+//----------------------------------------------------------------------
+// WaitSocketEvents
+//      Block the host process until a message is waiting on the IPC
+//      port, for at most "timeout" milliseconds (0 to just check).
+//      Return TRUE if a message can be read.
+//----------------------------------------------------------------------
+bool WaitSocketEvents(int eventsID, int timeout) {
+#ifdef LINUX
+    struct epoll_event event;
+    int retVal;
+
+    do
+        retVal = epoll_wait(eventsID, &event, 1, timeout);
+    while (retVal < 0 && errno == EINTR);
+    ASSERT(retVal >= 0);
+    return retVal > 0;
+#else
+    int rfd = (1 << eventsID), wfd = 0, xfd = 0, retVal;
+    struct timeval pollTime;
+
+    pollTime.tv_sec = timeout / 1000;
+    pollTime.tv_usec = (timeout % 1000) * 1000;
+#if defined(HOST_i386) || defined(SOLARIS)
+    retVal = select(32, (fd_set *)&rfd, (fd_set *)&wfd, (fd_set *)&xfd,
+                    &pollTime);
+#else
+    retVal = select(32, &rfd, &wfd, &xfd, &pollTime);
+#endif
+    return retVal > 0;
+#endif
+}
+
+//----------------------------------------------------------------------
+// ReadManyFromSocket
+//      Read the messages waiting on the IPC port, at most "count", without
+//      blocking.  Message i is put in buffers[i], of "packetSize" bytes,
+//      and its size in sizes[i].  Return the number of messages read.
+//
+//      On Linux, they are all read in a single call (recvmmsg).
+//----------------------------------------------------------------------
+int ReadManyFromSocket(int sockID, char **buffers, int *sizes, int count,
+                       int packetSize) {
+#ifdef LINUX
+    struct mmsghdr msgs[count];
+    struct iovec iovs[count];
+    int retVal;
+
+    memset(msgs, 0, sizeof(msgs));
+    for (int i = 0; i < count; i++) {
+        iovs[i].iov_base = buffers[i];
+        iovs[i].iov_len = packetSize;
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    do
+        retVal = recvmmsg(sockID, msgs, count, MSG_DONTWAIT, NULL);
+    while (retVal < 0 && errno == EINTR);
+    if (retVal < 0) {
+        ASSERT(errno == EAGAIN || errno == EWOULDBLOCK);
+        return 0;
+    }
+    for (int i = 0; i < retVal; i++)
+        sizes[i] = msgs[i].msg_len;
+    return retVal;
+#else
+    int n = 0;
+
+    while (n < count && WaitSocketEvents(sockID, 0)) {
+        sizes[n] = ReadFromSocket(sockID, buffers[n], packetSize);
+        n++;
+    }
+    return n;
+#endif
 }
 
 //----------------------------------------------------------------------
 // SendToSocket
-//      Transmit a fixed size packet to another Nachos' IPC port.
+//      Transmit a packet of "packetSize" bytes to another Nachos' IPC port.
 //      Abort on error.
 //----------------------------------------------------------------------
 void SendToSocket(int sockID, const char *buffer, int packetSize,
@@ -348,6 +513,87 @@ void SendToSocket(int sockID, const char *buffer, int packetSize,
     ASSERT(retVal == packetSize);
 }
 
+//----------------------------------------------------------------------
+// NewSocketAddress
+//      Return the address of the IPC port named "socketName", to send
+//      packets to it without building the address again each time.
+//----------------------------------------------------------------------
+void *NewSocketAddress(const char *socketName) {
+    struct sockaddr_un *uName = new struct sockaddr_un;
+
+    InitSocketName(uName, socketName);
+    return uName;
+}
+
+//----------------------------------------------------------------------
+// DeleteSocketAddress
+//      De-allocate an address returned by NewSocketAddress.
+//----------------------------------------------------------------------
+void DeleteSocketAddress(void *toAddr) {
+    delete (struct sockaddr_un *)toAddr;
+}
+
+//----------------------------------------------------------------------
+// SendManyToSocket
+//      Transmit "count" packets to other Nachos' IPC ports: packet i is
+//      buffers[i], of sizes[i] bytes, sent to toAddrs[i] (as returned by
+//      NewSocketAddress).  Abort on error.
+//
+//      On Linux, they are all sent in a single call (sendmmsg).  The
+//      sends never block: a packet that finds the receive queue of its
+//      peer full is dropped, like one lost by the network, since two
+//      Nachos sending to each other would otherwise wait for each other
+//      forever.  Return the number of packets dropped.
+//----------------------------------------------------------------------
+int SendManyToSocket(int sockID, char **buffers, int *sizes, void **toAddrs,
+                     int count) {
+    int dropped = 0;
+#ifdef LINUX
+    struct mmsghdr msgs[count];
+    struct iovec iovs[count];
+    int sent = 0, retVal;
+
+    memset(msgs, 0, sizeof(msgs));
+    for (int i = 0; i < count; i++) {
+        iovs[i].iov_base = buffers[i];
+        iovs[i].iov_len = sizes[i];
+        msgs[i].msg_hdr.msg_name = toAddrs[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_un);
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    while (sent < count) {
+        retVal = sendmmsg(sockID, msgs + sent, count - sent, MSG_DONTWAIT);
+        if (retVal < 0 && errno == EINTR)
+            continue;
+        if (retVal < 0 && (errno == EAGAIN || errno == EWOULDBLOCK ||
+                           errno == ENOBUFS)) {
+            sent++; // the first packet left is lost
+            dropped++;
+            continue;
+        }
+        ASSERT(retVal > 0);
+        for (int i = sent; i < sent + retVal; i++)
+            ASSERT((int)msgs[i].msg_len == sizes[i]);
+        sent += retVal;
+    }
+#else
+    int retVal;
+
+    for (int i = 0; i < count; i++) {
+        retVal = sendto(sockID, buffers[i], sizes[i], MSG_DONTWAIT,
+                        (sockaddr *)toAddrs[i], sizeof(struct sockaddr_un));
+        if (retVal < 0 && (errno == EAGAIN || errno == EWOULDBLOCK ||
+                           errno == ENOBUFS)) {
+            dropped++;
+            continue;
+        }
+        ASSERT(retVal == sizes[i]);
+    }
+#endif
+    return dropped;
+}
+
 //----------------------------------------------------------------------
 // CallOnUserAbort
 //      Arrange that "func" will be called when the user aborts (e.g., by
@@ -25,19 +25,36 @@ extern void Read(int fd, char *buffer, int nBytes);
 extern int ReadPartial(int fd, char *buffer, int nBytes);
 extern void WriteFile(int fd, const char *buffer, int nBytes);
 extern void Lseek(int fd, int offset, int whence);
+extern void PRead(int fd, char *buffer, int nBytes, int offset);
+extern void PWrite(int fd, const char *buffer, int nBytes, int offset);
 extern int Tell(int fd);
 extern void Close(int fd);
 extern bool Unlink(const char *name);
 
+// Memory-mapped files: map the "size" first bytes of an open file,
+// flush the modified pages back to the file, unmap
+extern char *MapFile(int fd, int size);
+extern void SyncMappedFile(char *address, int size);
+extern void UnmapFile(char *address, int size);
+
 // Interprocess communication operations, for simulating the network
 extern int OpenSocket();
 extern void CloseSocket(int sockID);
 extern void AssignNameToSocket(const char *socketName, int sockID);
 extern void DeAssignNameToSocket(const char *socketName);
 extern bool PollSocket(int sockID);
-extern void ReadFromSocket(int sockID, char *buffer, int packetSize);
+extern int ReadFromSocket(int sockID, char *buffer, int packetSize);
+extern int ReadManyFromSocket(int sockID, char **buffers, int *sizes,
+                              int count, int packetSize);
+extern int OpenSocketEvents(int sockID);
+extern void CloseSocketEvents(int eventsID);
+extern bool WaitSocketEvents(int eventsID, int timeout);
 extern void SendToSocket(int sockID, const char *buffer, int packetSize,
                          const char *toName);
+extern void *NewSocketAddress(const char *socketName);
+extern void DeleteSocketAddress(void *toAddr);
+extern int SendManyToSocket(int sockID, char **buffers, int *sizes,
+                            void **toAddrs, int count);
 
 // Process control: abort, exit, and sleep
 extern void Abort();
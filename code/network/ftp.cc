@@ -8,12 +8,14 @@ bool FileHandler::FileExists(const char *fileName)
     return (fileSystem->IsDataFile(fileName) && fileSystem->FileExists(fileName));
 }
 
-int FileHandler::CreateFile(const char *fileName) {
+// creates an empty file, with its disk space for fileSize bytes preallocated,
+// and return 0, or -1 on error
+int FileHandler::CreateFile(const char *fileName, int fileSize) {
     if (fileSystem->FileExists(fileName)) {
         printf("ERROR : file %s already exists\n", fileName);
         return -1;
     }
-    if (!fileSystem->Create(fileName, 0)) {
+    if (!fileSystem->Create(fileName, fileSize, TRUE)) {
         printf("ERROR : failed to create file %s\n", fileName);
         return -1;
     }
@@ -345,7 +347,7 @@ bool Server::ReceiveFile(Connection *c, char *fileName, ssize_t fileSize)
 {
     FTPHeader ftpHdr;
     // create file
-    if(FileHandler::CreateFile(fileName) < 0)
+    if(FileHandler::CreateFile(fileName, fileSize) < 0)
     {
         NotifyClient(c, ERROR, 0);
         return false;
@@ -660,7 +662,7 @@ bool Client::ReceiveFile(const char *fileName, ssize_t fileSize)
     FTPHeader ftpHdr;
 
     // create file
-    if(FileHandler::CreateFile(fileName) < 0)
+    if(FileHandler::CreateFile(fileName, fileSize) < 0)
     {
         NotifyServer(ERROR);
         return false;
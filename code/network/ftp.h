@@ -40,7 +40,7 @@ class FTPHeader {
 class FileHandler {
     public:
         static bool FileExists(const char *fileName);
-        static int CreateFile(const char *fileName);
+        static int CreateFile(const char *fileName, int fileSize);
         static int FileSize(const char *fileName);
         static int OpenFile(const char *fileName);
         static int ReadFile(int fd, char *buffer, int fileSize);
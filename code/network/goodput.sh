@@ -0,0 +1,18 @@
+#!/bin/bash
+
+# Measure the goodput of the transport for several network reliabilities.
+# For each one, two machines run the window test (see WindowTest in
+# nettest.cc); the lines printed by the sender are kept, one per window.
+# Extra arguments (e.g. "-rs 1") are passed to both machines.
+#
+# NACHOS selects the binary, so that a build of another commit can be
+# measured the same way, e.g. NACHOS=/tmp/before/nachos-step6 ./goodput.sh
+
+nachos=${NACHOS:-../build/nachos-step6}
+
+for rely in 0.5 0.9 0.99 1; do
+  echo "Reliability $rely"
+  $nachos -m 1 -l $rely "$@" -window 0 > /dev/null &
+  $nachos -m 0 -l $rely "$@" -window 1 | grep "^window"
+  wait
+done
@@ -24,6 +24,8 @@
 #include "system.h"
 #include "ftp.h"
 #include <cstdlib>
+#include <strings.h>
+#include <sys/time.h>
 
 // Test out message delivery, by doing the following:
 //	1. send a message to the machine with ID "farAddr", at mail box #0
@@ -205,6 +207,167 @@ void ConnTest(int farAddr)
     interrupt->Halt();
 }
 
+// Measure the throughput of the transport for each send window.
+// Both machines run "-window <other machine id>"; the one with the
+// lower id sends a WINDOW_TEST_SIZE bytes message to the other one's
+// mailbox #0 with each window in turn, and waits for a short reply
+// telling the whole message has arrived.  One line is printed per
+// window:
+//	window <w> bytes=<..> ticks=<..> packets=<..> wall_us=<..>
+//	        kb_per_sim_sec=<..> kb_per_wall_sec=<..>
+// network/goodput.sh runs it for several reliabilities (-l).
+
+#define WINDOW_TEST_SIZE 4096
+
+static long long WallMicros()
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return (long long)now.tv_sec * 1000000 + now.tv_usec;
+}
+
+void WindowTest(int farAddr)
+{
+    static const int windows[] = {1, 2, 4, 8, 16, MAXWINDOW};
+    int nbWindows = sizeof(windows) / sizeof(windows[0]);
+    NetworkAddress myAddr = postOffice->GetNetAddr();
+    Payload *plOut = new Payload();
+    Payload *plIn = new Payload();
+    char *data = new char[WINDOW_TEST_SIZE];
+    char *buffer = new char[WINDOW_TEST_SIZE];
+    const char *ack = "Got it!";
+    char *reply = new char[MaxSegmentSize];
+    int oldWindow = postOffice->GetWindow();
+
+    for (int i = 0; i < WINDOW_TEST_SIZE - 1; i++)
+    {
+        data[i] = 'a' + i % 26;
+    }
+    data[WINDOW_TEST_SIZE - 1] = '\0';
+    // ReceivePayload clears the previous contents of the buffers
+    bzero(buffer, WINDOW_TEST_SIZE);
+    bzero(reply, MaxSegmentSize);
+
+    for (int w = 0; w < nbWindows; w++)
+    {
+        if (myAddr < farAddr)
+        {
+            postOffice->SetWindow(windows[w]);
+            plOut->UpdatePayload(myAddr, farAddr, 0, 0, WINDOW_TEST_SIZE);
+            int ticks = stats->totalTicks;
+            int packets = stats->numPacketsSent;
+            long long wall = WallMicros();
+
+            postOffice->SendPayload(plOut, data);
+            postOffice->ReceivePayload(plIn, 0, reply);
+
+            ticks = stats->totalTicks - ticks;
+            packets = stats->numPacketsSent - packets;
+            wall = WallMicros() - wall;
+            if (ticks <= 0)
+            {
+                ticks = 1;
+            }
+            if (wall <= 0)
+            {
+                wall = 1;
+            }
+            printf("window %d bytes=%d ticks=%d packets=%d wall_us=%lld "
+                   "kb_per_sim_sec=%.1f kb_per_wall_sec=%.1f\n",
+                   windows[w], WINDOW_TEST_SIZE, ticks, packets, wall,
+                   WINDOW_TEST_SIZE * 1000000.0 / 1024 / ticks,
+                   WINDOW_TEST_SIZE * 1000000.0 / 1024 / wall);
+            fflush(stdout);
+        }
+        else
+        {
+            postOffice->ReceivePayload(plIn, 0, buffer);
+            ASSERT(!strcmp(buffer, data));
+            plOut->UpdatePayload(myAddr, plIn->pktHdr.from, plIn->mailHdr.to,
+                                 plIn->mailHdr.from, strlen(ack) + 1);
+            postOffice->SendPayload(plOut, ack);
+        }
+    }
+    postOffice->SetWindow(oldWindow);
+    delete[] data;
+    delete[] buffer;
+    delete[] reply;
+    delete plIn;
+    delete plOut;
+    interrupt->Halt();
+}
+
+// Pass a message around a ring of "nbMachines" machines, simulated in
+// this process and connected by the packet switch (-switch).  The
+// machine of this Nachos sends it to the next address, and each other
+// machine, with its own post office, passes it on to the next one until
+// it comes back.  The run only depends on simulated time: with the same
+// flags, it takes the same number of ticks.
+
+static const char ringMessage[] =
+    "Hello there! This message goes around the ring, from machine to "
+    "machine, until it comes back to the one that sent it.";
+static PostOffice **ringNodes; // post office of each machine of the ring
+static int ringSize;           // number of machines of the ring
+
+static void RingNode(int index)
+{
+    PostOffice *node = ringNodes[index];
+    NetworkAddress next = ringNodes[(index + 1) % ringSize]->GetNetAddr();
+    Payload *plOut = new Payload();
+    Payload *plIn = new Payload();
+    char buffer[sizeof(ringMessage)];
+
+    node->ReceivePayload(plIn, 0, buffer);
+    DEBUG('p', "[Machine %d] Received the ring message from machine %d\n",
+          node->GetNetAddr(), plIn->pktHdr.from);
+    plOut->UpdatePayload(node->GetNetAddr(), next, 0, 0, sizeof(ringMessage));
+    node->SendPayload(plOut, buffer);
+    delete plIn;
+    delete plOut;
+}
+
+void SwitchRingTest(int nbMachines)
+{
+    NetworkAddress first = postOffice->GetNetAddr();
+    Payload *plOut = new Payload();
+    Payload *plIn = new Payload();
+    char buffer[sizeof(ringMessage)];
+
+    ASSERT(packetSwitch != NULL);
+    ASSERT(nbMachines >= 2);
+    ringSize = nbMachines;
+    ringNodes = new PostOffice *[nbMachines];
+    ringNodes[0] = postOffice;
+    for (int i = 1; i < nbMachines; i++)
+    {
+        ringNodes[i] = new PostOffice(first + i, postOffice->GetReliability(), 10,
+                                      postOffice->GetWindow());
+        Thread *t = new Thread("ring machine");
+        t->Fork(RingNode, i);
+    }
+
+    int ticks = stats->totalTicks;
+    int packets = stats->numPacketsSent;
+    long long wall = WallMicros();
+
+    plOut->UpdatePayload(first, first + 1, 0, 0, sizeof(ringMessage));
+    postOffice->SendPayload(plOut, ringMessage);
+    postOffice->ReceivePayload(plIn, 0, buffer);
+    ASSERT(!strcmp(buffer, ringMessage));
+
+    ticks = stats->totalTicks - ticks;
+    packets = stats->numPacketsSent - packets;
+    wall = WallMicros() - wall;
+    printf("ring machines=%d bytes=%d ticks=%d packets=%d wall_us=%lld\n",
+           nbMachines, (int)sizeof(ringMessage), ticks, packets, wall);
+    fflush(stdout);
+    delete plIn;
+    delete plOut;
+    interrupt->Halt();
+}
+
 // First argument : address of the server machine
 // Second argument : r - read a file from the server
 //                   w - write a file to the server
@@ -20,55 +20,11 @@
 #include "copyright.h"
 #include "system.h"
 #include <string>
+#include <limits.h>
 #include <strings.h> /* for bzero */
 #include <tuple>
 #include <vector>
 
-static void NetworkSendWaitHandler(int arg)
-{
-    static int lastTicksTEMPO = 0;
-    static int lastTicksDISCONNECT = 0;
-
-    int currTick = stats->totalTicks;
-    if(currTick - lastTicksTEMPO > TEMPO)
-    {
-        lastTicksTEMPO = currTick;
-        for(int i = 0; i < postOffice->numBoxes; i++)
-        {
-            postOffice->boxes[i].ackLock->Acquire();
-            postOffice->boxes[i].ackCond->Broadcast(postOffice->boxes[i].ackLock);
-            postOffice->boxes[i].ackLock->Release();
-        }
-    }
-    if(currTick - lastTicksDISCONNECT > DISCONNECT_TEMPO)
-    {
-
-        lastTicksDISCONNECT = currTick;
-        postOffice->disconnectLock->Acquire();
-        postOffice->disconnectCond->Signal(postOffice->disconnectLock);
-        postOffice->disconnectLock->Release();
-    }
-}
-
-//----------------------------------------------------------------------
-// Mail::Mail
-//      Initialize a single mail message, by concatenating the headers to
-//	the data.
-//
-//	"pktH" -- source, destination machine ID's
-//	"mailH" -- source, destination mailbox ID's
-//	"data" -- payload data
-//----------------------------------------------------------------------
-
-Mail::Mail(Payload *p, char *msgData)
-{
-    pktHdr = p->pktHdr;
-    mailHdr = p->mailHdr;
-    // systematically copy the size of a full segment, because we cannot filter whether this is the
-    // last segment or not such a filtering will be performed by MailBox::Get later
-    bcopy(msgData, data, MaxSegmentSize);
-}
-
 //----------------------------------------------------------------------
 // MailBox::MailBox
 //      Initialize a single mail box within the post office, so that it
@@ -79,11 +35,28 @@ Mail::Mail(Payload *p, char *msgData)
 
 MailBox::MailBox()
 {
-    messages = new SynchList();
+    lock = new Lock("mail box lock");
+    messageArrived = new Condition("mail box cond");
     ackCond = new Condition("ack mail box cond");
     ackLock = new Lock("ack mail box cond");
     waitedId = 0;
+    for(int i = 0; i < MAXWINDOW; i++)
+    {
+        pending[i] = NULL;
+    }
     ackId = -1;
+    timedOut = false;
+    deadline = 0;
+    rto = INITIAL_RTO;
+    srtt = -1;
+    rttvar = 0;
+    timing = false;
+    dupAcks = 0;
+    fastRetransmit = false;
+    address = 0;
+    nextConn = NULL;
+    peer = 0;
+    peerBox = -1;
 }
 
 //----------------------------------------------------------------------
@@ -94,7 +67,23 @@ MailBox::MailBox()
 //	in the mailbox.
 //----------------------------------------------------------------------
 
-MailBox::~MailBox() { delete messages; }
+MailBox::~MailBox()
+{
+    for(int i = 0; i < MAXWINDOW; i++)
+    {
+        if(pending[i] != NULL)
+        {
+            packetPool->Free(pending[i]);
+        }
+    }
+    while(Drop())
+    {
+    }
+    delete lock;
+    delete messageArrived;
+    delete ackLock;
+    delete ackCond;
+}
 
 //----------------------------------------------------------------------
 // PrintHeader
@@ -116,21 +105,20 @@ static void PrintHeader(PacketHeader pktHdr, MailHeader mailHdr)
 // 	Add a message to the mailbox.  If anyone is waiting for message
 //	arrival, wake them up!
 //
-//	We need to reconstruct the Mail message (by concatenating the headers
-//	to the data), to simplify queueing the message on the SynchList.
+//	The packet itself is queued, as it came from the network: the
+//	mailbox owns it until MailBox::Get copies its data out.
 //
-//	"pktHdr" -- source, destination machine ID's
-//	"mailHdr" -- source, destination mailbox ID's
-//	"data" -- payload message data
+//	"pkt" -- the packet, with its PacketHeader and MailHeader
 //----------------------------------------------------------------------
 
-void MailBox::Put(Payload *p, char *data)
+void MailBox::Put(Packet *pkt)
 {
-    Mail *mail = new Mail(p, data);
-
-    messages->Append((void *)mail); // put on the end of the list of
-                                    // arrived messages, and wake up
-                                    // any waiters
+    lock->Acquire();
+    messages.Append(pkt); // put on the end of the list of
+                          // arrived messages, and wake up
+                          // any waiters
+    messageArrived->Signal(lock);
+    lock->Release();
 }
 
 //----------------------------------------------------------------------
@@ -139,51 +127,220 @@ void MailBox::Put(Payload *p, char *data)
 //	mailbox header, and data.
 //
 //	The calling thread waits if there are no messages in the mailbox.
+//	The data is copied once, from the packet into its place in the
+//	caller's buffer, and the packet goes back to the pool.
 //
-//	"pktHdr" -- address to put: source, destination machine ID's
-//	"mailHdr" -- address to put: source, destination mailbox ID's
+//	"p" -- address to put: source, destination machine and mailbox ID's
+//	"segmentIndex" -- index of the segment in the message
 //	"data" -- address to put: payload message data
 //----------------------------------------------------------------------
 
 bool MailBox::Get(Payload *p, int segmentIndex, char *data)
 {
     DEBUG('p', "Waiting for mail in mailbox\n");
-    Mail *mail = (Mail *)messages->Remove(); // remove message from list;
-                                             // will wait if list is empty
-    if(mail == NULL)
+    lock->Acquire();
+    while(messages.IsEmpty())
     {
-        return false;
+        messageArrived->Wait(lock);
     }
+    Packet *pkt = messages.Remove();
+    lock->Release();
+
+    PacketHeader *pktHdr = pkt->Header();
+    MailHeader *mailHdr = (MailHeader *)pkt->Data();
+    char *segment = pkt->Data() + sizeof(MailHeader);
+
     // Update the payload from the received mail
-    p->UpdatePayload(mail->pktHdr.from, mail->pktHdr.to, mail->mailHdr.from, mail->mailHdr.to,
-                     mail->mailHdr.length, mail->mailHdr.messageType);
-    p->mailHdr.messageId = mail->mailHdr.messageId;
+    p->UpdatePayload(pktHdr->from, pktHdr->to, mailHdr->from, mailHdr->to, mailHdr->length,
+                     mailHdr->messageType);
+    p->mailHdr.messageId = mailHdr->messageId;
     // if we are dealing with the last segment of the message
     // then copy only the remaining characters into data
     if(segmentIndex == p->nbSegments - 1)
     {
-        bcopy(mail->data, data, p->remainder);
+        bcopy(segment, data, p->remainder);
     }
     else
     {
         // otherwise copy a whole segment
-        bcopy(mail->data, data, MaxSegmentSize);
+        bcopy(segment, data, MaxSegmentSize);
     }
 
     if(DebugIsEnabled('p'))
     {
         DEBUG('p', "Got mail from mailbox: ");
         PrintHeader(p->pktHdr, p->mailHdr);
-        DEBUG('p', "[Machine %d] Got segment %d (%s) from machine %d, box %d\n", p->pktHdr.to,
-              segmentIndex, mail->data, p->pktHdr.from, p->mailHdr.from);
+        DEBUG('p', "[Machine %d] Got segment %d from machine %d, box %d\n", p->pktHdr.to,
+              segmentIndex, p->pktHdr.from, p->mailHdr.from);
+    }
+    packetPool->Free(pkt); // we've copied out the stuff we
+                           // need, we can now discard the message
+    return true;
+}
+
+//----------------------------------------------------------------------
+// MailBox::Drop
+// 	Throw away the first message of the mailbox, without waiting.
+//	Return false if the mailbox was empty.
+//----------------------------------------------------------------------
+
+bool MailBox::Drop()
+{
+    lock->Acquire();
+    Packet *pkt = messages.Remove();
+    lock->Release();
+
+    if(pkt == NULL)
+    {
+        return false;
     }
-    // copy the message data into
-    // the caller's buffer
-    delete mail; // we've copied out the stuff we
-                 // need, we can now discard the message
+    packetPool->Free(pkt);
     return true;
 }
 
+//----------------------------------------------------------------------
+// MailBox::Deliver
+// 	Put a DATA segment into the mailbox in the order of the ids.
+//
+//	The sender has up to a window of segments in flight, so a segment
+//	may arrive while one before it was lost and is being retransmitted.
+//	Such a segment is kept aside, as long as it is less than MAXWINDOW
+//	ahead; once the missing one arrives, the segments that follow it
+//	are put as well.  Segments already put are duplicates: their ACK
+//	was lost, and they are dropped.
+//
+//	Return true if the segment was the one expected, false if it was
+//	kept aside or dropped.
+//
+//	"pkt" -- the segment; the mailbox owns it from now on
+//----------------------------------------------------------------------
+
+bool MailBox::Deliver(Packet *pkt)
+{
+    int id = ((MailHeader *)pkt->Data())->messageId;
+    int slot = id % MAXWINDOW;
+
+    if(id == waitedId)
+    {
+        Put(pkt);
+        waitedId++;
+        // the segments received ahead can now follow
+        slot = waitedId % MAXWINDOW;
+        while(pending[slot] != NULL &&
+              ((MailHeader *)pending[slot]->Data())->messageId == waitedId)
+        {
+            Put(pending[slot]);
+            pending[slot] = NULL;
+            waitedId++;
+            slot = waitedId % MAXWINDOW;
+        }
+        return true;
+    }
+    else if(id > waitedId && id < waitedId + MAXWINDOW)
+    {
+        // ids of the window map to distinct slots, so a different
+        // segment in the slot is an old one, already put
+        if(pending[slot] == NULL || ((MailHeader *)pending[slot]->Data())->messageId != id)
+        {
+            DEBUG('p', "Segment %d kept until segment %d arrives\n", id, waitedId);
+            if(pending[slot] != NULL)
+            {
+                packetPool->Free(pending[slot]);
+            }
+            pending[slot] = pkt;
+            return false;
+        }
+    }
+    else
+    {
+        DEBUG('p', "Segment %d dropped, waiting for segment %d\n", id, waitedId);
+    }
+    packetPool->Free(pkt);
+    return false;
+}
+
+//----------------------------------------------------------------------
+// MailBox::Reset
+// 	Prepare the mailbox for a new connection: forget the segments
+//	kept aside and the ACKs of the previous one.
+//
+//	"firstId" -- id of the first segment the peer will send
+//----------------------------------------------------------------------
+
+void MailBox::Reset(int firstId)
+{
+    for(int i = 0; i < MAXWINDOW; i++)
+    {
+        if(pending[i] != NULL)
+        {
+            packetPool->Free(pending[i]);
+            pending[i] = NULL;
+        }
+    }
+    waitedId = firstId;
+    ackLock->Acquire();
+    ackId = -1;
+    timedOut = false;
+    deadline = 0;
+    rto = INITIAL_RTO;
+    srtt = -1;
+    rttvar = 0;
+    timing = false;
+    dupAcks = 0;
+    fastRetransmit = false;
+    ackLock->Release();
+}
+
+//----------------------------------------------------------------------
+// MailBox::SampleRtt
+// 	Update the retransmission timeout with a new measure of the round
+//	trip time, as TCP does (RFC 6298): the timeout is the smoothed
+//	round trip time, plus four times its mean deviation.  Called with
+//	"ackLock" held.
+//
+//	"rtt" -- ticks between the sending of a segment and its ACK
+//----------------------------------------------------------------------
+
+void MailBox::SampleRtt(int rtt)
+{
+    if(srtt < 0)
+    {
+        srtt = rtt;
+        rttvar = rtt / 2;
+    }
+    else
+    {
+        int delta = (srtt > rtt) ? srtt - rtt : rtt - srtt;
+        rttvar = (3 * rttvar + delta) / 4;
+        srtt = (7 * srtt + rtt) / 8;
+    }
+    // the timer only checks the deadlines every TimerTicks
+    rto = srtt + ((4 * rttvar > TimerTicks) ? 4 * rttvar : TimerTicks);
+    if(rto < MIN_RTO)
+    {
+        rto = MIN_RTO;
+    }
+    else if(rto > MAX_RTO)
+    {
+        rto = MAX_RTO;
+    }
+    DEBUG('p', "RTT %d, srtt %d, rttvar %d, rto %d\n", rtt, srtt, rttvar, rto);
+}
+
+//----------------------------------------------------------------------
+// MailBox::BackOff
+// 	Double the retransmission timeout after it expired, up to MAX_RTO.
+//	The segment being timed will be sent again, so its ACK could be
+//	the ACK of either copy: it is not measured (Karn's algorithm).
+//	Called with "ackLock" held.
+//----------------------------------------------------------------------
+
+void MailBox::BackOff()
+{
+    rto = (rto < MAX_RTO / 2) ? rto * 2 : MAX_RTO;
+    timing = false;
+}
+
 //----------------------------------------------------------------------
 // PostalHelper, ReadAvail, WriteDone
 // 	Dummy functions because C++ can't indirectly invoke member functions
@@ -208,6 +365,21 @@ static void WriteDone(int arg)
     PostOffice *po = (PostOffice *)arg;
     po->PacketSent();
 }
+static void RetransmitTimer(int arg)
+{
+    PostOffice *po = (PostOffice *)arg;
+    po->TimerExpired();
+}
+static void TimeoutHelper(int arg)
+{
+    PostOffice *po = (PostOffice *)arg;
+    po->CheckTimeouts();
+}
+static void TransmitHelper(int arg)
+{
+    PostOffice *po = (PostOffice *)arg;
+    po->Transmit();
+}
 
 //----------------------------------------------------------------------
 // PostOffice::PostOffice
@@ -218,7 +390,11 @@ static void WriteDone(int arg)
 //      We use a separate thread "the postal worker" to wait for messages
 //	to arrive, and deliver them to the correct mailbox.  Note that
 //	delivering messages to the mailboxes can't be done directly
-//	by the interrupt handlers, because it requires a Lock.
+//	by the interrupt handlers, because it requires a Lock.  For the
+//	same reason, a second thread wakes up the senders whose
+//	retransmission timeout expired.  A third one, the transmitter, is
+//	the only one to send packets: the others queue them, without
+//	waiting for the network.
 //
 //	"addr" is this machine's network ID
 //	"reliability" is the probability that a network packet will
@@ -226,20 +402,38 @@ static void WriteDone(int arg)
 //	  drops any packets; reliability = 0 means the network never
 //	  delivers any packets)
 //	"nBoxes" is the number of mail boxes in this Post Office
+//	"sendWindow" is the number of segments of a payload that can be
+//	  in flight, not acknowledged yet
 //----------------------------------------------------------------------
 
-PostOffice::PostOffice(NetworkAddress addr, double reliability, int nBoxes)
+PostOffice::PostOffice(NetworkAddress addr, double reliability, int nBoxes, int sendWindow)
 {
     // First, initialize the synchronization with the interrupt handlers
     messageAvailable = new Semaphore("message available", 0);
     messageSent = new Semaphore("message sent", 0);
-    sendLock = new Lock("message send lock");
+    queueLock = new Lock("transmit queue lock");
+    queueReady = new Condition("transmit queue cond");
+    timerWakeup = new Semaphore("retransmit timer", 0);
+    timerPending = false;
+    lastDisconnectTick = 0;
+    SetWindow(sendWindow);
+    netReliability = reliability;
     // Second, initialize the mailboxes
     netAddr = addr;
     numBoxes = nBoxes;
     boxes = new MailBox[nBoxes];
-    usedBoxes = new BitMap(numBoxes);
-    usedBoxes->Mark(LISTEN_BOX);
+    for(int i = 0; i < nBoxes; i++)
+    {
+        boxes[i].address = i;
+    }
+    ASSERT(nBoxes <= FIRST_CONN_ID);
+    for(int i = 0; i < CONN_BUCKETS; i++)
+    {
+        reminders[i] = NULL;
+        connTable[i] = NULL;
+    }
+    numConns = 0;
+    nextConnId = FIRST_CONN_ID;
     connLock = new Lock("conn lock");
     disconnectCond = new Condition("disconnect cond");
     disconnectLock = new Lock("disonnect lock");
@@ -249,9 +443,14 @@ PostOffice::PostOffice(NetworkAddress addr, double reliability, int nBoxes)
     // Finally, create a thread whose sole job is to wait for incoming messages,
     //   and put them in the right mailbox.
     Thread *t = new Thread("postal worker");
-    BroadcastTimer = new Timer(NetworkSendWaitHandler, 0, false);
-
     t->Fork(PostalHelper, (int)this);
+
+    t = new Thread("transmitter");
+    t->Fork(TransmitHelper, (int)this);
+
+    t = new Thread("retransmit timer");
+    t->Fork(TimeoutHelper, (int)this);
+    BroadcastTimer = new Timer(RetransmitTimer, (int)this, false);
 }
 
 //----------------------------------------------------------------------
@@ -263,9 +462,27 @@ PostOffice::~PostOffice()
 {
     delete network;
     delete[] boxes;
+    for(int i = 0; i < CONN_BUCKETS; i++)
+    {
+        while(connTable[i] != NULL)
+        {
+            MailBox *box = connTable[i];
+            connTable[i] = box->nextConn;
+            delete box;
+        }
+        while(reminders[i] != NULL)
+        {
+            ConnReminder *r = reminders[i];
+            reminders[i] = r->next;
+            delete r;
+        }
+    }
+    delete connLock;
     delete messageAvailable;
     delete messageSent;
-    delete sendLock;
+    delete queueLock;
+    delete queueReady;
+    delete timerWakeup;
     delete BroadcastTimer;
 }
 
@@ -273,79 +490,96 @@ PostOffice::~PostOffice()
 // PostOffice::PostalDelivery
 // 	Wait for incoming messages, and put them in the right mailbox.
 //
-//      Incoming messages have had the PacketHeader stripped off,
-//	but the MailHeader is still tacked on the front of the data.
+//      Incoming packets are passed on as they came from the network,
+//	with the PacketHeader and the MailHeader in front of the data:
+//	nothing is allocated nor copied for them here.  Each packet ends
+//	up in a mailbox, or back in the pool.
 //----------------------------------------------------------------------
 
 void PostOffice::PostalDelivery()
 {
     PacketHeader pktHdr;
     MailHeader mailHdr;
-    Payload *p;
-    char *buffer = new char[MaxPacketSize];
+    Packet *pkt;
+    bool inOrder;
+    int waitedId;
 
     for(;;)
     {
+        inOrder = false;
         // first, wait for a message
         messageAvailable->P();
-        pktHdr = network->Receive(buffer);
+        pkt = network->Receive();
+        ASSERT(pkt != NULL);
 
-        mailHdr = *(MailHeader *)buffer;
+        // keep the headers, the packet may be handed over to a mailbox
+        pktHdr = *pkt->Header();
+        mailHdr = *(MailHeader *)pkt->Data();
         if(DebugIsEnabled('p'))
         {
             DEBUG('p', "Putting mail into mailbox: ");
             PrintHeader(pktHdr, mailHdr);
         }
-        // check that arriving message is legal!
-        ASSERT(0 <= mailHdr.to && mailHdr.to < numBoxes);
-        p = new Payload(pktHdr.from, pktHdr.to, mailHdr.from, mailHdr.to, mailHdr.length,
-                        mailHdr.messageType);
-        p->mailHdr.messageId = mailHdr.messageId;
+        // check that arriving message is legal!  The mailbox can't be
+        // freed by a closing connection until it is released
+        MailBox *box = HoldBox(mailHdr.to);
+        if(box == NULL)
+        {
+            // a connection closed since: nothing to deliver, nor to ACK
+            DEBUG('p', "[machine %d] message for unknown box %d dropped\n", GetNetAddr(),
+                  mailHdr.to);
+            packetPool->Free(pkt);
+            continue;
+        }
         if(mailHdr.messageType == CONN && mailHdr.to == LISTEN_BOX)
         {
-            ConnReminder *cRm = new ConnReminder;
-            cRm->connTimestamp = *(time_t *)(buffer + sizeof(MailHeader));
-            cRm->netFrom = pktHdr.from;
-            cRm->netTo = pktHdr.to;
-            cRm->mailFrom = mailHdr.from;
-            cRm->mailTo = mailHdr.to;
-            if(ValidConn(cRm))
-            {
-
-                DEBUG('p', "[machine %d] receive CONN message from machine ID %d\n", GetNetAddr(),
-                      pktHdr.from);
-                boxes[mailHdr.to].Put(p, buffer + sizeof(MailHeader));
-            }
-            else
-            {
-                DEBUG('p', "[machine %d] receive invalid CONN message from machine ID %d\n",
-                      GetNetAddr(), pktHdr.from);
-                delete cRm;
-            }
+            AcceptConn(pkt);
         }
-        else if(mailHdr.messageType == DATA && mailHdr.messageId == boxes[mailHdr.to].waitedId)
+        else if(mailHdr.messageType == DATA)
         {
-            // put into mailbox
+            // put into mailbox, in order
             DEBUG('p', "[machine %d] receive DATA message with ID %d\n", GetNetAddr(),
                   mailHdr.messageId);
-            boxes[mailHdr.to].Put(p, buffer + sizeof(MailHeader));
-            boxes[mailHdr.to].waitedId++;
-            delete p;
+            inOrder = box->Deliver(pkt);
         }
         else if(mailHdr.messageType == ACK)
         {
-            boxes[mailHdr.to].ackLock->Acquire();
-            boxes[mailHdr.to].ackId = mailHdr.messageId;
+            box->ackLock->Acquire();
+            // ACKs are cumulative: a late one says less than the last
+            if(mailHdr.messageId > box->ackId)
+            {
+                box->ackId = mailHdr.messageId;
+                box->dupAcks = 0;
+                if(box->timing && mailHdr.messageId >= box->timedId)
+                {
+                    box->timing = false;
+                    box->SampleRtt(stats->totalTicks - box->timedTick);
+                }
+            }
+            else if(mailHdr.messageId == box->ackId)
+            {
+                // a segment arrived, but not the one the receiver waits
+                // for: that one was probably lost
+                box->dupAcks++;
+                if(box->dupAcks == DUPACKS)
+                {
+                    box->fastRetransmit = true;
+                }
+            }
             DEBUG('p', "[machine %d] receive ACK message with ID %d\n", GetNetAddr(),
                   mailHdr.messageId);
-            boxes[mailHdr.to].ackCond->Broadcast(boxes[mailHdr.to].ackLock);
-            boxes[mailHdr.to].ackLock->Release();
+            box->ackCond->Broadcast(box->ackLock);
+            box->ackLock->Release();
+            packetPool->Free(pkt);
         }
         else
         {
             DEBUG('p', "[machine %d] receive message with invalid ID: %d instead of %d\n",
-                  GetNetAddr(), mailHdr.messageId, boxes[mailHdr.to].waitedId);
+                  GetNetAddr(), mailHdr.messageId, box->waitedId);
+            packetPool->Free(pkt);
         }
+        waitedId = box->waitedId;
+        ReleaseBox(mailHdr.to);
         if(mailHdr.messageType != ACK)
         {
             PacketHeader ackPktHdr;
@@ -356,16 +590,54 @@ void PostOffice::PostalDelivery()
             ackMailHdr.from = mailHdr.to;
             ackMailHdr.to = mailHdr.from;
             ackMailHdr.messageType = ACK;
-            ackMailHdr.messageId = mailHdr.messageId;
+            // acknowledge every DATA segment received in order so far
+            if(mailHdr.messageType == DATA)
+            {
+                ackMailHdr.messageId = waitedId - 1;
+            }
+            else
+            {
+                ackMailHdr.messageId = mailHdr.messageId;
+            }
             ackMailHdr.length = 0;
             DEBUG('p', "[machine %d] DATA received, send ACK %d\n", GetNetAddr(),
                   ackMailHdr.messageId);
-            sendLock->Acquire();
-            network->Send(ackPktHdr, (char *)&ackMailHdr);
-            messageSent->P();
-            sendLock->Release();
+            // a duplicate ACK tells the sender a segment is missing: it
+            // must not be merged with the others
+            QueueAck(ackPktHdr, ackMailHdr, inOrder);
         }
-        // de-allocate the Payload
+    }
+}
+
+//----------------------------------------------------------------------
+// PostOffice::AcceptConn
+// 	Put a CONN message into the listening mailbox, unless it is a
+//	duplicate of a connection already made; it is thrown away then.
+//----------------------------------------------------------------------
+
+void PostOffice::AcceptConn(Packet *pkt)
+{
+    PacketHeader *pktHdr = pkt->Header();
+    MailHeader *mailHdr = (MailHeader *)pkt->Data();
+    ConnReminder *cRm = new ConnReminder;
+
+    cRm->connTimestamp = *(time_t *)(pkt->Data() + sizeof(MailHeader));
+    cRm->netFrom = pktHdr->from;
+    cRm->netTo = pktHdr->to;
+    cRm->mailFrom = mailHdr->from;
+    cRm->mailTo = mailHdr->to;
+    if(ValidConn(cRm))
+    {
+        DEBUG('p', "[machine %d] receive CONN message from machine ID %d\n", GetNetAddr(),
+              pktHdr->from);
+        boxes[mailHdr->to].Put(pkt);
+    }
+    else
+    {
+        DEBUG('p', "[machine %d] receive invalid CONN message from machine ID %d\n",
+              GetNetAddr(), pktHdr->from);
+        delete cRm;
+        packetPool->Free(pkt);
     }
 }
 
@@ -380,8 +652,8 @@ void PostOffice::IncomingPacket() { messageAvailable->V(); }
 
 //----------------------------------------------------------------------
 // PostOffice::PacketSent
-// 	Interrupt handler, called when the next packet can be put onto the
-//	network.
+// 	Interrupt handler, called when the next batch of packets can be put
+//	onto the network.
 //
 //	The name of this routine is a misnomer; if "reliability < 1",
 //	the packet could have been dropped by the network, so it won't get
@@ -390,8 +662,180 @@ void PostOffice::IncomingPacket() { messageAvailable->V(); }
 
 void PostOffice::PacketSent() { messageSent->V(); }
 
+//----------------------------------------------------------------------
+// PostOffice::QueueAck
+// 	Queue an ACK for the transmitter, ahead of the segments.
+//
+//	ACKs of segments received in order are cumulative: if one for the
+//	same mailboxes is still queued, it is updated to acknowledge the
+//	new segment as well, and a single ACK goes out.  ACKs are thus
+//	delayed and merged while the transmitter is busy.
+//
+//	"pktHdr" -- source, destination machine ID's
+//	"mailHdr" -- source, destination mailbox ID's, and the id acknowledged
+//	"cumulative" -- the segment acknowledged arrived in order
+//----------------------------------------------------------------------
+
+void PostOffice::QueueAck(PacketHeader pktHdr, MailHeader mailHdr, bool cumulative)
+{
+    queueLock->Acquire();
+    if(cumulative)
+    {
+        for(Packet *ack = ackQueue.First(); ack != NULL; ack = ack->next)
+        {
+            MailHeader *queued = (MailHeader *)ack->Data();
+            if(ack->tag && ack->Header()->to == pktHdr.to && queued->to == mailHdr.to &&
+               queued->from == mailHdr.from)
+            {
+                DEBUG('p', "[machine %d] ACK %d replaced by ACK %d\n", GetNetAddr(),
+                      queued->messageId, mailHdr.messageId);
+                queued->messageId = mailHdr.messageId;
+                queueLock->Release();
+                return;
+            }
+        }
+    }
+    Packet *pkt = packetPool->Alloc();
+    *pkt->Header() = pktHdr;
+    *(MailHeader *)pkt->Data() = mailHdr;
+    pkt->tag = cumulative; // this ACK can be replaced
+    ackQueue.Append(pkt);
+    queueReady->Signal(queueLock);
+    queueLock->Release();
+}
+
+//----------------------------------------------------------------------
+// PostOffice::Transmit
+// 	Loop forever, sending the queued packets in batches of at most
+//	SendBatch, and waiting for the network after each batch.  ACKs go
+//	first: the senders of the other machines are waiting for them.
+//	The packets go back to the pool once sent.
+//----------------------------------------------------------------------
+
+void PostOffice::Transmit()
+{
+    Packet *batch[SendBatch];
+    int count;
+
+    for(;;)
+    {
+        queueLock->Acquire();
+        while(ackQueue.IsEmpty() && dataQueue.IsEmpty())
+        {
+            queueReady->Wait(queueLock);
+        }
+        count = 0;
+        while(count < SendBatch && !ackQueue.IsEmpty())
+        {
+            batch[count++] = ackQueue.Remove();
+        }
+        while(count < SendBatch && !dataQueue.IsEmpty())
+        {
+            batch[count++] = dataQueue.Remove();
+        }
+        queueLock->Release();
+
+        network->SendMany(batch, count);
+        messageSent->P();
+        for(int i = 0; i < count; i++)
+        {
+            packetPool->Free(batch[i]);
+        }
+    }
+}
+
+//----------------------------------------------------------------------
+// PostOffice::TimerExpired
+// 	Interrupt handler, called on each tick of the timer.
+//
+//	Wake up CheckTimeouts when the retransmission timeout of a mailbox
+//	expired, or when it is time to signal the disconnections.  The
+//	handler cannot take the locks of the mailboxes itself.
+//
+//	Only the mailboxes of the running senders have a timer: the cost
+//	does not grow with the number of connections.
+//----------------------------------------------------------------------
+
+void PostOffice::TimerExpired()
+{
+    int now = stats->totalTicks;
+    bool expired = (now - lastDisconnectTick > DISCONNECT_TEMPO);
+
+    if(timerPending)
+    {
+        return;
+    }
+    for(std::list<MailBox *>::iterator it = senders.begin(); it != senders.end() && !expired;
+        ++it)
+    {
+        expired = ((*it)->deadline != 0 && now >= (*it)->deadline);
+    }
+    if(expired)
+    {
+        timerPending = true;
+        timerWakeup->V();
+    }
+}
+
+//----------------------------------------------------------------------
+// PostOffice::CheckTimeouts
+// 	Loop forever, waiting for TimerExpired; then wake up the senders
+//	whose retransmission timeout expired, and signal the threads
+//	waiting for a connection to close every DISCONNECT_TEMPO ticks.
+//----------------------------------------------------------------------
+
+void PostOffice::CheckTimeouts()
+{
+    for(;;)
+    {
+        timerWakeup->P();
+        int now = stats->totalTicks;
+
+        // the senders may come and go while we wait for their locks
+        IntStatus oldLevel = interrupt->SetLevel(IntOff);
+        std::list<MailBox *> running(senders);
+        (void)interrupt->SetLevel(oldLevel);
+
+        for(std::list<MailBox *>::iterator it = running.begin(); it != running.end(); ++it)
+        {
+            MailBox *box = *it;
+
+            box->ackLock->Acquire();
+            if(box->deadline != 0 && now >= box->deadline)
+            {
+                DEBUG('p', "[machine %d] Timeout of box %d after %d ticks\n", GetNetAddr(),
+                      box->address, box->rto);
+                box->deadline = 0;
+                box->timedOut = true;
+                box->ackCond->Broadcast(box->ackLock);
+            }
+            box->ackLock->Release();
+        }
+        if(now - lastDisconnectTick > DISCONNECT_TEMPO)
+        {
+            lastDisconnectTick = now;
+            disconnectLock->Acquire();
+            disconnectCond->Signal(disconnectLock);
+            disconnectLock->Release();
+        }
+        timerPending = false;
+    }
+}
+
 NetworkAddress PostOffice::GetNetAddr() { return netAddr; }
 
+//----------------------------------------------------------------------
+// PostOffice::SetWindow
+// 	Set the number of segments of a payload that can be sent before
+//	the first of them is acknowledged; 1 is stop-and-wait.
+//----------------------------------------------------------------------
+
+void PostOffice::SetWindow(int sendWindow)
+{
+    ASSERT(sendWindow >= 1 && sendWindow <= MAXWINDOW);
+    window = sendWindow;
+}
+
 // Initialize a payload without data, to default zero values (because lengths are unsigned)
 Payload::Payload()
 {
@@ -448,19 +892,15 @@ void Payload::UpdatePayload(NetworkAddress netFrom,
                             unsigned int length,
                             MessageType messageType)
 {
+    int segmentSize = MaxSegmentSize; // follows the wire size
+
     // size of the whole message
     msgSize = length;
-    // compute the amount of characters remaining in the last segment, if any
-    remainder = msgSize % MaxSegmentSize;
     // compute the number of segments of size MaxSegmentSize required for the whole message
-    if(remainder == 0)
-    {
-        nbSegments = msgSize / MaxSegmentSize;
-    }
-    else
-    {
-        nbSegments = msgSize / MaxSegmentSize + 1;
-    }
+    nbSegments = (msgSize + segmentSize - 1) / segmentSize;
+    // compute the amount of characters in the last segment: a whole
+    // segment if the size of the message is a multiple of it
+    remainder = (nbSegments == 0) ? 0 : msgSize - (nbSegments - 1) * segmentSize;
     // set the source machine (source machine and length of packet are set in SendPayload)
     pktHdr.from = netFrom;
     // set the destination machine (source machine and length of packet are set in SendPayload)
@@ -476,147 +916,330 @@ void Payload::UpdatePayload(NetworkAddress netFrom,
     mailHdr.messageType = messageType;
 }
 
-bool PostOffice::ReliableSendSegment(Payload *p, char *data)
+//----------------------------------------------------------------------
+// PostOffice::BuildSegment
+// 	Build the segment "segIndex" of a payload: its MailHeader, with the
+//	id of the segment, followed by its part of the data.  The data is
+//	copied once, into a packet of the pool, right behind the headers.
+//
+//	"p" -- the headers of the payload, with the id of its first segment
+//	"data" -- the whole message data
+//----------------------------------------------------------------------
+
+Packet *PostOffice::BuildSegment(Payload *p, const char *data, int segIndex)
 {
-    int nReemissions = 0;
-    int sentId = p->mailHdr.messageId;
-    while(nReemissions < MAXREEMISSIONS)
+    Packet *pkt = packetPool->Alloc();
+    MailHeader *mailHdr = (MailHeader *)pkt->Data();
+
+    // if we are dealing with the last segment of a message
+    // then only write the remaining characters, otherwise a whole segment
+    int size = (segIndex == p->nbSegments - 1) ? p->remainder : (int)MaxSegmentSize;
+
+    *pkt->Header() = p->pktHdr;
+    // only the bytes of this segment go out on the wire
+    pkt->Header()->length = sizeof(MailHeader) + size;
+    // write MailHeader first, before the data
+    *mailHdr = p->mailHdr;
+    mailHdr->messageId += segIndex;
+    bcopy(data + segIndex * MaxSegmentSize, pkt->Data() + sizeof(MailHeader), size);
+    DEBUG('p', "[Machine %d] Sent segment %d to machine %d, box %d, messageId %d\n",
+          p->pktHdr.from, segIndex, p->pktHdr.to, p->mailHdr.to, mailHdr->messageId);
+    return pkt;
+}
+
+//----------------------------------------------------------------------
+// PostOffice::QueueSegments
+// 	Hand segments over to the transmitter, all at once, so that they
+//	can go out in the same batch.  "segments" is left empty.
+//----------------------------------------------------------------------
+
+void PostOffice::QueueSegments(PacketQueue *segments)
+{
+    Packet *pkt;
+
+    queueLock->Acquire();
+    while((pkt = segments->Remove()) != NULL)
     {
-        boxes[p->mailHdr.from].ackLock->Acquire();
-        sendLock->Acquire();
-        network->Send(p->pktHdr, data);
-        messageSent->P();
-        sendLock->Release();
-        DEBUG('p', "[machine %d] Emission %d in machine %d in box %d with messageId %d\n",
-              GetNetAddr(), nReemissions, p->pktHdr.to, p->mailHdr.to, p->mailHdr.messageId);
+        dataQueue.Append(pkt);
+    }
+    queueReady->Signal(queueLock);
+    queueLock->Release();
+}
+
+//----------------------------------------------------------------------
+// PostOffice::SendSegment
+// 	Queue the segment "segIndex" of a payload, to be sent once.
+//----------------------------------------------------------------------
+
+void PostOffice::SendSegment(Payload *p, const char *data, int segIndex)
+{
+    PacketQueue segment;
 
-        boxes[p->mailHdr.from].ackCond->Wait(boxes[p->mailHdr.from].ackLock);
-        int ackId = boxes[p->mailHdr.from].ackId;
-        boxes[p->mailHdr.from].ackLock->Release();
+    segment.Append(BuildSegment(p, data, segIndex));
+    QueueSegments(&segment);
+}
+
+//----------------------------------------------------------------------
+// PostOffice::LoopbackPayload
+// 	Deliver a message sent by this machine to itself: its segments are
+//	put straight into the destination mailbox, in order, without going
+//	through the transmitter, the network nor PostalDelivery.  Nothing
+//	can be lost on the way, so there is no ACK, no window and no
+//	retransmission.
+//
+//	The message is still split into segments, as a mailbox holds
+//	packets of the pool, and ReceivePayload gets one at a time.
+//
+//	"p" -- the headers of the payload; its messageId is advanced past
+//	  the segments delivered
+//	"data" -- the message data
+//----------------------------------------------------------------------
 
-        if(ackId == sentId)
+bool PostOffice::LoopbackPayload(Payload *p, const char *data)
+{
+    MailBox *box = HoldBox(p->mailHdr.to);
+
+    if(box == NULL)
+    {
+        return false;
+    }
+
+    DEBUG('p', "[machine %d] Loopback delivery of %d segments to box %d\n", GetNetAddr(),
+          p->nbSegments, p->mailHdr.to);
+    for(int segIndex = 0; segIndex < p->nbSegments; segIndex++)
+    {
+        Packet *pkt = BuildSegment(p, data, segIndex);
+
+        if(p->mailHdr.messageType == CONN && p->mailHdr.to == LISTEN_BOX)
         {
-            DEBUG('p', "[machine %d] ACK received\n", GetNetAddr());
-            return true;
+            AcceptConn(pkt);
         }
-        else if(ackId != -1)
+        else
         {
-            DEBUG('p', "[machine %d] Received invalid ACK(ignored) %d instead of %d\n ",
-                  GetNetAddr(), ackId, sentId);
+            // the segments arrive in order: the receiver now waits for
+            // the one after them
+            box->Put(pkt);
+            box->waitedId = p->mailHdr.messageId + segIndex + 1;
         }
-
-        DEBUG('p', "[machine %d] NO ACK received, reemission\n", GetNetAddr());
-        nReemissions++;
     }
-
-    return false;
+    ReleaseBox(p->mailHdr.to);
+    p->mailHdr.messageId += p->nbSegments;
+    stats->numLoopbackMessages++;
+    return true;
 }
 
+//----------------------------------------------------------------------
+// PostOffice::SendPayload
+// 	Send a message reliably, split into segments.
+//
+//	Up to "window" segments are sent without waiting for their ACK.
+//	ACKs are cumulative, so each one that arrives slides the window
+//	past every segment it covers, and the next ones are sent.
+//
+//	A segment is retransmitted in two cases:
+//	  - DUPACKS duplicate ACKs arrived: the segments after the oldest
+//	    unacknowledged one arrive, but not that one, which is resent
+//	    at once (fast retransmit);
+//	  - the retransmission timeout of the mailbox expired without any
+//	    progress: the segments are sent again from the oldest one not
+//	    acknowledged (go-back-N), and the timeout is doubled.
+//	The timeout follows the round trip times measured on the mailbox
+//	(see MailBox::SampleRtt).
+//
+//	Return false if the receiver did not answer after MAXREEMISSIONS
+//	timeouts in a row.
+//
+//	A message to this machine does not go through the network at all
+//	(see LoopbackPayload).
+//
+//	"p" -- the headers of the payload; its messageId is advanced past
+//	  the segments sent
+//	"data" -- the message data
+//----------------------------------------------------------------------
+
 bool PostOffice::SendPayload(Payload *p, const char *data)
 {
-    char *buffer = new char[MaxPacketSize]; // space to hold concatenated
-                                            // mailHdr + data
+    MailBox *box = FindBox(p->mailHdr.from);
+    int first = p->mailHdr.messageId;       // id of the first segment
+    int base = 0;                           // oldest segment not ACKed
+    int next = 0;                           // next segment to send
+    int sent = 0;                           // segments sent at least once
+    int nTimeouts = 0;
 
     if(DebugIsEnabled('p'))
     {
         DEBUG('p', "Post send: ");
         PrintHeader(p->pktHdr, p->mailHdr);
     }
-    ASSERT(0 <= p->mailHdr.to && p->mailHdr.to < numBoxes);
+    ASSERT(box != NULL);
+    ASSERT((0 <= p->mailHdr.to && p->mailHdr.to < numBoxes) || p->mailHdr.to >= FIRST_CONN_ID);
 
     // fill in pktHdr, for the Network layer
     ASSERT(p->pktHdr.from == netAddr);
     ASSERT(p->pktHdr.length == MaxSegmentSize + sizeof(MailHeader));
 
-    // split the message into segments
-    for(int segIndex = 0; segIndex < p->nbSegments; segIndex++)
+    if(p->pktHdr.to == netAddr)
+    {
+        return LoopbackPayload(p, data);
+    }
+
+    box->ackLock->Acquire();
+    box->timedOut = false;
+    box->fastRetransmit = false;
+    box->dupAcks = 0;
+    box->ackLock->Release();
+    StartSending(box);
+
+    while(base < p->nbSegments)
     {
-        // reset the buffer before the upcoming iteration
-        bzero(buffer, MaxPacketSize);
-        // write MailHeader first, before the data
-        bcopy(&(p->mailHdr), buffer, sizeof(MailHeader));
-        // if we are dealing with the last segment of a message
-        // then only write the remaining characters into buffer
-        if(segIndex == p->nbSegments - 1)
+        // fill the window; the segments are queued together, to go out
+        // in as few batches as possible
+        PacketQueue burst;
+        while(next < p->nbSegments && next < base + window)
         {
-            bcopy(data + segIndex * MaxSegmentSize, buffer + sizeof(MailHeader), p->remainder);
+            box->ackLock->Acquire();
+            // only time segments sent once, whose ACK is not ambiguous
+            if(next == sent && !box->timing)
+            {
+                box->timing = true;
+                box->timedId = first + next;
+                box->timedTick = stats->totalTicks;
+            }
+            if(box->deadline == 0)
+            {
+                box->deadline = stats->totalTicks + box->rto;
+            }
+            box->ackLock->Release();
+            burst.Append(BuildSegment(p, data, next));
+            next++;
+            if(next > sent)
+            {
+                sent = next;
+            }
         }
-        else
+        QueueSegments(&burst);
+
+        // wait for an ACK that slides the window, or for a retransmission
+        box->ackLock->Acquire();
+        while(box->ackId - first < base && !box->timedOut && !box->fastRetransmit)
         {
-            // otherwise write a whole segment
-            bcopy(data + segIndex * MaxSegmentSize, buffer + sizeof(MailHeader), MaxSegmentSize);
+            box->ackCond->Wait(box->ackLock);
         }
-        if(DebugIsEnabled('p'))
+        int acked = box->ackId - first + 1; // segments known to have arrived
+        bool timeout = box->timedOut;
+        bool fast = box->fastRetransmit;
+        box->timedOut = false;
+        box->fastRetransmit = false;
+        if(acked > base)
+        {
+            // restart the timer for the segments still in flight
+            box->deadline = (acked < p->nbSegments) ? stats->totalTicks + box->rto : 0;
+        }
+        else if(timeout)
+        {
+            box->BackOff();
+        }
+        else if(fast)
         {
-            DEBUG('p', "[Machine %d] Sent segment %d (%s) to machine %d, box %d\n", p->pktHdr.from,
-                  segIndex, buffer + sizeof(MailHeader), p->pktHdr.to, p->mailHdr.to);
+            box->timing = false;
         }
+        box->ackLock->Release();
 
-        if(!ReliableSendSegment(p, buffer))
+        if(acked > base)
         {
-            delete[] buffer;
-            return false;
+            DEBUG('p', "[machine %d] ACK received up to segment %d\n", GetNetAddr(), acked - 1);
+            base = (acked < p->nbSegments) ? acked : p->nbSegments;
+            if(next < base)
+            {
+                next = base;
+            }
+            nTimeouts = 0;
+        }
+        else if(timeout)
+        {
+            nTimeouts++;
+            if(nTimeouts >= MAXREEMISSIONS)
+            {
+                box->ackLock->Acquire();
+                box->deadline = 0;
+                box->timing = false;
+                box->ackLock->Release();
+                StopSending(box);
+                p->mailHdr.messageId = first + base;
+                return false;
+            }
+            DEBUG('p', "[machine %d] NO ACK received, reemission from segment %d\n",
+                  GetNetAddr(), base);
+            next = base;
+        }
+        else if(fast)
+        {
+            DEBUG('p', "[machine %d] %d duplicate ACKs, fast reemission of segment %d\n",
+                  GetNetAddr(), DUPACKS, base);
+            SendSegment(p, data, base);
         }
-        p->mailHdr.messageId++;
     }
-    delete[] buffer; // we've sent the message, so
-                     // we can delete our buffer
+    StopSending(box);
+    p->mailHdr.messageId = first + p->nbSegments;
     return true;
 }
 
 // Receive a payload from the network
 void PostOffice::ReceivePayload(Payload *p, int box, char *data)
 {
-    ASSERT((box >= 0) && (box < numBoxes));
+    MailBox *mailBox = FindBox(box);
+
+    ASSERT(mailBox != NULL);
     bzero(data, strlen(data) + 1);
     // first call to Get() in order to initialize the current payload
-    boxes[box].Get(p, 0, data);
+    mailBox->Get(p, 0, data);
     // Browse through every other segment index to reconstitute data
     for(int segIndex = 1; segIndex < p->nbSegments; segIndex++)
     {
-        boxes[box].Get(p, segIndex, data + segIndex * MaxSegmentSize);
+        mailBox->Get(p, segIndex, data + segIndex * MaxSegmentSize);
     }
 }
 
 void PostOffice::DisconnectPayload(Payload *inP)
+{
+    DisconnectBox(inP->mailHdr.to);
+}
+
+void PostOffice::DisconnectBox(MailBoxAddress addr)
 {
     DEBUG('p', "START DISCONNECT\n");
-    int box = inP->mailHdr.to;
-    while(!boxes[box].messages->IsEmpty())
+    MailBox *box = FindBox(addr);
+    ASSERT(box != NULL);
+    while(box->Drop())
     {
-        boxes[box].messages->Remove();
     }
     disconnectLock->Acquire();
     disconnectCond->Wait(disconnectLock); // Be sure that DISONNECT_TEMPO is reached
     do
     {
         disconnectCond->Wait(disconnectLock);
-    } while(boxes[box].messages->RemoveNoWaiting() != NULL);
+    } while(box->Drop());
     disconnectLock->Release();
-    boxes[box].waitedId = 0;
-    usedBoxes->Clear(box);
+    if(addr >= FIRST_CONN_ID)
+    {
+        CloseConnection(box);
+    }
+    else
+    {
+        box->Reset(0);
+    }
     DEBUG('p', "END DISCONNECT\n");
 }
 
 Connection *PostOffice::Connect(NetworkAddress addr)
 {
     DEBUG('p', "Start connect\n");
-    if(addr == postOffice->GetNetAddr())
-    {
-        printf("ERROR : a machine cannot connect to itself !\n");
-        return NULL;
-    }
-    char buffer[MaxSegmentSize];
+    char buffer[HANDSHAKE_SIZE] = {0}; // the reply is "C"
     time_t timestamp = time(0);
-    int box = usedBoxes->Find();
-    if(box == -1)
-    {
-        return NULL;
-    }
+    int box = OpenConnection(0)->address;
     Connection *c = new Connection;
     c->pOut = new Payload;
     c->pIn = new Payload;
-    boxes[box].waitedId = 0;
     c->pOut->UpdatePayload(GetNetAddr(), addr, box, LISTEN_BOX, sizeof(time_t), CONN);
     SendPayload(c->pOut, (char *)&timestamp);
     ReceivePayload(c->pIn, box, buffer);
@@ -628,20 +1251,18 @@ Connection *PostOffice::Connect(NetworkAddress addr)
 
 Connection *PostOffice::Listen()
 {
-    char buffer[MaxSegmentSize];
-    int box = usedBoxes->Find();
-    if(box == -1)
-    {
-        return NULL;
-    }
-
+    char buffer[HANDSHAKE_SIZE] = {0}; // the request holds a time_t
+    MailBox *box = OpenConnection(1);
     Connection *c = new Connection;
     c->pOut = new Payload;
     c->pIn = new Payload;
-    boxes[box].waitedId = 1;
     ReceivePayload(c->pIn, LISTEN_BOX, buffer);
     ASSERT(c->pIn->mailHdr.messageType == CONN);
-    c->pOut->UpdatePayload(GetNetAddr(), c->pIn->pktHdr.from, box, c->pIn->mailHdr.from, 2);
+    // its reminder is dropped when the connection closes
+    box->peer = c->pIn->pktHdr.from;
+    box->peerBox = c->pIn->mailHdr.from;
+    c->pOut->UpdatePayload(GetNetAddr(), c->pIn->pktHdr.from, box->address,
+                           c->pIn->mailHdr.from, 2);
     SendPayload(c->pOut, "C");
     return c;
 }
@@ -672,41 +1293,232 @@ void PostOffice::Disconnect(Connection *conn)
     {
         return;
     }
-    DisconnectPayload(conn->pIn);
+    // our end of the connection, even if nothing was received on it
+    DisconnectBox(conn->pOut->mailHdr.from);
+    delete conn->pIn;
+    delete conn->pOut;
     delete conn;
 }
 
+// Hash bucket of the reminders of the CONN messages sent from mailbox
+// "box" of machine "from"
+static unsigned ReminderBucket(NetworkAddress from, MailBoxAddress box)
+{
+    return ((unsigned)from * 31 + (unsigned)box) % CONN_BUCKETS;
+}
+
 bool PostOffice::ValidConn(ConnReminder *conn)
 {
+    unsigned bucket = ReminderBucket(conn->netFrom, conn->mailFrom);
+    ConnReminder **prev = &reminders[bucket];
+    bool validConn = true;
+
     connLock->Acquire(); // Ensure thread safety
-    bool validConn;
     // Check if the connection already exists
-    auto it = std::find_if(connections.begin(), connections.end(),
-                           [conn](const ConnReminder *existingConn)
-                           {
-                               return (existingConn->netFrom == conn->netFrom &&
-                                       existingConn->netTo == conn->netTo &&
-                                       existingConn->mailFrom == conn->mailFrom &&
-                                       existingConn->mailTo == conn->mailTo &&
-                                       existingConn->connTimestamp >= conn->connTimestamp);
-                           });
-
-    if(it == connections.end())
-    {
-        // Connection is not in the list, add it
+    for(ConnReminder *r = *prev; r != NULL; prev = &r->next, r = r->next)
+    {
+        if(r->netFrom == conn->netFrom && r->netTo == conn->netTo &&
+           r->mailFrom == conn->mailFrom && r->mailTo == conn->mailTo)
+        {
+            validConn = (r->connTimestamp < conn->connTimestamp);
+            if(validConn)
+            {
+                // a newer request: it replaces the one we remembered
+                *prev = r->next;
+                delete r;
+            }
+            break;
+        }
+    }
+
+    if(validConn)
+    {
+        // Connection is not in the table, add it
         DEBUG('p', "The conn : %d %d %d %d %ld is valid\n", conn->netFrom, conn->netTo,
               conn->mailFrom, conn->mailTo, conn->connTimestamp);
-        connections.push_back(conn);
-        validConn = true;
+        conn->next = reminders[bucket];
+        reminders[bucket] = conn;
     }
     else
     {
         // Connection is a duplicate; optionally log or handle it
         DEBUG('p', "The conn : %d %d %d %d %ld is duplicated\n", conn->netFrom, conn->netTo,
               conn->mailFrom, conn->mailTo, conn->connTimestamp);
-        validConn = false;
     }
 
     connLock->Release(); // Release the lock
     return validConn;
 }
+
+//----------------------------------------------------------------------
+// PostOffice::ForgetConn
+// 	Drop the reminder of the CONN message that opened the connection
+//	of "box", if Listen accepted one on it, so that the reminders don't
+//	outlive their connections.  The caller holds connLock.
+//----------------------------------------------------------------------
+
+void PostOffice::ForgetConn(MailBox *box)
+{
+    ConnReminder **prev;
+
+    if(box->peerBox == -1)
+    {
+        return;
+    }
+    for(prev = &reminders[ReminderBucket(box->peer, box->peerBox)]; *prev != NULL;
+        prev = &(*prev)->next)
+    {
+        ConnReminder *r = *prev;
+
+        if(r->netFrom == box->peer && r->mailFrom == box->peerBox && r->mailTo == LISTEN_BOX)
+        {
+            *prev = r->next;
+            delete r;
+            return;
+        }
+    }
+}
+
+//----------------------------------------------------------------------
+// PostOffice::FindBox
+// 	Return the mailbox a message to "addr" goes to: one of the fixed
+//	mailboxes, or the mailbox of an open connection, found in the hash
+//	table of the connections; NULL if there is none.
+//----------------------------------------------------------------------
+
+MailBox *PostOffice::FindBox(MailBoxAddress addr)
+{
+    MailBox *box;
+
+    if(0 <= addr && addr < numBoxes)
+    {
+        return &boxes[addr];
+    }
+    if(addr < FIRST_CONN_ID)
+    {
+        return NULL;
+    }
+    connLock->Acquire();
+    box = LookupConnection(addr);
+    connLock->Release();
+    return box;
+}
+
+//----------------------------------------------------------------------
+// PostOffice::HoldBox, ReleaseBox
+// 	Like FindBox, but the mailbox of a connection stays in the table,
+//	and allocated, until ReleaseBox: connLock is held in between.  For
+//	short uses that don't wait, such as putting a message in it.
+//----------------------------------------------------------------------
+
+MailBox *PostOffice::HoldBox(MailBoxAddress addr)
+{
+    MailBox *box;
+
+    if(addr < FIRST_CONN_ID)
+    {
+        return FindBox(addr);
+    }
+    connLock->Acquire();
+    box = LookupConnection(addr);
+    if(box == NULL)
+    {
+        connLock->Release();
+    }
+    return box;
+}
+
+void PostOffice::ReleaseBox(MailBoxAddress addr)
+{
+    if(addr >= FIRST_CONN_ID)
+    {
+        connLock->Release();
+    }
+}
+
+// Return the mailbox of the open connection "addr", or NULL; the caller
+// holds connLock
+MailBox *PostOffice::LookupConnection(MailBoxAddress addr)
+{
+    MailBox *box = connTable[addr % CONN_BUCKETS];
+
+    while(box != NULL && box->address != addr)
+    {
+        box = box->nextConn;
+    }
+    return box;
+}
+
+//----------------------------------------------------------------------
+// PostOffice::OpenConnection
+// 	Allocate the mailbox of a new connection, and give it an id not
+//	used by any open connection.  Ids are handed out in increasing
+//	order, so that a late message of a closed connection does not reach
+//	the next one.
+//
+//	"firstId" -- the id of the first segment expected on the mailbox
+//----------------------------------------------------------------------
+
+MailBox *PostOffice::OpenConnection(int firstId)
+{
+    MailBox *box = new MailBox;
+
+    box->Reset(firstId);
+    connLock->Acquire();
+    do
+    {
+        box->address = nextConnId;
+        nextConnId = (nextConnId == INT_MAX) ? FIRST_CONN_ID : nextConnId + 1;
+    } while(LookupConnection(box->address) != NULL);
+    box->nextConn = connTable[box->address % CONN_BUCKETS];
+    connTable[box->address % CONN_BUCKETS] = box;
+    numConns++;
+    connLock->Release();
+    DEBUG('p', "[machine %d] Connection %d opened, %d open\n", GetNetAddr(), box->address,
+          numConns);
+    return box;
+}
+
+//----------------------------------------------------------------------
+// PostOffice::CloseConnection
+// 	Remove the mailbox of a connection from the table, along with the
+//	reminder of its CONN, and de-allocate it.  Messages still arriving
+//	for it are thrown away.
+//----------------------------------------------------------------------
+
+void PostOffice::CloseConnection(MailBox *box)
+{
+    connLock->Acquire();
+    MailBox **prev = &connTable[box->address % CONN_BUCKETS];
+    while(*prev != box)
+    {
+        prev = &(*prev)->nextConn;
+    }
+    *prev = box->nextConn;
+    numConns--;
+    ForgetConn(box);
+    connLock->Release();
+    DEBUG('p', "[machine %d] Connection %d closed\n", GetNetAddr(), box->address);
+    delete box;
+}
+
+//----------------------------------------------------------------------
+// PostOffice::StartSending, StopSending
+// 	Add a mailbox to the list of those whose SendPayload is running, or
+//	remove it.  The timer handler walks the list, hence interrupts are
+//	disabled while it changes.
+//----------------------------------------------------------------------
+
+void PostOffice::StartSending(MailBox *box)
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    senders.push_back(box);
+    (void)interrupt->SetLevel(oldLevel);
+}
+
+void PostOffice::StopSending(MailBox *box)
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    senders.remove(box);
+    (void)interrupt->SetLevel(oldLevel);
+}
@@ -37,8 +37,23 @@
 #define MAXREEMISSIONS 50
 #define TEMPO 10000000
 #define DISCONNECT_TEMPO (TEMPO * 4)
+#define MAXWINDOW 32     // Largest send window; also the number of segments
+                         // a mailbox keeps when they arrive out of order
+#define DEFAULT_WINDOW 8 // Unacknowledged segments a sender may have in flight
+#define INITIAL_RTO 20000 // Retransmission timeout before the first round
+                          // trip is measured, in ticks
+#define MIN_RTO 1000      // Bounds of the retransmission timeout
+#define MAX_RTO TEMPO
+#define DUPACKS 3         // Duplicate ACKs that trigger a fast retransmit
+#define FIRST_CONN_ID 1024 // Mailbox addresses from this one up are the ids
+                           // of connections, not numbers of fixed mailboxes
+#define CONN_BUCKETS 1024  // Hash buckets of the connection tables
+#define HANDSHAKE_SIZE 16  // Room for a message of the connection handshake
 // Mailbox address -- uniquely identifies a mailbox on a given machine.
 // A mailbox is just a place for temporary storage for messages.
+// Addresses below the number of mailboxes of the post office are fixed
+// mailboxes; from FIRST_CONN_ID up, they are connection ids, each with
+// a mailbox of its own allocated by Connect or Listen.
 typedef int MailBoxAddress;
 
 // Forward declaration of the Payload class (circular dependencies between classes)
@@ -57,8 +72,10 @@ typedef enum
 class MailHeader
 {
 public:
-  MailBoxAddress to;   // Destination mail box
-  MailBoxAddress from; // Mail box to reply to
+  MailBoxAddress to;   // Destination mail box, or connection id on the
+                       // receiver
+  MailBoxAddress from; // Mail box to reply to, or connection id on the
+                       // sender
   unsigned length;     // Bytes of message data (excluding the
                        // mail header)
   MessageType messageType;
@@ -66,7 +83,7 @@ public:
 };
 
 // Maximum "payload" -- real data -- that can included in a single message
-// Excluding the MailHeader and the PacketHeader
+// Excluding the MailHeader and the PacketHeader; it follows the wire size
 
 #define MaxSegmentSize (MaxPacketSize - sizeof(MailHeader))
 
@@ -117,22 +134,13 @@ public:
   // Update a payload from the given data
 };
 
-class Mail
-{
-public:
-  Mail(Payload *p, char *msgData);
-  // Initialize a mail message by
-  // concatenating the headers to the data
-
-  PacketHeader pktHdr;       // Header appended by Network
-  MailHeader mailHdr;        // Header appended by PostOffice
-  char data[MaxSegmentSize]; // Payload -- message data
-};
-
 // The following class defines a single mailbox, or temporary storage
 // for messages.   Incoming messages are put by the PostOffice into the
 // appropriate mailbox, and these messages can then be retrieved by
 // threads on this machine.
+//
+// Messages are kept in the packets they arrived in, each with its
+// PacketHeader and MailHeader in front of the data.
 
 class MailBox
 {
@@ -140,18 +148,59 @@ public:
   MailBox();  // Allocate and initialize mail box
   ~MailBox(); // De-allocate mail box
 
-  void Put(Payload *p, char *data);
-  // Atomically put a message into the mailbox
+  void Put(Packet *pkt);
+  // Atomically put a message into the mailbox,
+  // which owns the packet from now on
   bool Get(Payload *p, int segmentIndex, char *data);
   // Atomically get a message out of the
   // mailbox (and wait if there is no message
   // to get!)
-  SynchList *messages; // A mailbox is just a list of arrived messages
-  int waitedId;
-  int ackId;
-  int timeoutId;
+  bool Drop();
+  // Throw away the first message, without
+  // waiting; return false if there was none
+  bool Deliver(Packet *pkt);
+  // Put a DATA segment in order: keep it aside
+  // if the segments before it are missing, and
+  // put those it was holding back afterwards;
+  // return true if it was the one expected
+  void Reset(int firstId);
+  // Forget the state of the previous connection;
+  // "firstId" is the next segment expected
+  void SampleRtt(int rtt);
+  // Update the retransmission timeout with a
+  // measured round trip time
+  void BackOff();
+  // Double the retransmission timeout, after it
+  // expired
+  PacketQueue messages; // A mailbox is just a list of arrived messages
+  Lock *lock;           // Protects "messages"
+  Condition *messageArrived; // Signaled when a message is put
+  int waitedId;        // Id of the next segment to put in "messages"
+  Packet *pending[MAXWINDOW]; // Segments received ahead of "waitedId",
+                              // indexed by messageId % MAXWINDOW
+  int ackId;           // Highest id acknowledged by the receiver: every
+                       // segment up to it has arrived (cumulative ACK)
+  bool timedOut;       // Set by the timer; the sender goes back to the
+                       // oldest unacknowledged segment
+  int deadline;        // Tick when "timedOut" is set, 0 if no timer runs
+  int rto;             // Retransmission timeout, in ticks
+  int srtt;            // Smoothed round trip time; -1 before the first
+                       // measure
+  int rttvar;          // Mean deviation of the round trip time
+  bool timing;         // Is a segment timed to measure the round trip?
+  int timedId;         // Id of that segment, never retransmitted
+  int timedTick;       // When it was sent
+  int dupAcks;         // ACKs received again, each after a segment that
+                       // arrived out of order
+  bool fastRetransmit; // Set after DUPACKS duplicate ACKs: the oldest
+                       // unacknowledged segment is resent at once
   Condition *ackCond;
   Lock *ackLock;
+  MailBoxAddress address; // Number of the mailbox, or connection id
+  MailBox *nextConn;      // Next connection of the same hash bucket
+  NetworkAddress peer;    // Machine and connection id of the client of
+  MailBoxAddress peerBox; // a connection accepted by Listen; peerBox is
+                          // -1 for other mailboxes
 };
 
 class Connection
@@ -169,6 +218,7 @@ public:
   MailBoxAddress mailFrom;
   MailBoxAddress mailTo;
   time_t connTimestamp;
+  ConnReminder *next; // Next reminder of the same hash bucket
 };
 
 // The following class defines a "Post Office", or a collection of
@@ -183,27 +233,47 @@ public:
 class PostOffice
 {
 public:
-  PostOffice(NetworkAddress addr, double reliability, int nBoxes);
+  PostOffice(NetworkAddress addr, double reliability, int nBoxes, int sendWindow);
   // Allocate and initialize Post Office
   //   "reliability" is how many packets
   //   get dropped by the underlying network
+  //   "sendWindow" is how many segments may
+  //   be sent before the first one is ACKed
   ~PostOffice(); // De-allocate Post Office data
 
   void PostalDelivery(); // Wait for incoming messages,
                          // and then put them in the correct mailbox
 
   void PacketSent();     // Interrupt handler, called when outgoing
-                         // packet has been put on network; next
-                         // packet can now be sent
+                         // packets have been put on network; next
+                         // batch can now be sent
   void IncomingPacket(); // Interrupt handler, called when incoming
                          // packet has arrived and can be pulled
                          // off of network (i.e., time to call
                          // PostalDelivery)
+  void TimerExpired();   // Interrupt handler, called on each tick of
+                         // the timer; wakes up CheckTimeouts if a
+                         // retransmission timeout expired
+  void CheckTimeouts();  // Wake up the senders whose timeout expired
+                         // (retransmit timer thread)
+  void Transmit();       // Send the queued packets in batches, ACKs
+                         // first (transmitter thread)
   bool SendPayload(Payload *p, const char *data);
   void ReceivePayload(Payload *p, int box, char *data);
   // Receive a payload from the network
-  bool ReliableSendSegment(Payload *p, char *data);
+  Packet *BuildSegment(Payload *p, const char *data, int segIndex);
+  // Copy the segment "segIndex" of a payload
+  // into a packet, behind its headers
+  bool LoopbackPayload(Payload *p, const char *data);
+  // Deliver a payload to this machine directly
+  void SendSegment(Payload *p, const char *data, int segIndex);
+  // Queue the segment "segIndex" of a payload,
+  // to be sent once
   void DisconnectPayload(Payload *inP);
+  void DisconnectBox(MailBoxAddress addr);
+  // Wait until the messages in flight to a
+  // mailbox are over, and throw them away;
+  // a connection is closed then
   bool Send(Connection *conn, const char *data, size_t data_size);
   bool Receive(Connection *conn, char *data);
   Connection *Connect(NetworkAddress addr);
@@ -212,12 +282,16 @@ public:
   Lock *disconnectLock;
 
   Condition *disconnectCond;
-  // Send a segment and wait for the ACK
   NetworkAddress GetNetAddr(); // Return the current network id
   MailBox *boxes;              // Table of mail boxes to hold incoming mail
   void BroadcastBoxes();
   int numBoxes;
-  BitMap *usedBoxes;
+  MailBox *FindBox(MailBoxAddress addr);
+  // Mailbox of a fixed address or of an open
+  // connection; NULL if there is none
+  void SetWindow(int sendWindow); // Change the send window
+  int GetWindow() { return window; }
+  double GetReliability() { return netReliability; } // As given to the network
 
 private:
   Timer *BroadcastTimer;
@@ -225,10 +299,46 @@ private:
   NetworkAddress netAddr;      // Network address of this machine
   Semaphore *messageAvailable; // V'ed when message has arrived from network
   Semaphore *messageSent;      // V'ed when next message can be sent to network
-  Lock *sendLock;              // Only one outgoing message at a time
-  std::list<ConnReminder*> connections; // To track active/received connections
-  Lock *connLock;                      // To make the list thread-safe
+  PacketQueue ackQueue;        // ACKs waiting for the transmitter; the tag
+                               // of those that a later one can replace
+                               // (cumulative ACKs) is set
+  PacketQueue dataQueue;       // Segments waiting for the transmitter
+  Lock *queueLock;             // Protects the transmit queues
+  Condition *queueReady;       // Signaled when a packet is queued
+  void QueueAck(PacketHeader pktHdr, MailHeader mailHdr, bool cumulative);
+                               // Queue an ACK, or update the ACK it follows
+  void AcceptConn(Packet *pkt);
+                               // Put a CONN into the listening mailbox,
+                               // unless it is a duplicate
+  void QueueSegments(PacketQueue *segments);
+                               // Queue segments for the transmitter at once
+  Semaphore *timerWakeup;      // V'ed when a timeout expired
+  bool timerPending;           // Is CheckTimeouts about to run?
+  int lastDisconnectTick;      // When disconnectCond was last signaled
+  int window;                  // Segments in flight per payload, at most MAXWINDOW
+  double netReliability;       // Chance that the network delivers a packet
+  ConnReminder *reminders[CONN_BUCKETS]; // CONN messages received, to
+                                         // throw duplicates away
+  MailBox *connTable[CONN_BUCKETS]; // Mailboxes of the open connections,
+                                    // hashed on their id
+  int numConns;                     // Number of open connections
+  MailBoxAddress nextConnId;        // Id of the next connection opened
+  Lock *connLock;                   // Protects the connection tables
   bool ValidConn(ConnReminder *conn);
+  void ForgetConn(MailBox *box); // Drop the reminder of the CONN that
+                                 // opened a connection; connLock is held
+  MailBox *LookupConnection(MailBoxAddress addr); // Mailbox of an open
+                                        // connection; connLock is held
+  MailBox *HoldBox(MailBoxAddress addr); // FindBox, keeping the mailbox
+                                         // of a connection from being freed
+  void ReleaseBox(MailBoxAddress addr);  // until this
+  MailBox *OpenConnection(int firstId); // Allocate the mailbox of a new
+                                        // connection, with a new id
+  void CloseConnection(MailBox *box);   // De-allocate it
+  std::list<MailBox *> senders;     // Mailboxes whose SendPayload is
+                                    // running: those the timer checks
+  void StartSending(MailBox *box);  // Add a mailbox to "senders"
+  void StopSending(MailBox *box);   // Remove it
 };
 
 typedef struct
@@ -1,8 +1,9 @@
 #!/bin/bash
 
 # Check if the correct number of arguments is provided
-if [ "$#" -ne 1 ]; then
-  echo "Usage: $0 <number_of_machines>"
+if [ "$#" -lt 1 ] || [ "$#" -gt 2 ] || { [ "$#" -eq 2 ] && [ "$2" != "-switch" ]; }; then
+  echo "Usage: $0 <number_of_machines> [-switch]"
+  echo "  -switch: simulate every machine in a single nachos, with no socket"
   exit 1
 fi
 
@@ -15,6 +16,16 @@ if ! [[ $n =~ ^[0-9]+$ ]] || [ "$n" -le 0 ]; then
   exit 1
 fi
 
+if [ "$2" = "-switch" ]; then
+  if [ "$n" -lt 2 ]; then
+    echo "Error: The ring of the switch needs at least 2 machines."
+    exit 1
+  fi
+  echo "Launching: ./nachos-step6 -switch -m 0 -swring $n"
+  ../build/nachos-step6 -switch -m 0 -swring $n
+  exit $?
+fi
+
 # Loop to launch the machines in a ring
 for (( i=1; i<n; i++ )); do
   target=$(( (i+1) % n ))
@@ -1,7 +1,7 @@
 #include "syscall.h"
 
 void thread_routine(void *arg) {
-    if (Create("Test") == 0) {
+    if (Create("Test", 0) == 0) {
         PutString("The file Test can't be created\n", 50);
     } else {
         PutString("The file Test has been created\n", 50);
@@ -16,7 +16,7 @@ void thread_routine(void *arg) {
 int main() {
     int id[5];
 
-    if (!Create("Test")) {
+    if (!Create("Test", 0)) {
         PutString("The file Test can't be created\n", 50);
         Exit(1);
     }
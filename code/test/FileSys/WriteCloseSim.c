@@ -21,7 +21,7 @@ int main() {
     int id1, id2, value, nb;
     char buffer[100];
 
-    if (!Create("Test")) {
+    if (!Create("Test", 0)) {
         PutString("The file Test can't be created\n", 50);
         Exit(1);
     }
@@ -21,7 +21,7 @@ int main() {
     char buffer[100];
     mem_init(100);
 
-    if (!Create("Test")) {
+    if (!Create("Test", 0)) {
         PutString("The file Test can't be created\n", 50);
         Exit(1);
     }
@@ -4,7 +4,7 @@ int main() {
     int fd, value;
     char buffer[100];
 
-    if (Create("Test") == -1) {
+    if (Create("Test", 0) == -1) {
         PutString("The file Test can't be created\n", 50);
         Exit(1);
     }
@@ -1,6 +1,8 @@
 #include "syscall.h"
 
 #define NB_ELEMENT 50
+#define NB_NAME 256         // longest file name, with its '\0'
+#define NB_RECORD_WORDS 128 // size of the Readdir buffer, in words
 
 int strCmp(const char *s1, const char *s2) {
     while (*s1 && (*s1 == *s2)) {
@@ -18,6 +20,8 @@ int main() {
     int sizeWords[3];
     int hasQuotes[3];
     char *buffer;
+    int records[NB_RECORD_WORDS], from; // int, for Readdir's word alignment
+    DirRecord *record;
 
     PutString("Starting the shell !\n", 25);
 
@@ -96,6 +100,22 @@ int main() {
                     PutString("ls\n", 50);
                 }
                 Listfiles();
+            } else if (strCmp(*commandLine, "ll") == 0) {
+                from = 0;
+                while ((value = Readdir(from, (char *)records, sizeof(records))) > 0) {
+                    record = (DirRecord *)records;
+                    for (i = 0; i < value; i++) {
+                        PutInt(record->size);
+                        PutString("B ", 2);
+                        PutString(record->name, NB_NAME);
+                        if (record->type != 0) {
+                            PutChar('/');
+                        }
+                        PutChar('\n');
+                        record = (DirRecord *)((char *)record + record->length);
+                    }
+                    from += value;
+                }
             } else if (strCmp(*commandLine, "rm") == 0) {
                 if (nbTotalWords != 2) {
                     PutString("Not enough arguments for rm\n", 50);
@@ -133,9 +153,17 @@ int main() {
                     PutString("Not enough arguments for touch\n", 50);
                     PutString("touch <name>\n", 50);
                 }
-                if (!Create(commandLine[1])) {
+                if (!Create(commandLine[1], 0)) {
                     PutString("touch didn't work\n", 50);
                 }
+            } else if (strCmp(*commandLine, "cp") == 0) {
+                if (nbTotalWords != 3) {
+                    PutString("Not enough arguments for cp\n", 50);
+                    PutString("cp <file> <new file>\n", 50);
+                }
+                if (!Copy(commandLine[1], commandLine[2])) {
+                    PutString("cp didn't work\n", 50);
+                }
             } else if (strCmp(*commandLine, "cat") == 0) {
                 if (nbTotalWords != 2) {
                     PutString("Not enough arguments for cat\n", 50);
@@ -206,10 +234,12 @@ int main() {
             } else if (strCmp(*commandLine, "help") == 0) {
                 PutString("Available commands: \n", 20);
                     PutString("ls - List all files in the current directory\n", 100);
+                    PutString("ll - List all files in the current directory, with their size\n", 100);
                     PutString("rm <file> - Remove the file <file> in the current directory\n", 100);
                     PutString("rmdir <directory> - Remove an empty directory <directory> in the current directory\n", 100);
                     PutString("cd <path> - Change the current directory to <path>\n", 100);
                     PutString("touch <name> - Create a new file of name <name>\n", 100);
+                    PutString("cp <file> <new file> - Copy <file> into <new file>\n", 100);
                     PutString("cat <file> - Display the content of the file <file>\n", 100);
                     PutString("echo <text> <file> - Write <text> into <file>\n", 100);
                     PutString("run <executable> - Run the executable <executable>\n", 100);
@@ -216,3 +216,20 @@ void *List::SortedRemove(long long *keyPtr) {
     delete element;
     return thing;
 }
+
+//----------------------------------------------------------------------
+// List::FirstKey
+//      Look at the key of the first item of a sorted list, leaving the
+//      list as it is.
+//
+// Returns:
+//      FALSE if nothing is on the list; otherwise TRUE, with *keyPtr
+//      set to the priority value of the first item.
+//----------------------------------------------------------------------
+
+bool List::FirstKey(long long *keyPtr) {
+    if (IsEmpty())
+        return FALSE;
+    *keyPtr = first->key;
+    return TRUE;
+}
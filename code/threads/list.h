@@ -56,6 +56,8 @@ class List {
     // Routines to put/get items on/off list in order (sorted by key)
     void SortedInsert(void *item, long long sortKey); // Put item into list
     void *SortedRemove(long long *keyPtr); // Remove first item from list
+    bool FirstKey(long long *keyPtr); // Key of the first item, without
+                                      // removing it; FALSE if empty
 
   private:
     ListElement *first; // Head of the list, NULL if list is empty
@@ -11,12 +11,15 @@
 // Usage: nachos -d <debugflags> -rs <random seed #>
 //              -s -x <nachos file> -c <consoleIn> <consoleOut>
 //              -f -cp <unix file> <nachos file>
-//              -disk <disk name>
-//              -p <nachos file> -r <nachos file> -l -D -t
-//              -n <network reliability> -m <machine id>
+//              -disk <disk name> -ds <fifo|sstf|scan|cscan> -dmap
+//              -p <nachos file> -r <nachos file> -l -D -t -bench [run]
+//              -n <network reliability> -m <machine id> -mtu <bytes>
+//              -w <window> -switch
 //              -o <other machine id>
+//              -window <far address>
 //              -conn <far address>
 //              -ring <far address>
+//              -swring <number of machines>
 //              -ftpclient <server address> <r/w> <file name>
 //              -ftpserver
 //              -z
@@ -33,20 +36,33 @@
 //  FILESYS
 //    -f causes the physical disk to be formatted
 //    -disk creates a NachOS disk with the specified name
+//    -ds sets the disk scheduling policy (default cscan)
+//    -dmap maps the disk file in memory instead of reading/writing it
 //    -cp copies a file from UNIX to Nachos
 //    -p prints a Nachos file to stdout
 //    -r removes a Nachos file from the file system
 //    -l lists the contents of the Nachos directory
 //    -D prints the contents of the entire file system
 //    -t tests the performance of the Nachos file system
+//    -bench runs the file system benchmarks (those whose name starts
+//          with "run" if given) and prints one line of results per run
 //    -ft launches a test shell for the file system
 //
 //  NETWORK
 //    -n sets the network reliability
 //    -m sets this machine's host id (needed for the network)
+//    -mtu sets the size of the packets on the wire, headers included
+//          (default 64, at most 65507); every machine must use the same
+//    -w sets how many segments can be sent before the first one is
+//          acknowledged (default 8, at most 32; 1 is stop-and-wait)
+//    -switch connects the machines simulated in this Nachos through an
+//          in-memory packet switch, instead of UNIX sockets
 //    -o runs a simple test of the Nachos network software using the basic Payload structures
 //    -ring runs a connection test of several machines in a ring topology (see network/ring.sh)
+//    -swring runs the ring test with several machines in this Nachos
+//          (needs -switch); they get the addresses following -m
 //    -conn runs a standard connection test using the PostOffice methods
+//    -window measures the throughput of a transfer for each send window
 //    -ftpclient runs a FTP client machine that connects to the specified server and tries to send or receive the specified file
 //    -ftpserver runs a FTP server that waits for client connections
 
@@ -69,10 +85,13 @@
 extern void MailTest (int networkID);
 extern void RingTest(int networkID);
 extern void ConnTest(int networkID);
+extern void WindowTest(int networkID);
+extern void SwitchRingTest(int nbMachines);
 extern void FTPTestClient(int servAddr, char readwrite, char *fileName);
 extern void FTPTestServer();
 extern void ThreadTest (void), Copy (const char *unixFile, const char *nachosFile);
 extern void Print (char *file), PerformanceTest (void), FileSystemTest(void);
+extern void FileSystemBenchmark (const char *only);
 extern void StartProcess (char *file), ConsoleTest (char *in, char *out),
     SynchConsoleTest (char *in, char *out);
 
@@ -174,8 +193,17 @@ int main(int argc, char **argv)
         else if (!strcmp(*argv, "-t"))
         { // performance test
             PerformanceTest ();
+        }
+        else if (!strcmp(*argv, "-bench"))
+        { // file system benchmarks
+            if (argc > 1 && **(argv + 1) != '-') {
+                FileSystemBenchmark(*(argv + 1));
+                argCount = 2;
+            } else
+                FileSystemBenchmark(NULL);
         } else if (!strcmp(*argv, "-ft")) {
             FileSystemTest(); 
+            fileSystem->Sync();
             interrupt->Halt (); // once we start the console, then
         } 
 #endif // FILESYS
@@ -196,6 +224,12 @@ int main(int argc, char **argv)
             RingTest(atoi(*(argv + 1)));
             argCount = 2;
         }
+        else if (!strcmp(*argv, "-swring"))
+        {
+            ASSERT(argc > 1);
+            SwitchRingTest(atoi(*(argv + 1)));
+            argCount = 2;
+        }
         else if (!strcmp(*argv, "-conn"))
         {
             ASSERT(argc > 1);
@@ -203,6 +237,13 @@ int main(int argc, char **argv)
             ConnTest(atoi(*(argv + 1)));
             argCount = 2;
         }
+        else if (!strcmp(*argv, "-window"))
+        {
+            ASSERT(argc > 1);
+            Delay(1);
+            WindowTest(atoi(*(argv + 1)));
+            argCount = 2;
+        }
         else if (!strcmp(*argv, "-ftpclient"))
         {
             ASSERT(argc > 3);
@@ -241,3 +241,107 @@ void Condition::Broadcast(Lock *conditionLock)
 
     (void)interrupt->SetLevel(oldLevel); // Re-enable interrupts
 }
+
+//----------------------------------------------------------------------
+// RWLock::RWLock
+//      Initialize a reader/writer lock, so that it can be used for
+//      synchronization.  It is built on a lock and two condition
+//      variables.
+//
+//      "debugName" is an arbitrary name, useful for debugging.
+//----------------------------------------------------------------------
+
+RWLock::RWLock(const char *debugName)
+{
+    name = debugName;
+    lock = new Lock(debugName);
+    readersOk = new Condition(debugName);
+    writersOk = new Condition(debugName);
+    readers = 0;
+    waitingWriters = 0;
+    writer = -1;
+}
+
+//----------------------------------------------------------------------
+// RWLock::~RWLock
+//      De-allocate the reader/writer lock when no longer needed.
+//----------------------------------------------------------------------
+
+RWLock::~RWLock()
+{
+    ASSERT(readers == 0 && writer == -1);
+    delete writersOk;
+    delete readersOk;
+    delete lock;
+}
+
+//----------------------------------------------------------------------
+// RWLock::AcquireRead
+//      Hold the lock for reading.  Wait while a writer holds the lock
+//      or waits for it.
+//----------------------------------------------------------------------
+
+void RWLock::AcquireRead()
+{
+    lock->Acquire();
+    while(writer != -1 || waitingWriters > 0)
+        readersOk->Wait(lock);
+    readers++;
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// RWLock::ReleaseRead
+//      Release the lock held for reading.  The last reader lets a
+//      waiting writer in.
+//----------------------------------------------------------------------
+
+void RWLock::ReleaseRead()
+{
+    lock->Acquire();
+    ASSERT(readers > 0);
+    if(--readers == 0 && waitingWriters > 0)
+        writersOk->Signal(lock);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// RWLock::AcquireWrite
+//      Hold the lock for writing.  Wait until no thread holds the lock.
+//----------------------------------------------------------------------
+
+void RWLock::AcquireWrite()
+{
+    lock->Acquire();
+    waitingWriters++;
+    while(writer != -1 || readers > 0)
+        writersOk->Wait(lock);
+    waitingWriters--;
+    writer = currentThread->GetThreadId();
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// RWLock::ReleaseWrite
+//      Release the lock held for writing.  Waiting writers go first;
+//      otherwise every waiting reader is woken up.
+//----------------------------------------------------------------------
+
+void RWLock::ReleaseWrite()
+{
+    lock->Acquire();
+    ASSERT(isWriteHeldByCurrentThread());
+    writer = -1;
+    if(waitingWriters > 0)
+        writersOk->Signal(lock);
+    else
+        readersOk->Broadcast(lock);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// RWLock::isWriteHeldByCurrentThread
+//      Check if the current thread holds this lock for writing.
+//----------------------------------------------------------------------
+
+bool RWLock::isWriteHeldByCurrentThread() { return writer == currentThread->GetThreadId(); }
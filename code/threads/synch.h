@@ -1,11 +1,11 @@
 // synch.h
 //      Data structures for synchronizing threads.
 //
-//      Three kinds of synchronization are defined here: semaphores,
-//      locks, and condition variables.  The implementation for
-//      semaphores is given; for the latter two, only the procedure
-//      interface is given -- they are to be implemented as part of
-//      the first assignment.
+//      Four kinds of synchronization are defined here: semaphores,
+//      locks, condition variables and reader/writer locks.  All of
+//      them are implemented in synch.cc: locks on top of a semaphore,
+//      condition variables with a queue of waiting threads, and
+//      reader/writer locks on top of a lock and two condition variables.
 //
 //      Note that all the synchronization objects take a "name" as
 //      part of the initialization.  This is solely for debugging purposes.
@@ -137,4 +137,43 @@ class Condition
     List *waitQueue; // The waiting queue for the waiting threads
     // plus some other stuff you'll need to define
 };
+
+// The following class defines a "reader/writer lock".  Any number of
+// threads may hold it for reading at the same time, or a single
+// thread for writing:
+//
+//      AcquireRead -- wait until no thread holds or waits for the lock
+//              for writing, then hold it for reading
+//
+//      AcquireWrite -- wait until no thread holds the lock, then hold
+//              it for writing
+//
+// Writers have priority over new readers, so that a steady stream of
+// readers can't starve them.  As with locks, only the thread that
+// acquired the lock for writing may release it.
+
+class RWLock
+{
+  public:
+    RWLock (const char *debugName); // initialize lock to be FREE
+    ~RWLock ();                     // deallocate lock
+    const char *getName () { return name; }
+
+    void AcquireRead ();  // hold the lock, shared with other readers
+    void ReleaseRead ();
+    void AcquireWrite (); // hold the lock exclusively
+    void ReleaseWrite ();
+
+    bool isWriteHeldByCurrentThread (); // true if the current thread
+                                        // holds this lock for writing
+
+  private:
+    const char *name;      // for debugging
+    Lock *lock;            // Protects the fields below
+    Condition *readersOk;  // Signaled when readers may proceed
+    Condition *writersOk;  // Signaled when a writer may proceed
+    int readers;           // Number of threads holding it for reading
+    int waitingWriters;    // Number of threads waiting in AcquireWrite
+    int writer;            // Thread holding it for writing, or -1
+};
 #endif // SYNCH_H
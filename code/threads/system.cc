@@ -25,6 +25,7 @@ FileSystem *fileSystem;
 
 #ifdef FILESYS
 SynchDisk *synchDisk;
+Journal *journal;
 #endif
 
 #ifdef USER_PROGRAM // requires either FILESYS or FILESYS_STUB
@@ -39,6 +40,8 @@ SynchConsole *synchconsole; // console to communicate
 #endif
 
 #ifdef NETWORK
+PacketPool *packetPool;
+PacketSwitch *packetSwitch;
 PostOffice *postOffice;
 #endif
 
@@ -98,9 +101,13 @@ void Initialize(int argc, char **argv) {
 #ifdef NETWORK
     double rely = 1; // network reliability
     int netname = 0; // UNIX socket name
+    int window = DEFAULT_WINDOW; // segments in flight per payload
+    bool inProcess = FALSE; // machines connected by an in-memory switch
 #endif
 #ifdef FILESYS
     char diskName[MAX_STRING_SIZE] = "DISK";
+    DiskPolicy diskPolicy = DiskCSCAN; // disk request scheduling
+    bool diskMapped = FALSE;           // map the disk file in memory
 #endif
 
     for (argc--, argv++; argc > 0; argc -= argCount, argv += argCount)
@@ -144,12 +151,47 @@ void Initialize(int argc, char **argv) {
             netname = atoi(*(argv + 1));
             argCount = 2;
         }
+        else if (!strcmp(*argv, "-mtu"))
+        {
+            ASSERT(argc > 1);
+            wireSize = atoi(*(argv + 1));
+            ASSERT(wireSize >= DefaultWireSize && wireSize <= MaxWireLimit);
+            argCount = 2;
+        }
+        else if (!strcmp(*argv, "-w"))
+        {
+            ASSERT(argc > 1);
+            window = atoi(*(argv + 1));
+            ASSERT(window >= 1 && window <= MAXWINDOW);
+            argCount = 2;
+        }
+        else if (!strcmp(*argv, "-switch"))
+        {
+            inProcess = TRUE;
+        }
 #endif
 #ifdef FILESYS
         else if (!strcmp(*argv, "-disk")) {
             ASSERT(argc > 1);
             strncpy(diskName, *(argv + 1), MAX_STRING_SIZE);
+            argCount = 2;
+        }
+        else if (!strcmp(*argv, "-ds")) {
+            ASSERT(argc > 1);
+            if (!strcmp(*(argv + 1), "fifo"))
+                diskPolicy = DiskFIFO;
+            else if (!strcmp(*(argv + 1), "sstf"))
+                diskPolicy = DiskSSTF;
+            else if (!strcmp(*(argv + 1), "scan"))
+                diskPolicy = DiskSCAN;
+            else {
+                ASSERT(!strcmp(*(argv + 1), "cscan")); // no other policy
+                diskPolicy = DiskCSCAN;
+            }
+            argCount = 2;
         }
+        else if (!strcmp(*argv, "-dmap"))
+            diskMapped = TRUE;
 #endif
     }
 
@@ -176,7 +218,8 @@ void Initialize(int argc, char **argv) {
 #endif
 
 #ifdef FILESYS
-    synchDisk = new SynchDisk(diskName);
+    synchDisk = new SynchDisk(diskName, diskPolicy, diskMapped);
+    journal = new Journal(format); // replays the log before mounting
 #endif
 
 #ifdef FILESYS_NEEDED
@@ -184,7 +227,9 @@ void Initialize(int argc, char **argv) {
 #endif
 
 #ifdef NETWORK
-    postOffice = new PostOffice(netname, rely, 10);
+    packetPool = new PacketPool(PacketPoolSize);
+    packetSwitch = inProcess ? new PacketSwitch() : NULL;
+    postOffice = new PostOffice(netname, rely, 10, window);
 #endif
 }
 
@@ -209,6 +254,7 @@ void Cleanup() {
 #endif
 
 #ifdef FILESYS
+    delete journal;
     delete synchDisk;
 #endif
 
@@ -217,6 +263,8 @@ void Cleanup() {
     delete interrupt;
 #ifdef NETWORK
     delete postOffice;
+    delete packetSwitch;
+    delete packetPool;
 #endif
     Exit(0);
 }
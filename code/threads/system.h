@@ -49,12 +49,17 @@ extern FileSystem *fileSystem;
 #endif
 
 #ifdef FILESYS
+#include "journal.h"
 #include "synchdisk.h"
 extern SynchDisk *synchDisk;
+extern Journal *journal; // log of the file system metadata
 #endif
 
 #ifdef NETWORK
 #include "post.h"
+extern PacketPool *packetPool; // buffers of the network packets
+extern PacketSwitch *packetSwitch; // connects the machines simulated in
+                                   // this process, NULL for UNIX sockets
 extern PostOffice *postOffice;
 #endif
 
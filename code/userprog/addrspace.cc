@@ -179,6 +179,9 @@ AddrSpace::AddrSpace(unsigned int nPages)
     InitializeThreadData();
     semBitmap = new BitMap(MAX_SEM);
     semList = new Semaphore *[MAX_SEM];
+#ifdef FILESYS
+    files = new FileTable;
+#endif
 }
 
 AddrSpace::AddrSpace(OpenFile *executable)
@@ -256,15 +259,22 @@ AddrSpace::AddrSpace(OpenFile *executable)
     InitializeThreadData();
     semBitmap = new BitMap(MAX_SEM);
     semList = new Semaphore *[MAX_SEM];
+#ifdef FILESYS
+    files = new FileTable;
+#endif
 }
 
 //----------------------------------------------------------------------
 // AddrSpace::~AddrSpace
-//      Dealloate an address space.  Nothing for now!
+//      Dealloate an address space, closing the files left open.
 //----------------------------------------------------------------------
 
 AddrSpace::~AddrSpace()
 {
+#ifdef FILESYS
+    fileSystem->CloseAllUser(files);
+    delete files;
+#endif
     // LB: Missing [] for delete
     // delete pageTable;
     delete[] pageTable;
@@ -84,6 +84,9 @@ class AddrSpace
     thread_info_t **localThreadsInfos;
     BitMap *threadsBitmap; // BitMap used to indicate whether a thread stack is free or not
     unsigned int nextUserThreadid;
+#ifdef FILESYS
+    FileTable *files; // Descriptors of the files opened by the process
+#endif
 
   private:
     int stackStartAddrs[(MaxThreadsPerProcess)]; // arstack start addrs
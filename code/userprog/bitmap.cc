@@ -124,6 +124,41 @@ int BitMap::FindStart(int startPoint)
     return -1;
 }
 
+//----------------------------------------------------------------------
+// BitMap::FindRun
+//      Return the number of the first bit of a run of consecutive clear
+//      bits, and set "*length" to the size of that run.  The first run
+//      of at least "wanted" bits is taken; if there is none, the longest
+//      run is taken instead.
+//      As a side effect, set the bits of the run (mark them as in use).
+//
+//      If no bits are clear, return -1.
+//----------------------------------------------------------------------
+
+int BitMap::FindRun(int wanted, int *length)
+{
+    int i, start, runStart = -1, runLength = 0;
+
+    for(i = 0; i < numBits && runLength < wanted; i++)
+    {
+        if(Test(i))
+            continue;
+        start = i;
+        while(i < numBits && !Test(i) && i - start < wanted)
+            i++;
+        if(i - start > runLength)
+        {
+            runStart = start;
+            runLength = i - start;
+        }
+    }
+
+    *length = runLength;
+    for(i = 0; i < runLength; i++)
+        Mark(runStart + i);
+    return runStart;
+}
+
 //----------------------------------------------------------------------
 // BitMap::NumClear
 //      Return the number of clear bits in the bitmap.
@@ -43,6 +43,8 @@ class BitMap {
     int Find();            // Return the # of a clear bit, and as a side
         // effect, set the bit. If no bits are clear, return -1.
     int FindStart(int startPoint);
+    int FindRun(int wanted, int *length); // Find and set a run of clear bits,
+        // as long as possible up to "wanted"; return its first bit
     int NumClear(); // Return the number of clear bits
 
     void Print(); // Print contents of bitmap
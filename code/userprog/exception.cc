@@ -75,6 +75,52 @@ void copyStringFromMachine(int from, char *to, unsigned size)
     to[i] = '\0';
 }
 
+//----------------------------------------------------------------------
+//  copyDirectoryToMachine
+//      Write the Readdir records of the files of the current directory
+//      into the user buffer, as long as they fit.
+//
+//      "from" the number of the first file to describe
+//      "to" the address of the user buffer
+//      "size" the size of the user buffer
+//
+//      Return the number of records written, or -1 if even the first
+//      one doesn't fit
+//----------------------------------------------------------------------
+
+static int copyDirectoryToMachine(int from, int to, int size)
+{
+    FileInfo *infos = new FileInfo[ListBatch];
+    int count, i, j, nameLength, length;
+    int used = 0, filled = 0;
+    bool full = FALSE;
+
+    while(!full && (count = fileSystem->ReadDirectory(from + filled, infos, ListBatch)) > 0)
+    {
+        for(i = 0; i < count; i++)
+        {
+            nameLength = strlen(infos[i].name) + 1;
+            length = DirRecordHeader + divRoundUp(nameLength, 4) * 4;
+            if(used + length > size)
+            {
+                full = TRUE;
+                break;
+            }
+
+            machine->WriteMem(to + used, 4, length);
+            machine->WriteMem(to + used + 4, 4, (int)infos[i].type);
+            machine->WriteMem(to + used + 8, 4, infos[i].size);
+            for(j = 0; j < nameLength; j++)
+                machine->WriteMem(to + used + DirRecordHeader + j, 1, (int)infos[i].name[j]);
+            used += length;
+            filled++;
+        }
+    }
+
+    delete[] infos;
+    return (full && filled == 0) ? -1 : filled;
+}
+
 //----------------------------------------------------------------------
 //  synchThreadsMainExit
 //      Synchronize the termination of the main thread with the exit of the
@@ -140,6 +186,9 @@ extern void endProcess()
         threadsLock->Release();
         AddrSpace::nUsedAddrSpaceLock->Release();
         delete AddrSpace::nUsedAddrSpaceLock;
+#ifdef FILESYS
+        fileSystem->Sync(); // write back open files, commit the journal
+#endif
         interrupt->Halt();
         // Stop (never returns from Halt)
     }
@@ -196,6 +245,9 @@ void ExceptionHandler(ExceptionType which)
         case SC_Halt:
             DEBUG('a', "Shutdown, initiated by user program with tid %d.\n",
                   currentThread->GetThreadId());
+#ifdef FILESYS
+            fileSystem->Sync(); // write back open files, commit the journal
+#endif
             interrupt->Halt();
             break;
         case SC_Sendprocess:
@@ -235,8 +287,9 @@ void ExceptionHandler(ExceptionType which)
             break;
         case SC_Create:
             start_addr = machine->ReadRegister(4);
+            size = machine->ReadRegister(5);
             copyStringFromMachine(start_addr, put_str, MAX_STRING_SIZE);
-            value = fileSystem->Create(put_str, 0);
+            value = (size >= 0) && fileSystem->Create(put_str, size, TRUE);
             machine->WriteRegister(2, value);
             break;
         case SC_Remove:
@@ -245,6 +298,14 @@ void ExceptionHandler(ExceptionType which)
             value = fileSystem->Remove(put_str);
             machine->WriteRegister(2, value);
             break;
+        case SC_Copy:
+            start_addr = machine->ReadRegister(4);
+            copyStringFromMachine(start_addr, put_str, MAX_STRING_SIZE);
+            start_addr = machine->ReadRegister(5);
+            copyStringFromMachine(start_addr, get_str, MAX_STRING_SIZE);
+            value = fileSystem->CopyFile(put_str, get_str);
+            machine->WriteRegister(2, value);
+            break;
         case SC_Open:
             start_addr = machine->ReadRegister(4);
             copyStringFromMachine(start_addr, put_str, MAX_STRING_SIZE);
@@ -283,6 +344,12 @@ void ExceptionHandler(ExceptionType which)
             value = machine->ReadRegister(5);
             fileSystem->SeekUser(fd, value);
             break;
+        case SC_Preallocate:
+            fd = machine->ReadRegister(4);
+            size = machine->ReadRegister(5);
+            value = fileSystem->PreallocateUser(fd, size);
+            machine->WriteRegister(2, value);
+            break;
         case SC_Putchar:
             ch = machine->ReadRegister(4);
             DEBUG('a', "PutChar, put a char %c in stdout.\n", ch);
@@ -395,6 +462,13 @@ void ExceptionHandler(ExceptionType which)
         case SC_Listfiles:
             fileSystem->List();
             break;
+        case SC_Readdir:
+            value = machine->ReadRegister(4);
+            start_addr = machine->ReadRegister(5);
+            size = machine->ReadRegister(6);
+            value = copyDirectoryToMachine(value, start_addr, size);
+            machine->WriteRegister(2, value);
+            break;
         case SC_Changedir:
             start_addr = machine->ReadRegister(4);
             copyStringFromMachine(start_addr, put_str, MAX_STRING_SIZE);
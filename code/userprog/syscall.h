@@ -54,6 +54,11 @@
 #define SC_Sendfile 35
 #define SC_Receivefile 36 
 #define SC_Startftpserver 37 
+#define SC_Preallocate 38
+#define SC_Copy 39
+#define SC_Readdir 40
+
+#define DirRecordHeader 12 // Bytes before the name in a Readdir record
 
 #ifdef IN_USER_MODE
 
@@ -98,10 +103,18 @@ void Exit(int status) __attribute__((noreturn));
  * the console device.
  */
 
-/* Create a Nachos file, with "name" */
-int Create(char *name);
+/* Create a Nachos file, with "name".  If "size" is not 0, the disk space
+ * for "size" bytes is allocated at once, so that writing the file up to
+ * that size never has to allocate sectors; the file is still empty.
+ */
+int Create(char *name, int size);
 
 int Remove(char *name);
+
+/* Copy the file "from" into a new file "to", inside the kernel.
+ * Return 1 on success, 0 otherwise.
+ */
+int Copy(char *from, char *to);
     
 /* Open the Nachos file "name", and return an "OpenFileId" that can
  * be used to read and write to the file.
@@ -174,10 +187,35 @@ int Rmdir(char *s);
 
 char *Listfiles();
 
+/* Record filled by Readdir for each file of the current directory.  The
+ * name is null-terminated, and the record padded to a multiple of 4
+ * bytes: the next record starts "length" bytes after this one.
+ */
+typedef struct {
+    int length;   /* Size of this record, in bytes */
+    int type;     /* 0 for a data file, 1 for a directory, 2 for the root */
+    int size;     /* Size of the file, in bytes ("." and ".." have none) */
+    char name[4]; /* Name of the file (variable length) */
+} DirRecord;
+
+/* Fill "buffer", of "size" bytes and word aligned, with the records of
+ * the files of the current directory, starting with the from-th one.
+ * The types and sizes are taken from the directory itself.  Return the
+ * number of records filled, 0 when there are no more files, or -1 if
+ * the buffer is too small for the next record.
+ */
+int Readdir(int from, char *buffer, int size);
+
 int Changedir(char *s);
 
 void Seek(int fd, int offset);
 
+/* Allocate the disk space for the open file "fd" to hold "size" bytes,
+ * without writing it nor changing the size of the file (as fallocate
+ * with FALLOC_FL_KEEP_SIZE).  Return 0, or -1 if the disk is full.
+ */
+int Preallocate(int fd, int size);
+
 // should only be called by main
 // if stopAfter != 0 : stop the calling thread after sending the process 
 // return : -1 if the process hasn't been send,